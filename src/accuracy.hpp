@@ -0,0 +1,252 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "resumable.hpp"
+#include "batch.hpp"
+#include "physics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+//Solves a scenario corpus with every integrator and time step and measures the angle error against
+//a fine RK4 reference (and the closed form vacuum angle when there is no drag) next to the cost.
+//The configurations that no other one beats on both error and cost (steps times acceleration
+//evaluations per step, so it does not depend on the machine) form the Pareto front.
+class Accuracy {
+    public:
+        static double REFERENCE_DELTA_TIME;
+
+        struct Configuration{
+            Physics::Integrator integrator;
+            double delta_time;
+        };
+
+        struct Measurement{
+            size_t scenario;
+            Configuration configuration;
+            Simulation::ShotResultEnum result;
+            double angle;
+            double time; //of flight
+            double angle_error; //degrees, against the reference solve
+            double time_error; //seconds of flight, against the reference solve
+            double analytic_error; //degrees, NaN when there is no closed form
+            double seconds;
+            uint64_t steps;
+        };
+
+        //one configuration over the whole corpus
+        struct Point{
+            Configuration configuration;
+            double max_angle_error = 0.0;
+            double mean_angle_error = 0.0;
+            double max_time_error = 0.0;
+            double seconds = 0.0;
+            uint64_t steps = 0;
+            uint64_t evaluations = 0;
+            size_t failures = 0; //scenarios the reference hits but this configuration does not
+            bool pareto = false;
+        };
+
+        static std::vector<double> defaultDeltaTimes(){
+            return {0.1, 0.05, 0.02, 0.01, 0.005, 0.002, 0.001, 0.0005};
+        }
+
+        static std::vector<Physics::Integrator> defaultIntegrators(){
+            return {Physics::TRAPEZOID, Physics::EULER, Physics::HEUN, Physics::RK4};
+        }
+
+        //low arc in vacuum: tan(theta) = (v^2 - sqrt(v^4 - g (g x^2 + 2 y v^2))) / (g x), returned as a simulateShot angle
+        static bool analyticAngle(const Batch::Scenario& scenario, double& angle){
+            if(Physics::AIR_DENSITY != 0.0){
+                return false;
+            }
+            glm::dvec3 up = Simulation::UP_VECTOR;
+            double g = glm::dot(-Physics::GRAVITY, up);
+            glm::dvec3 offset = scenario.target_position - scenario.shooter_position;
+            double y = glm::dot(offset, up);
+            double x = glm::length(offset - y * up);
+            double v2 = scenario.shoot_speed * scenario.shoot_speed;
+            double discriminant = v2 * v2 - g * (g * x * x + 2.0 * y * v2);
+            if(g <= 0.0 || x <= 0.0 || discriminant < 0.0){
+                return false;
+            }
+            double elevation = std::atan((v2 - std::sqrt(discriminant)) / (g * x));
+            angle = glm::degrees(elevation - std::atan2(y, x));
+            return true;
+        }
+
+        //Switches the process-wide Physics::INTEGRATOR for every configuration and restores it on return
+        //or throw, so nothing else may fly shots while the harness runs.
+        static std::vector<Measurement> run(const std::vector<Batch::Scenario>& scenarios,
+                                            const std::vector<Physics::Integrator>& integrators = defaultIntegrators(),
+                                            const std::vector<double>& delta_times = defaultDeltaTimes()){
+            std::vector<Measurement> measurements;
+            IntegratorScope integrator_scope;
+            for(size_t i = 0; i < scenarios.size(); i++){
+                Physics::INTEGRATOR = Physics::RK4;
+                Measurement reference = solve(i, scenarios[i], {Physics::RK4, REFERENCE_DELTA_TIME});
+                double analytic = std::numeric_limits<double>::quiet_NaN();
+                analyticAngle(scenarios[i], analytic);
+
+                for(Physics::Integrator integrator : integrators){
+                    Physics::INTEGRATOR = integrator;
+                    for(double delta_time : delta_times){
+                        Measurement measurement = solve(i, scenarios[i], {integrator, delta_time});
+                        if(reference.result == Simulation::ShotResultEnum::HIT){
+                            measurement.angle_error = std::abs(measurement.angle - reference.angle);
+                            measurement.time_error = std::abs(measurement.time - reference.time);
+                        } else {
+                            measurement.angle_error = std::numeric_limits<double>::quiet_NaN();
+                            measurement.time_error = std::numeric_limits<double>::quiet_NaN();
+                        }
+                        measurement.analytic_error = std::abs(measurement.angle - analytic);
+                        measurements.push_back(measurement);
+                    }
+                }
+            }
+            return measurements;
+        }
+
+        static std::vector<Point> pareto(const std::vector<Measurement>& measurements){
+            std::vector<Point> points;
+            std::vector<size_t> counted;
+            for(const Measurement& measurement : measurements){
+                auto it = std::find_if(points.begin(), points.end(), [&](const Point& point){
+                    return point.configuration.integrator == measurement.configuration.integrator
+                        && point.configuration.delta_time == measurement.configuration.delta_time;
+                });
+                if(it == points.end()){
+                    points.push_back(Point());
+                    points.back().configuration = measurement.configuration;
+                    counted.push_back(0);
+                    it = points.end() - 1;
+                }
+                Point& point = *it;
+                point.seconds += measurement.seconds;
+                point.steps += measurement.steps;
+                point.evaluations += measurement.steps * Physics::integratorStages(measurement.configuration.integrator);
+                if(std::isnan(measurement.angle_error)){
+                    continue;
+                }
+                if(measurement.result != Simulation::ShotResultEnum::HIT){
+                    point.failures++;
+                }
+                point.max_angle_error = std::max(point.max_angle_error, measurement.angle_error);
+                point.max_time_error = std::max(point.max_time_error, measurement.time_error);
+                point.mean_angle_error += measurement.angle_error;
+                counted[it - points.begin()]++;
+            }
+            for(size_t i = 0; i < points.size(); i++){
+                if(counted[i] > 0){
+                    points[i].mean_angle_error /= counted[i];
+                }
+            }
+
+            for(Point& point : points){
+                point.pareto = point.failures == 0;
+                for(const Point& other : points){
+                    if(&other == &point || other.failures > 0){
+                        continue;
+                    }
+                    bool no_worse = other.max_angle_error <= point.max_angle_error && other.evaluations <= point.evaluations;
+                    bool better = other.max_angle_error < point.max_angle_error || other.evaluations < point.evaluations;
+                    if(no_worse && better){
+                        point.pareto = false;
+                        break;
+                    }
+                }
+            }
+            std::sort(points.begin(), points.end(), [](const Point& a, const Point& b){
+                return a.evaluations < b.evaluations;
+            });
+            return points;
+        }
+
+        static std::string csv(const std::vector<Point>& points){
+            std::string text = "integrator,delta_time,max_angle_error,mean_angle_error,max_time_error,seconds,steps,evaluations,failures,pareto\n";
+            char line[256];
+            for(const Point& point : points){
+                std::snprintf(line, sizeof(line), "%s,%.9g,%.9g,%.9g,%.9g,%.6f,%llu,%llu,%zu,%d\n",
+                    Physics::integratorName(point.configuration.integrator), point.configuration.delta_time,
+                    point.max_angle_error, point.mean_angle_error, point.max_time_error, point.seconds,
+                    (unsigned long long)point.steps, (unsigned long long)point.evaluations, point.failures, point.pareto ? 1 : 0);
+                text += line;
+            }
+            return text;
+        }
+
+        static std::string json(const std::vector<Point>& points, const std::vector<Measurement>& measurements){
+            char line[512];
+            std::string text = "{\n  \"reference_delta_time\": ";
+            std::snprintf(line, sizeof(line), "%.9g", REFERENCE_DELTA_TIME);
+            text += line;
+            text += ",\n  \"points\": [";
+            for(size_t i = 0; i < points.size(); i++){
+                const Point& point = points[i];
+                std::snprintf(line, sizeof(line), "%s\n    {\"integrator\": \"%s\", \"delta_time\": %.9g, \"max_angle_error\": %s, \"mean_angle_error\": %s, "
+                    "\"max_time_error\": %s, \"seconds\": %.6f, \"steps\": %llu, \"evaluations\": %llu, \"failures\": %zu, \"pareto\": %s}", i > 0 ? "," : "",
+                    Physics::integratorName(point.configuration.integrator), point.configuration.delta_time,
+                    number(point.max_angle_error).c_str(), number(point.mean_angle_error).c_str(), number(point.max_time_error).c_str(),
+                    point.seconds, (unsigned long long)point.steps, (unsigned long long)point.evaluations, point.failures, point.pareto ? "true" : "false");
+                text += line;
+            }
+            text += "\n  ],\n  \"measurements\": [";
+            for(size_t i = 0; i < measurements.size(); i++){
+                const Measurement& measurement = measurements[i];
+                std::snprintf(line, sizeof(line), "%s\n    {\"scenario\": %zu, \"integrator\": \"%s\", \"delta_time\": %.9g, \"result\": \"%s\", \"angle\": %.12g, "
+                    "\"angle_error\": %s, \"time_error\": %s, \"analytic_error\": %s, \"seconds\": %.6f, \"steps\": %llu}", i > 0 ? "," : "",
+                    measurement.scenario, Physics::integratorName(measurement.configuration.integrator), measurement.configuration.delta_time,
+                    Batch::resultName(measurement.result), measurement.angle, number(measurement.angle_error).c_str(),
+                    number(measurement.time_error).c_str(), number(measurement.analytic_error).c_str(), measurement.seconds,
+                    (unsigned long long)measurement.steps);
+                text += line;
+            }
+            text += "\n  ]\n}\n";
+            return text;
+        }
+
+    private:
+        class IntegratorScope{
+            public:
+                IntegratorScope() : previous(Physics::INTEGRATOR) {}
+                ~IntegratorScope(){
+                    Physics::INTEGRATOR = previous;
+                }
+            private:
+                Physics::Integrator previous;
+        };
+
+        static Measurement solve(size_t index, const Batch::Scenario& scenario, const Configuration& configuration){
+            Batch::Scenario configured = scenario;
+            configured.delta_time = configuration.delta_time;
+            Simulation simulation(configured.shooter_position, configured.target_position, configured.shoot_speed, configured.shoot_height, configured.delta_time);
+
+            //resumed without a budget so the steps are counted on the path every solve takes
+            auto start = std::chrono::steady_clock::now();
+            ResumableSolve solve(simulation, (Simulation::Strategy)configured.strategy);
+            solve.resume(ResumableSolve::Budget());
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const Simulation::StrategyResult& result = solve.result();
+            uint64_t steps = solve.getSteps();
+
+            double nan = std::numeric_limits<double>::quiet_NaN();
+            return {index, configuration, result.best_result.result, result.best_angle, result.best_result.time, nan, nan, nan, seconds, steps};
+        }
+
+        //JSON has no NaN
+        static std::string number(double value){
+            if(!std::isfinite(value)){
+                return "null";
+            }
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.9g", value);
+            return text;
+        }
+};
+
+double Accuracy::REFERENCE_DELTA_TIME = 0.0001;
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "components.hpp"
+#include "physics.hpp"
+#include <entt/entt.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+
+//Many live projectiles in one persistent registry. Launches are scheduled ahead of time,
+//every step integrates all of them in one Physics::update and retires the ones that
+//crossed the ground plane in a single batch.
+class Barrage {
+    public:
+        struct Launch{
+            double time;
+            glm::dvec3 position;
+            glm::dvec3 velocity;
+            double mass;
+            double air_resistance;
+        };
+
+        struct Impact{
+            double time;
+            glm::dvec3 position;
+        };
+
+        //number of recent impacts kept for display
+        static size_t IMPACT_HISTORY;
+
+        entt::registry registry;
+
+        Barrage(const glm::dvec3& up = glm::dvec3(0.0, 1.0, 0.0), double ground_height = 0.0) : up(up), ground_height(ground_height) {}
+
+        void schedule(const Launch& launch){
+            pending.push_back(launch);
+            sorted = false;
+        }
+
+        //count shots from origin, elevations and azimuths spread uniformly around the given aim,
+        //launch times spread uniformly over duration
+        void salvo(const glm::dvec3& origin, double speed, double elevation, double azimuth, double spread,
+                   int count, double duration, double mass, double air_resistance, unsigned seed = 1){
+            std::mt19937 generator(seed);
+            std::uniform_real_distribution<double> offset(-0.5 * spread, 0.5 * spread);
+            std::uniform_real_distribution<double> delay(0.0, std::max(duration, 0.0));
+
+            glm::dvec3 forward = glm::cross(up, glm::dvec3(0.0, 0.0, 1.0));
+            if(glm::length(forward) < 0.5){
+                forward = glm::cross(up, glm::dvec3(1.0, 0.0, 0.0));
+            }
+            forward = glm::normalize(forward);
+            glm::dvec3 side = glm::cross(up, forward);
+
+            for(int i = 0; i < count; i++){
+                double e = glm::radians(elevation + offset(generator));
+                double a = glm::radians(azimuth + offset(generator));
+                glm::dvec3 horizontal = glm::cos(a) * forward + glm::sin(a) * side;
+                glm::dvec3 velocity = speed * (glm::cos(e) * horizontal + glm::sin(e) * up);
+                schedule({time + delay(generator), origin, velocity, mass, air_resistance});
+            }
+        }
+
+        void step(double delta_time){
+            Physics::update(registry, delta_time);
+            time += delta_time;
+            launchDue();
+            retireImpacts(delta_time);
+        }
+
+        void clear(){
+            registry.clear();
+            pending.clear();
+            impacts.clear();
+            impact_count = 0;
+            active_count = 0;
+            time = 0.0;
+        }
+
+        template<typename F>
+        void each(F function){
+            auto group = registry.group<Position, Velocity, Mass>();
+            for(auto entity : group){
+                auto [position, velocity] = group.template get<Position, Velocity>(entity);
+                function(position, velocity);
+            }
+        }
+
+        size_t active() const{
+            return active_count;
+        }
+
+        size_t scheduled() const{
+            return pending.size();
+        }
+
+        size_t impacted() const{
+            return impact_count;
+        }
+
+        double currentTime() const{
+            return time;
+        }
+
+        const std::vector<Impact>& recentImpacts() const{
+            return impacts;
+        }
+
+    private:
+        //launches that fell inside the last step are flown individually for the part of the
+        //step after their launch time, so launch times are not rounded to the step size
+        void launchDue(){
+            if(!sorted){
+                std::sort(pending.begin(), pending.end(), [](const Launch& a, const Launch& b){
+                    return a.time > b.time;
+                });
+                sorted = true;
+            }
+            launched.clear();
+            while(!pending.empty() && pending.back().time <= time){
+                Launch launch = pending.back();
+                pending.pop_back();
+
+                Position position = {launch.position, launch.position};
+                Velocity velocity = {launch.velocity};
+                Mass mass = {launch.mass, launch.air_resistance};
+                double lead = time - launch.time;
+                if(lead > 0.0){
+                    Physics::integrate(position, velocity, mass, lead);
+                }
+
+                auto projectile = registry.create();
+                registry.emplace<Position>(projectile, position);
+                registry.emplace<Velocity>(projectile, velocity);
+                registry.emplace<Mass>(projectile, mass);
+                launched.push_back({projectile, lead});
+                active_count++;
+            }
+        }
+
+        void retireImpacts(double delta_time){
+            retired.clear();
+            auto group = registry.group<Position, Velocity, Mass>();
+            for(auto entity : group){
+                const Position& position = group.template get<Position>(entity);
+                double height = glm::dot(position.position, up) - ground_height;
+                if(height >= 0.0){
+                    continue;
+                }
+                retired.push_back(entity);
+
+                //previous_position of a projectile launched in this step is its launch point, lead before now
+                double interval = delta_time;
+                for(const auto& [projectile, lead] : launched){
+                    if(projectile == entity){
+                        interval = lead;
+                    }
+                }
+                double previous = glm::dot(position.previous_position, up) - ground_height;
+                double s = previous > height ? glm::clamp(previous / (previous - height), 0.0, 1.0) : 1.0;
+                if(impacts.size() >= IMPACT_HISTORY && !impacts.empty()){
+                    impacts.erase(impacts.begin(), impacts.begin() + impacts.size() / 2);
+                }
+                impacts.push_back({time - (1.0 - s) * interval, position.previous_position + (position.position - position.previous_position) * s});
+            }
+            registry.destroy(retired.begin(), retired.end());
+            impact_count += retired.size();
+            active_count -= retired.size();
+        }
+
+        glm::dvec3 up;
+        double ground_height;
+        double time = 0.0;
+        std::vector<Launch> pending;
+        bool sorted = true;
+        std::vector<entt::entity> retired;
+        std::vector<std::pair<entt::entity, double>> launched; //projectiles of the last step and their lead
+        std::vector<Impact> impacts;
+        size_t impact_count = 0;
+        size_t active_count = 0;
+};
+
+size_t Barrage::IMPACT_HISTORY = 4096;
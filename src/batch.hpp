@@ -0,0 +1,119 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+//headless solver, one scenario per line:
+//shooter_x shooter_y shooter_z target_x target_y target_z shoot_speed shoot_height delta_time [strategy]
+//strategy is a Simulation::Strategy value from 1 to 4, 2 when omitted
+class Batch {
+    public:
+        struct Scenario{
+            glm::dvec3 shooter_position;
+            glm::dvec3 target_position;
+            double shoot_speed;
+            double shoot_height;
+            double delta_time;
+            int strategy = 2;
+        };
+
+        static const char* resultName(Simulation::ShotResultEnum result){
+            switch(result){
+                case Simulation::ShotResultEnum::HIT: return "HIT";
+                case Simulation::ShotResultEnum::TOO_HIGH: return "TOO_HIGH";
+                case Simulation::ShotResultEnum::TOO_LOW: return "TOO_LOW";
+                case Simulation::ShotResultEnum::NO_TIME: return "NO_TIME";
+                case Simulation::ShotResultEnum::NO_IN_RANGE: return "NO_IN_RANGE";
+                case Simulation::ShotResultEnum::TERRAIN: return "TERRAIN";
+                default: return "UNKNOWN";
+            }
+        }
+
+        static bool parseScenario(const std::string& line, Scenario& scenario){
+            std::istringstream in(line);
+            if(!(in >> scenario.shooter_position.x >> scenario.shooter_position.y >> scenario.shooter_position.z
+                    >> scenario.target_position.x >> scenario.target_position.y >> scenario.target_position.z
+                    >> scenario.shoot_speed >> scenario.shoot_height >> scenario.delta_time)){
+                return false;
+            }
+            if(!(in >> scenario.strategy)){
+                scenario.strategy = 2;
+            }
+            return scenario.strategy >= Simulation::BISECTION && scenario.strategy <= Simulation::K_ARY;
+        }
+
+        //skips empty lines and lines starting with #
+        static std::vector<Scenario> load(const std::string& path){
+            std::ifstream file(path);
+            if(!file){
+                throw std::runtime_error("Cannot open scenario file " + path);
+            }
+            std::vector<Scenario> scenarios;
+            std::string line;
+            size_t line_number = 0;
+            while(std::getline(file, line)){
+                line_number++;
+                size_t start = line.find_first_not_of(" \t\r");
+                if(start == std::string::npos || line[start] == '#'){
+                    continue;
+                }
+                Scenario scenario;
+                if(!parseScenario(line, scenario)){
+                    throw std::runtime_error("Invalid scenario on line " + std::to_string(line_number) + " of " + path);
+                }
+                scenarios.push_back(scenario);
+            }
+            return scenarios;
+        }
+
+        static Simulation::StrategyResult solve(const Scenario& scenario, Simulation::ShotCache* cache = nullptr, const Terrain* terrain = nullptr){
+            Simulation simulation(scenario.shooter_position, scenario.target_position, scenario.shoot_speed, scenario.shoot_height, scenario.delta_time);
+            simulation.setCache(cache);
+            simulation.setTerrain(terrain);
+            return simulation.find_angle((Simulation::Strategy)scenario.strategy);
+        }
+
+        //results keep the order of the scenarios whatever the number of threads
+        static std::vector<Simulation::StrategyResult> run(const std::vector<Scenario>& scenarios, unsigned threads = 1, Simulation::ShotCache* cache = nullptr,
+                                                          const Terrain* terrain = nullptr){
+            std::vector<Simulation::StrategyResult> results(scenarios.size());
+            std::atomic<size_t> next{0};
+            auto worker = [&](){
+                for(size_t i = next++; i < scenarios.size(); i = next++){
+                    Trace::Scope trace("scenario", "batch");
+                    trace.arg("index", (int64_t)i);
+                    results[i] = solve(scenarios[i], cache, terrain);
+                }
+            };
+
+            threads = std::max(1u, threads);
+            std::vector<std::thread> workers;
+            for(unsigned i = 1; i < threads; i++){
+                workers.emplace_back([&worker, i](){
+                    Trace::setThreadName("batch worker " + std::to_string(i));
+                    worker();
+                });
+            }
+            worker();
+            for(auto& thread : workers){
+                thread.join();
+            }
+            return results;
+        }
+
+        static std::string format(size_t index, const Simulation::StrategyResult& result){
+            char line[256];
+            std::snprintf(line, sizeof(line), "%zu %s %.12g %.12g %.12g %u", index, resultName(result.best_result.result),
+                result.best_angle, result.best_result.distance, result.best_result.time, result.tries);
+            return line;
+        }
+};
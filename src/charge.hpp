@@ -0,0 +1,225 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "trajectory.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+//Charge selection: searches muzzle speed with the elevation solved at every speed. The minimum speed
+//that reaches the target (within max_time, when given) is bracketed upwards from the vacuum bound,
+//which drag can only raise, and bisected. A required impact angle is then met on the low arc by false
+//position on speed above that minimum, the low arc only flattens as the speed grows. After the first
+//hit every elevation solve is warm started from the angle of the previous speed. The vacuum bound is
+//the only pruning: the solver's reachability precheck is off for the inner solves, it would sweep a
+//new envelope at every speed tried, so shots counts every trajectory flown.
+class Charge {
+    public:
+        static double GROWTH; //of the speed bracket while nothing reaches the target
+        static uint32_t MAX_ITERATIONS;
+
+        struct Constraints{
+            double min_speed = 1.0;
+            double max_speed = 1000.0;
+            double speed_tolerance = 0.1; //m/s
+            double max_time = std::numeric_limits<double>::infinity(); //of flight
+            double impact_angle = std::numeric_limits<double>::quiet_NaN(); //degrees below the horizontal, NaN for any
+            double angle_tolerance = 0.5; //degrees
+            double warm_width = 1.0; //half width of the warm bracket, degrees
+            Simulation::Strategy strategy = Simulation::BISECTION; //until the first hit
+        };
+
+        struct Solution{
+            bool found = false;
+            double speed = 0.0;
+            double angle = 0.0; //simulateShot angle
+            double elevation = 0.0; //above the horizontal
+            double impact_angle = std::numeric_limits<double>::quiet_NaN(); //only measured when constrained
+            Simulation::ShotResult result = {Simulation::ShotResultEnum::NO_IN_RANGE, 0.0, 0.0};
+            uint32_t shots = 0;
+            uint32_t solves = 0; //elevation solves, one per speed tried
+        };
+
+        //v^2 = g (y + sqrt(x^2 + y^2)), 0 without gravity along UP_VECTOR
+        static double vacuumSpeed(const glm::dvec3& shooter_position, const glm::dvec3& target_position){
+            glm::dvec3 up = Simulation::UP_VECTOR;
+            double g = glm::dot(-Physics::GRAVITY, up);
+            glm::dvec3 offset = target_position - shooter_position;
+            double y = glm::dot(offset, up);
+            double x = glm::length(offset - y * up);
+            if(g <= 0.0){
+                return 0.0;
+            }
+            return std::sqrt(std::max(0.0, g * (y + std::sqrt(x * x + y * y))));
+        }
+
+        //simulation supplies everything but the speed
+        static Solution solve(const Simulation& simulation, const Constraints& constraints){
+            Search search(simulation, constraints);
+            //a falling arc always comes in steeper than the line of sight
+            glm::dvec3 offset = simulation.getTargetPosition() - simulation.getShooterPosition();
+            double rise = glm::dot(offset, Simulation::UP_VECTOR);
+            double sight = -glm::degrees(std::atan2(rise, glm::length(offset - rise * Simulation::UP_VECTOR)));
+            if(constraints.impact_angle < sight - constraints.angle_tolerance){
+                return search.finish(Solution());
+            }
+
+            double low = std::max(constraints.min_speed, vacuumSpeed(simulation.getShooterPosition(), simulation.getTargetPosition()));
+            if(low > constraints.max_speed){
+                return search.finish(Solution());
+            }
+
+            Solution best = search.attempt(low);
+            if(!best.found){
+                double high = low;
+                while(!best.found){
+                    if(high >= constraints.max_speed || search.solves >= MAX_ITERATIONS){
+                        return search.finish(best);
+                    }
+                    low = high;
+                    high = std::min(constraints.max_speed, high * GROWTH);
+                    best = search.attempt(high);
+                }
+                while(best.speed - low > constraints.speed_tolerance && search.solves < MAX_ITERATIONS){
+                    Solution middle = search.attempt((low + best.speed) / 2.0);
+                    if(middle.found){
+                        best = middle;
+                    } else {
+                        low = middle.speed;
+                    }
+                }
+            }
+            if(std::isnan(constraints.impact_angle)){
+                return search.finish(best);
+            }
+            return search.finish(impactAngle(search, best));
+        }
+
+    private:
+        struct Search{
+            Simulation simulation;
+            const Constraints& constraints;
+            bool warm = false;
+            double guess = 0.0;
+            uint32_t shots = 0;
+            uint32_t solves = 0;
+
+            Search(const Simulation& simulation, const Constraints& constraints) : simulation(simulation), constraints(constraints) {
+                this->simulation.setPrecheck(false);
+            }
+
+            Solution attempt(double speed){
+                simulation.setShootSpeed(speed);
+                Simulation::StrategyResult result = warm ? simulation.find_angle_warm(guess, constraints.warm_width)
+                                                         : simulation.find_angle(constraints.strategy);
+                solves++;
+                shots += result.tries;
+
+                Solution solution;
+                solution.speed = speed;
+                solution.angle = result.best_angle;
+                solution.result = result.best_result;
+                if(result.best_result.result != Simulation::ShotResultEnum::HIT){
+                    return solution;
+                }
+                warm = true;
+                guess = result.best_angle;
+
+                glm::dvec3 up = Simulation::UP_VECTOR;
+                glm::dvec3 offset = simulation.getTargetPosition() - simulation.getShooterPosition();
+                double rise = glm::dot(offset, up);
+                solution.elevation = result.best_angle + glm::degrees(std::atan2(rise, glm::length(offset - rise * up)));
+                if(!std::isnan(constraints.impact_angle)){
+                    //one more shot for the velocity at the hit
+                    Trajectory trajectory;
+                    simulation.simulateShot(result.best_angle, nullptr, &trajectory);
+                    shots++;
+                    glm::dvec3 velocity = trajectory.velocity(result.best_result.time);
+                    double descent = -glm::dot(velocity, up);
+                    solution.impact_angle = glm::degrees(std::atan2(descent, glm::length(velocity + descent * up)));
+                }
+                solution.found = result.best_result.time <= constraints.max_time;
+                return solution;
+            }
+
+            Solution finish(Solution solution) const{
+                solution.shots = shots;
+                solution.solves = solves;
+                return solution;
+            }
+        };
+
+        //minimum is the slowest charge that reaches the target, so its low arc is the steepest one
+        static Solution impactAngle(Search& search, const Solution& minimum){
+            const Constraints& constraints = search.constraints;
+            auto error = [&](const Solution& solution){
+                return solution.impact_angle - constraints.impact_angle;
+            };
+            Solution low = minimum;
+            if(!low.found || error(low) < -constraints.angle_tolerance){
+                low.found = false;
+                return low;
+            }
+            if(error(low) <= constraints.angle_tolerance){
+                return low;
+            }
+
+            Solution high = low;
+            while(error(high) > constraints.angle_tolerance){
+                if(high.speed >= constraints.max_speed || search.solves >= MAX_ITERATIONS){
+                    high.found = false;
+                    return high;
+                }
+                low = high;
+                high = search.attempt(std::min(constraints.max_speed, high.speed * GROWTH));
+                if(!high.found){
+                    return high;
+                }
+            }
+            if(error(high) >= -constraints.angle_tolerance){
+                return high;
+            }
+
+            //Illinois false position, the error falls with speed
+            double low_error = error(low);
+            double high_error = error(high);
+            int last_side = 0;
+            while(high.speed - low.speed > constraints.speed_tolerance && search.solves < MAX_ITERATIONS){
+                double speed = (low.speed * high_error - high.speed * low_error) / (high_error - low_error);
+                if(!(speed > low.speed && speed < high.speed)){
+                    speed = (low.speed + high.speed) / 2.0;
+                }
+                Solution middle = search.attempt(speed);
+                if(!middle.found){
+                    return middle;
+                }
+                double middle_error = error(middle);
+                if(std::abs(middle_error) <= constraints.angle_tolerance){
+                    return middle;
+                }
+                if(middle_error > 0.0){
+                    low = middle;
+                    low_error = middle_error;
+                    if(last_side == -1){
+                        high_error /= 2.0;
+                    }
+                    last_side = -1;
+                } else {
+                    high = middle;
+                    high_error = middle_error;
+                    if(last_side == 1){
+                        low_error /= 2.0;
+                    }
+                    last_side = 1;
+                }
+            }
+            Solution closest = std::abs(error(low)) < std::abs(error(high)) ? low : high;
+            closest.found = std::abs(error(closest)) <= constraints.angle_tolerance;
+            return closest;
+        }
+};
+
+double Charge::GROWTH = 1.25;
+uint32_t Charge::MAX_ITERATIONS = 64;
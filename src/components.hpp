@@ -14,4 +14,19 @@ struct Velocity {
 struct Mass {
     double mass;
     double air_resistance; // area * dragg coefficient
-};
\ No newline at end of file
+};
+
+//spin state of the modified point mass model
+struct Spin {
+    double rate; // rad/s about the axis, positive for a right hand twist
+    glm::dvec3 yaw; // yaw of repose in radians, perpendicular to the velocity
+};
+
+struct Aerodynamics {
+    double diameter;
+    double axial_inertia; // kg m^2
+    double lift; // lift force coefficient slope, per radian
+    double overturning; // overturning moment coefficient slope, per radian
+    double magnus; // Magnus force coefficient slope, per radian
+    double spin_damping; // spin damping moment coefficient, negative
+};
@@ -6,8 +6,18 @@
 #include <imgui_impl_opengl3.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/type_ptr.hpp>
+#include <atomic>
 #include <thread>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "simulation.hpp"
+#include "resumable.hpp"
+#include "barrage.hpp"
+#include "safety_fan.hpp"
+#include "uncertainty.hpp"
+#include "heatmap.hpp"
+#include "charge.hpp"
 #include "mesh.hpp"
 #include "camera.hpp"
 #include "sphere.hpp"
@@ -22,11 +32,30 @@ class GUI {
 
         std::thread simulation_thread;
 
-        std::vector<glm::vec3> trajectory;
+        Trajectory trajectory;
+        std::mutex trajectory_mutex;
+        float trajectory_spacing = 1.0f;
+
+        Simulation::ShotCache cache;
+        bool useCache = true;
+
+        Barrage barrage;
+
+        SafetyFan::Settings fan_settings;
+        SafetyFan::Result fan;
+        std::mutex fan_mutex;
+        std::atomic<bool> fan_busy{false};
 
         Simulation::StrategyResult lastResult;
         bool hasResult = false;
 
+        struct LiveParameters{
+            bool live = false;
+            float budget_ms = 2.0f;
+        } live_parameters;
+        std::unique_ptr<ResumableSolve> live_solve;
+        std::vector<float> live_key; // inputs the live solve was started from
+
         Camera camera;
         Sphere* sphere = nullptr;
         Shader* shader = nullptr;
@@ -40,10 +69,58 @@ class GUI {
             float shoot_speed = 100.0f;
             float shoot_height = 1.0f;
             float delta_time = 0.01f;
+            int strategy = Simulation::THREE_POINT - 1;
 
             float angle_start = 0.0f;
         } simulation_parameters;
 
+        struct BarrageParameters{
+            int count = 10000;
+            float speed = 100.0f;
+            float elevation = 45.0f;
+            float azimuth = 0.0f;
+            float spread = 10.0f;
+            float duration = 5.0f;
+            float air_resistance = 0.01f;
+            float delta_time = 1.0f / 60.0f;
+            int draw_limit = 2000;
+            bool running = true;
+            double step_ms = 0.0;
+        } barrage_parameters;
+
+        struct UncertaintyParameters{
+            float speed = 1.0f;
+            float air_resistance = 0.0005f;
+            float mass = 0.01f;
+            float angle = 0.05f;
+            float azimuth = 0.05f;
+            glm::vec3 wind = glm::vec3(1.0f, 0.5f, 1.0f);
+            float radius = 1.0f;
+            bool live = true;
+        } uncertainty_parameters;
+        Uncertainty::Result uncertainty;
+
+        struct HeatmapParameters{
+            float extent = 100.0f;
+            float height = 0.0f;
+            int coarse = 8;
+            int levels = 4;
+            float angle_tolerance = 1.0f;
+            int mode = 0;
+        } heatmap_parameters;
+        Heatmap heatmap;
+
+        struct ChargeParameters{
+            float min_speed = 1.0f;
+            float max_speed = 1000.0f;
+            bool limit_time = false;
+            float max_time = 10.0f;
+            bool constrain_angle = false;
+            float impact_angle = 45.0f;
+        } charge_parameters;
+        Charge::Solution charge;
+        std::atomic<bool> charge_busy{false};
+
         struct CameraParameters{
             glm::vec3 position = glm::vec3(100.0f, 100.0f, 100.0f);
             glm::vec3 target = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -130,8 +207,10 @@ class GUI {
 
             glEnable(GL_DEPTH_TEST);
             glDepthFunc(GL_LESS);
+            Trace::setThreadName("gui");
             
             while (!glfwWindowShouldClose(window)) {
+                Trace::Scope frame("frame", "gui");
                 glfwPollEvents();
         
                 // Clear the frame
@@ -143,6 +222,12 @@ class GUI {
 
                 glUniformMatrix4fv(projectionID, 1, GL_FALSE, glm::value_ptr(camera.getProjectionView()));
                 
+                if (barrage_parameters.running) {
+                    double start = glfwGetTime();
+                    barrage.step(barrage_parameters.delta_time);
+                    barrage_parameters.step_ms = (glfwGetTime() - start) * 1000.0;
+                }
+
                 // Render the simulation visualization using OpenGL
                 renderScene();   
                 
@@ -171,16 +256,26 @@ class GUI {
             ImGui::SliderFloat("Shoot Speed", &simulation_parameters.shoot_speed, 1.0f, 500.0f);
             ImGui::SliderFloat("Shoot Height", &simulation_parameters.shoot_height, 0.001f, 10.0f);
             ImGui::SliderFloat("Time Step", &simulation_parameters.delta_time, 0.0001f, 1.0f);
+            ImGui::Combo("Strategy", &simulation_parameters.strategy, "Bisection\0Three Point\0Multi-resolution\0K-ary Parallel\0");
             
             // Run simulation button
             if (ImGui::Button("Find Angle")) {
                 simulation_thread = std::thread([this](){
+                    Trace::setThreadName("simulation");
                     simulation.init(simulation_parameters.shooter_position.position, simulation_parameters.target_position.position, simulation_parameters.shoot_speed, simulation_parameters.shoot_height, simulation_parameters.delta_time);
-                    lastResult = simulation.find_angle_strategy2();
+                    simulation.setCache(useCache ? &cache : nullptr);
+                    lastResult = simulation.find_angle((Simulation::Strategy)(simulation_parameters.strategy + 1));
                     hasResult = true;
                 });
                 simulation_thread.detach();
             }
+            ImGui::Checkbox("Live Solve", &live_parameters.live);
+            ImGui::SliderFloat("Frame Budget (ms)", &live_parameters.budget_ms, 0.1f, 16.0f);
+            if (live_parameters.live) {
+                updateLiveSolve();
+            } else {
+                live_solve.reset();
+            }
             
             // Display results if available
             if (hasResult) {
@@ -191,16 +286,20 @@ class GUI {
                 ImGui::Text("Distance: %.2f m", lastResult.best_result.distance);
                 ImGui::Text("Time of Flight: %.2f s", lastResult.best_result.time);
                 ImGui::Text("Result: %s", lastResult.best_result.result == Simulation::ShotResultEnum::HIT ? "HIT" : "MISS");
+                if (lastResult.marginal) {
+                    ImGui::Text("Target is at the edge of the reachable range");
+                }
             }
 
             ImGui::SliderFloat("Angle", &simulation_parameters.angle_start, 0.0f, 90.0f);
+            ImGui::SliderFloat("Trajectory Spacing", &trajectory_spacing, 0.1f, 10.0f);
             if (ImGui::Button("Shoot")) {
                 simulation_thread = std::thread([this](){
-                    trajectory.clear();
+                    Trajectory shot;
                     simulation.init(simulation_parameters.shooter_position.position, simulation_parameters.target_position.position, simulation_parameters.shoot_speed, simulation_parameters.shoot_height, simulation_parameters.delta_time);
-                    simulation.simulateShot(simulation_parameters.angle_start, [this](const Position& position, const double& time){
-                        trajectory.push_back(glm::vec3((float)position.position.x, (float)position.position.y, (float)position.position.z));
-                    });
+                    simulation.simulateShot(simulation_parameters.angle_start, nullptr, &shot);
+                    std::lock_guard<std::mutex> lock(trajectory_mutex);
+                    std::swap(trajectory, shot);
                 });
                 simulation_thread.detach();
             }
@@ -223,12 +322,373 @@ class GUI {
             Physics::GRAVITY = physics_parameters.gravity;
             Physics::AIR_DENSITY = physics_parameters.air_density;
             Simulation::UP_VECTOR = -glm::normalize(Physics::GRAVITY);
+
+            renderBarrage();
+            renderSafetyFan();
+            renderUncertainty();
+            renderHeatmap();
+            renderCharge();
+            renderPerformance();
             
             // Render ImGui
             ImGui::Render();
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
             
         } 
+        void renderBarrage(){
+            ImGui::Begin("Barrage");
+            ImGui::SliderInt("Projectiles", &barrage_parameters.count, 1, 100000);
+            ImGui::SliderFloat("Speed", &barrage_parameters.speed, 1.0f, 500.0f);
+            ImGui::SliderFloat("Elevation", &barrage_parameters.elevation, 0.0f, 90.0f);
+            ImGui::SliderFloat("Azimuth", &barrage_parameters.azimuth, -180.0f, 180.0f);
+            ImGui::SliderFloat("Spread", &barrage_parameters.spread, 0.0f, 45.0f);
+            ImGui::SliderFloat("Duration", &barrage_parameters.duration, 0.0f, 30.0f);
+            ImGui::SliderFloat("Drag", &barrage_parameters.air_resistance, 0.0f, 0.1f);
+            ImGui::SliderFloat("Barrage Time Step", &barrage_parameters.delta_time, 0.001f, 0.1f);
+            ImGui::SliderInt("Drawn", &barrage_parameters.draw_limit, 0, 20000);
+
+            if (ImGui::Button("Fire")) {
+                barrage.salvo(simulation_parameters.shooter_position.position, barrage_parameters.speed, barrage_parameters.elevation,
+                    barrage_parameters.azimuth, barrage_parameters.spread, barrage_parameters.count, barrage_parameters.duration,
+                    simulation_parameters.shoot_height, barrage_parameters.air_resistance, (unsigned)barrage.impacted() + 1);
+            }
+            ImGui::SameLine();
+            ImGui::Checkbox("Running", &barrage_parameters.running);
+            ImGui::SameLine();
+            if (ImGui::Button("Clear")) {
+                barrage.clear();
+            }
+
+            ImGui::Text("Time: %.2f s", barrage.currentTime());
+            ImGui::Text("Active: %zu scheduled: %zu impacts: %zu", barrage.active(), barrage.scheduled(), barrage.impacted());
+            ImGui::Text("Step: %.3f ms", barrage_parameters.step_ms);
+            ImGui::End();
+        }
+        void renderSafetyFan(){
+            ImGui::Begin("Safety Fan");
+            float angles[2] = {(float)fan_settings.min_angle, (float)fan_settings.max_angle};
+            if (ImGui::SliderFloat2("Angles", angles, -90.0f, 180.0f)) {
+                fan_settings.min_angle = angles[0];
+                fan_settings.max_angle = angles[1];
+            }
+            float azimuth_span = (float)fan_settings.azimuth_span;
+            if (ImGui::SliderFloat("Azimuth Span", &azimuth_span, 0.0f, 360.0f)) {
+                fan_settings.azimuth_span = azimuth_span;
+            }
+            ImGui::SliderInt("Azimuths", &fan_settings.azimuths, 1, 64);
+            ImGui::SliderInt("Initial Rays", &fan_settings.initial_rays, 2, 256);
+            ImGui::SliderInt("Max Rays", &fan_settings.max_rays, 2, 4096);
+            float tolerance = (float)fan_settings.tolerance;
+            if (ImGui::SliderFloat("Tolerance", &tolerance, 0.1f, 50.0f)) {
+                fan_settings.tolerance = tolerance;
+            }
+
+            if (fan_busy) {
+                ImGui::Text("Computing...");
+            } else if (ImGui::Button("Compute Fan")) {
+                fan_busy = true;
+                std::thread([this](){
+                    Simulation local(simulation_parameters.shooter_position.position, simulation_parameters.target_position.position,
+                        simulation_parameters.shoot_speed, simulation_parameters.shoot_height, simulation_parameters.delta_time);
+                    local.setTerrain(simulation.getTerrain());
+                    SafetyFan::Result result = SafetyFan::compute(local, fan_settings);
+                    {
+                        std::lock_guard<std::mutex> lock(fan_mutex);
+                        fan = std::move(result);
+                    }
+                    fan_busy = false;
+                }).detach();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(fan_mutex);
+                ImGui::Text("Rays: %zu impacts: %zu", fan.rays.size(), fan.footprint.size());
+                ImGui::Text("Max height: %.2f m max range: %.2f m", fan.max_height, fan.max_range);
+            }
+            ImGui::End();
+        }
+        // restarts the solve whenever an input changes and spends at most the frame budget on it
+        void updateLiveSolve(){
+            const SimulationParameters& p = simulation_parameters;
+            std::vector<float> key = {p.shooter_position.position.x, p.shooter_position.position.y, p.shooter_position.position.z,
+                p.target_position.position.x, p.target_position.position.y, p.target_position.position.z, p.shoot_speed, p.shoot_height, p.delta_time,
+                (float)p.strategy, physics_parameters.gravity.x, physics_parameters.gravity.y, physics_parameters.gravity.z, physics_parameters.air_density, (float)useCache};
+            if (!live_solve || key != live_key) {
+                Simulation local(p.shooter_position.position, p.target_position.position, p.shoot_speed, p.shoot_height, p.delta_time);
+                local.setCache(useCache ? &cache : nullptr);
+                live_solve = std::make_unique<ResumableSolve>(local, (Simulation::Strategy)(p.strategy + 1));
+                live_key = key;
+            }
+
+            ResumableSolve::Budget budget;
+            budget.microseconds = live_parameters.budget_ms * 1000.0;
+            bool done = live_solve->resume(budget);
+            if (live_solve->getShots() > 0 || done) {
+                lastResult = live_solve->result();
+                hasResult = true;
+            }
+            if (done) {
+                ImGui::Text("Solved in %u shots, %llu steps", live_solve->getShots(), (unsigned long long)live_solve->getSteps());
+            } else {
+                ImGui::Text("Solving: %u shots, bracket %.4f deg", live_solve->getShots(), live_solve->bracket());
+            }
+        }
+        // linearised spread of the last solved shot, cheap enough to redo every frame
+        void renderUncertainty(){
+            ImGui::Begin("Uncertainty");
+            ImGui::SliderFloat("Speed Sigma", &uncertainty_parameters.speed, 0.0f, 10.0f);
+            ImGui::SliderFloat("Drag Sigma", &uncertainty_parameters.air_resistance, 0.0f, 0.01f, "%.5f");
+            ImGui::SliderFloat("Mass Sigma", &uncertainty_parameters.mass, 0.0f, 1.0f);
+            ImGui::SliderFloat("Angle Sigma", &uncertainty_parameters.angle, 0.0f, 1.0f);
+            ImGui::SliderFloat("Azimuth Sigma", &uncertainty_parameters.azimuth, 0.0f, 1.0f);
+            ImGui::SliderFloat3("Wind Sigma", glm::value_ptr(uncertainty_parameters.wind), 0.0f, 10.0f);
+            ImGui::SliderFloat("Target Radius", &uncertainty_parameters.radius, 0.01f, 10.0f);
+            ImGui::Checkbox("Live", &uncertainty_parameters.live);
+
+            if (hasResult && uncertainty_parameters.live) {
+                Simulation local(simulation_parameters.shooter_position.position, simulation_parameters.target_position.position,
+                    simulation_parameters.shoot_speed, simulation_parameters.shoot_height, simulation_parameters.delta_time);
+                Uncertainty::Inputs sigma;
+                sigma.speed = uncertainty_parameters.speed;
+                sigma.air_resistance = uncertainty_parameters.air_resistance;
+                sigma.mass = uncertainty_parameters.mass;
+                sigma.angle = uncertainty_parameters.angle;
+                sigma.azimuth = uncertainty_parameters.azimuth;
+                sigma.wind = uncertainty_parameters.wind;
+                uncertainty = Uncertainty::propagate(local, lastResult.best_angle, 0.0, sigma, uncertainty_parameters.radius);
+            }
+
+            if (uncertainty.reached) {
+                ImGui::Text("Sigma lateral: %.3f m vertical: %.3f m", std::sqrt(uncertainty.covariance[0][0]), std::sqrt(uncertainty.covariance[1][1]));
+                ImGui::Text("Miss: %.3f m %.3f m", uncertainty.miss.x, uncertainty.miss.y);
+                ImGui::Text("Hit probability: %.1f %%", 100.0 * uncertainty.hit_probability);
+                ImGui::Text("Steps: %llu", (unsigned long long)uncertainty.steps);
+            }
+            ImGui::End();
+        }
+        // targets around the shooter; only reads samples the workers already published
+        void renderHeatmap(){
+            ImGui::Begin("Heatmap");
+            ImGui::SliderFloat("Extent", &heatmap_parameters.extent, 1.0f, 1000.0f);
+            ImGui::SliderFloat("Target Height", &heatmap_parameters.height, -100.0f, 100.0f);
+            ImGui::SliderInt("Coarse Tiles", &heatmap_parameters.coarse, 1, 32);
+            ImGui::SliderInt("Levels", &heatmap_parameters.levels, 0, 8);
+            ImGui::SliderFloat("Elevation Tolerance", &heatmap_parameters.angle_tolerance, 0.01f, 10.0f);
+            ImGui::Combo("Show", &heatmap_parameters.mode, "Hit\0Elevation\0Time of Flight\0");
+
+            if (ImGui::Button("Solve Map")) {
+                Heatmap::Settings settings;
+                settings.shooter = simulation_parameters.shooter_position.position;
+                settings.extent = heatmap_parameters.extent;
+                settings.height = heatmap_parameters.height;
+                settings.shoot_speed = simulation_parameters.shoot_speed;
+                settings.shoot_height = simulation_parameters.shoot_height;
+                settings.delta_time = simulation_parameters.delta_time;
+                settings.coarse = heatmap_parameters.coarse;
+                settings.levels = heatmap_parameters.levels;
+                settings.angle_tolerance = heatmap_parameters.angle_tolerance;
+                settings.terrain = simulation.getTerrain();
+                heatmap.start(settings);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Stop")) {
+                heatmap.stop();
+            }
+
+            int size = heatmap.size();
+            ImGui::Text("Level %d/%d %s", heatmap.level(), heatmap.getSettings().levels, heatmap.done() ? "done" : "");
+            ImGui::Text("Solved %llu of %d targets, %llu warm, %llu shots", (unsigned long long)heatmap.solved(), size * size,
+                (unsigned long long)heatmap.warmSolves(), (unsigned long long)heatmap.shots());
+
+            if (size > 1) {
+                int cells = std::min(size - 1, 128);
+                // 0 unsolved, 1 miss, 2 hit
+                std::vector<uint8_t> states((size_t)cells * cells, 0);
+                std::vector<float> values((size_t)cells * cells, 0.0f);
+                float low = std::numeric_limits<float>::max();
+                float high = -std::numeric_limits<float>::max();
+                for (int y = 0; y < cells; y++) {
+                    for (int x = 0; x < cells; x++) {
+                        const Heatmap::Sample* sample = heatmap.lookup(x * (size - 1) / cells, y * (size - 1) / cells);
+                        if (!sample) {
+                            continue;
+                        }
+                        size_t index = (size_t)y * cells + x;
+                        states[index] = sample->result == Simulation::ShotResultEnum::HIT ? 2 : 1;
+                        if (states[index] == 2) {
+                            values[index] = (float)(heatmap_parameters.mode == 1 ? sample->elevation : sample->time);
+                            low = std::min(low, values[index]);
+                            high = std::max(high, values[index]);
+                        }
+                    }
+                }
+
+                const float side = 256.0f;
+                float cell = side / cells;
+                ImVec2 origin = ImGui::GetCursorScreenPos();
+                ImDrawList* draw_list = ImGui::GetWindowDrawList();
+                for (int y = 0; y < cells; y++) {
+                    for (int x = 0; x < cells; x++) {
+                        size_t index = (size_t)y * cells + x;
+                        ImU32 color = IM_COL32(40, 40, 40, 255);
+                        if (states[index] == 1) {
+                            color = IM_COL32(90, 20, 20, 255);
+                        } else if (states[index] == 2 && heatmap_parameters.mode == 0) {
+                            color = IM_COL32(40, 200, 60, 255);
+                        } else if (states[index] == 2) {
+                            float t = high > low ? (values[index] - low) / (high - low) : 0.5f;
+                            color = IM_COL32((int)(255 * t), 60, (int)(255 * (1.0f - t)), 255);
+                        }
+                        // rows from the far edge down, like a map
+                        ImVec2 min(origin.x + x * cell, origin.y + (cells - 1 - y) * cell);
+                        draw_list->AddRectFilled(min, ImVec2(min.x + cell, min.y + cell), color);
+                    }
+                }
+                ImGui::Dummy(ImVec2(side, side));
+                if (heatmap_parameters.mode != 0 && high >= low) {
+                    ImGui::Text("%.2f (blue) to %.2f (red) %s", low, high, heatmap_parameters.mode == 1 ? "deg" : "s");
+                }
+            }
+            ImGui::End();
+        }
+        // slowest charge for the current target, the speed slider is ignored
+        void renderCharge(){
+            ImGui::Begin("Charge");
+            ImGui::SliderFloat("Min Speed", &charge_parameters.min_speed, 1.0f, 1000.0f);
+            ImGui::SliderFloat("Max Speed", &charge_parameters.max_speed, 1.0f, 1000.0f);
+            ImGui::Checkbox("Limit Time of Flight", &charge_parameters.limit_time);
+            ImGui::SliderFloat("Max Time", &charge_parameters.max_time, 0.1f, 100.0f);
+            ImGui::Checkbox("Impact Angle", &charge_parameters.constrain_angle);
+            ImGui::SliderFloat("Descent", &charge_parameters.impact_angle, 0.0f, 90.0f);
+
+            if (charge_busy) {
+                ImGui::Text("Solving...");
+            } else if (ImGui::Button("Find Charge")) {
+                charge_busy = true;
+                std::thread([this](){
+                    Simulation local(simulation_parameters.shooter_position.position, simulation_parameters.target_position.position,
+                        simulation_parameters.shoot_speed, simulation_parameters.shoot_height, simulation_parameters.delta_time);
+                    local.setTerrain(simulation.getTerrain());
+                    Charge::Constraints constraints;
+                    constraints.min_speed = charge_parameters.min_speed;
+                    constraints.max_speed = charge_parameters.max_speed;
+                    if (charge_parameters.limit_time) {
+                        constraints.max_time = charge_parameters.max_time;
+                    }
+                    if (charge_parameters.constrain_angle) {
+                        constraints.impact_angle = charge_parameters.impact_angle;
+                    }
+                    constraints.strategy = (Simulation::Strategy)(simulation_parameters.strategy + 1);
+                    charge = Charge::solve(local, constraints);
+                    charge_busy = false;
+                }).detach();
+            }
+
+            if (!charge_busy && charge.solves > 0) {
+                if (charge.found) {
+                    ImGui::Text("Speed: %.2f m/s elevation: %.2f deg", charge.speed, charge.elevation);
+                    ImGui::Text("Time of Flight: %.2f s", charge.result.time);
+                    if (!std::isnan(charge.impact_angle)) {
+                        ImGui::Text("Impact Angle: %.2f deg", charge.impact_angle);
+                    }
+                } else {
+                    ImGui::Text("No charge meets the constraints");
+                }
+                ImGui::Text("Shots: %u speeds: %u", charge.shots, charge.solves);
+            }
+            ImGui::End();
+        }
+        void renderPerformance(){
+            ImGui::Begin("Performance");
+            if (Instrumentation::ENABLED) {
+                renderInstrumentation();
+            } else {
+                ImGui::Text("Instrumentation compiled out");
+            }
+
+            ImGui::Separator();
+            ImGui::Checkbox("Use Cache", &useCache);
+            ImGui::Text("Cache: %zu entries, %llu hits, %llu misses", cache.size(),
+                (unsigned long long)cache.hitCount(), (unsigned long long)cache.missCount());
+            if (ImGui::Button("Clear Cache")) {
+                cache.clear();
+            }
+
+            ImGui::Separator();
+            if (ImGui::Button("Reset")) {
+                Instrumentation::reset();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Dump JSON")) {
+                Instrumentation::dumpJson("performance.json");
+            }
+
+            ImGui::Separator();
+            if (!Trace::ENABLED) {
+                ImGui::Text("Tracing compiled out");
+            } else if (Trace::recording()) {
+                if (ImGui::Button("Stop Trace")) {
+                    Trace::stop();
+                    Trace::writeJson("trace.json");
+                }
+                ImGui::SameLine();
+                ImGui::Text("Recording to trace.json");
+            } else if (ImGui::Button("Start Trace")) {
+                Trace::start();
+            }
+            ImGui::End();
+        }
+        void renderInstrumentation(){
+            Instrumentation::Stats stats = Instrumentation::snapshot();
+            ImGui::Text("Shots: %llu", (unsigned long long)stats.steps_per_shot.count);
+            ImGui::Text("Steps: %llu", (unsigned long long)stats.steps);
+            ImGui::Text("Steps/shot: mean %.0f p50 %llu p99 %llu", stats.steps_per_shot.mean(),
+                (unsigned long long)stats.steps_per_shot.quantile(0.5), (unsigned long long)stats.steps_per_shot.quantile(0.99));
+            ImGui::Text("ns/step: %.1f", stats.nsPerStep());
+
+            for (const auto& [name, solve] : stats.solves) {
+                ImGui::Separator();
+                ImGui::Text("%s: %llu solves", name.c_str(), (unsigned long long)solve.solve_ns.count);
+                ImGui::Text("Shots/solve: mean %.1f max %llu", solve.shots_per_solve.mean(), (unsigned long long)solve.shots_per_solve.max);
+                ImGui::Text("Solve time: mean %.3f ms p99 %.3f ms", solve.solve_ns.mean() * 1e-6, solve.solve_ns.quantile(0.99) * 1e-6);
+                for (int i = 0; i < Instrumentation::TERMINATION_COUNT; i++) {
+                    ImGui::Text("  %s: %llu", Instrumentation::terminationName((Instrumentation::Termination)i), (unsigned long long)solve.terminations[i]);
+                }
+
+                float buckets[Instrumentation::Histogram::BUCKETS];
+                for (int i = 0; i < Instrumentation::Histogram::BUCKETS; i++) {
+                    buckets[i] = (float)solve.solve_ns.buckets[i];
+                }
+                ImGui::PlotHistogram(("Solve time (log2 ns)##" + name).c_str(), buckets, Instrumentation::Histogram::BUCKETS);
+            }
+        }
+        // profile drawn in the vertical plane towards the target, footprint outline on the ground
+        void renderSafetyFanScene(TransformComponent& trasform){
+            std::lock_guard<std::mutex> lock(fan_mutex);
+            if (fan.rays.empty()) {
+                return;
+            }
+            glm::dvec3 shooter = simulation_parameters.shooter_position.position;
+            glm::dvec3 toward = glm::dvec3(simulation_parameters.target_position.position) - shooter;
+            toward -= glm::dot(toward, Simulation::UP_VECTOR) * Simulation::UP_VECTOR;
+            toward = glm::length(toward) > 0.0 ? glm::normalize(toward) : glm::dvec3(1.0, 0.0, 0.0);
+
+            sphere->bind();
+            glUniform3fv(modelColorID, 1, glm::value_ptr(glm::vec3(1.0f, 0.5f, 0.0f)));
+            size_t stride = std::max<size_t>(1, fan.profile.size() / 500);
+            for (size_t i = 0; i < fan.profile.size(); i += stride) {
+                trasform.position = shooter + fan.profile[i].x * toward + fan.profile[i].y * Simulation::UP_VECTOR;
+                glUniformMatrix4fv(modelTransformID, 1, GL_FALSE, glm::value_ptr(trasform.mat4()));
+                sphere->draw();
+            }
+
+            glUniform3fv(modelColorID, 1, glm::value_ptr(glm::vec3(1.0f, 0.0f, 1.0f)));
+            for (const glm::dvec3& point : fan.outline) {
+                trasform.position = point;
+                glUniformMatrix4fv(modelTransformID, 1, GL_FALSE, glm::value_ptr(trasform.mat4()));
+                sphere->draw();
+            }
+        }
         void renderScene(){
             
             shader->bind();
@@ -246,13 +706,37 @@ class GUI {
             sphere->bind();
             sphere->draw();
 
+            std::vector<glm::dvec3> samples;
+            {
+                std::lock_guard<std::mutex> lock(trajectory_mutex);
+                samples = trajectory.sampleByArcLength(trajectory_spacing);
+            }
+
             TransformComponent trasform;
-            for (int i = 0; i < trajectory.size(); i++){
-                trasform.position = trajectory[i];
+            for (int i = 0; i < samples.size(); i++){
+                trasform.position = samples[i];
                 glUniformMatrix4fv(modelTransformID, 1, GL_FALSE, glm::value_ptr(trasform.mat4()));
                 glUniform3fv(modelColorID, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 1.0f)));
                 sphere->bind();
                 sphere->draw();
             }
+
+            renderSafetyFanScene(trasform);
+
+            // one draw call per sphere, so only every n-th projectile of a large barrage is drawn
+            if (barrage_parameters.draw_limit > 0 && barrage.active() > 0) {
+                size_t stride = std::max<size_t>(1, barrage.active() / barrage_parameters.draw_limit);
+                size_t index = 0;
+                sphere->bind();
+                glUniform3fv(modelColorID, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.0f)));
+                barrage.each([&](const Position& position, const Velocity&){
+                    if (index++ % stride != 0) {
+                        return;
+                    }
+                    trasform.position = position.position;
+                    glUniformMatrix4fv(modelTransformID, 1, GL_FALSE, glm::value_ptr(trasform.mat4()));
+                    sphere->draw();
+                });
+            }
         }
 };
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "terrain.hpp"
+#include "thread_pool.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//Solves a square grid of target positions around the shooter, coarse to fine. The coarse lattice
+//is solved row by row, every target warm started from its left neighbour. Each refinement level
+//then splits only the tiles whose corners disagree (hit next to miss, or elevation / time of
+//flight further apart than the tolerances) and solves the new edge midpoints and centre, warm
+//started from an adjacent hit. Tiles are solved on the worker pool and every sample is published
+//as soon as it is solved, so the map can be drawn while it refines.
+class Heatmap {
+    public:
+        struct Settings{
+            glm::dvec3 shooter = glm::dvec3(0.0);
+            double extent = 100.0; //half the side of the square, in meters
+            double height = 0.0; //of the targets above the shooter, along UP_VECTOR
+            double shoot_speed = 100.0;
+            double shoot_height = 1.0;
+            double delta_time = 0.01;
+            Simulation::Strategy strategy = Simulation::BISECTION; //for targets without a solved neighbour
+            int coarse = 8; //tiles per side on the coarse level
+            int levels = 4;
+            double angle_tolerance = 1.0; //degrees
+            double time_tolerance = 0.1; //seconds
+            double warm_width = 0.5; //half width of the first warm bracket, degrees
+            const Terrain* terrain = nullptr;
+        };
+
+        enum State : uint8_t{
+            EMPTY,
+            CLAIMED,
+            SOLVED
+        };
+
+        struct Sample{
+            std::atomic<uint8_t> state{EMPTY};
+            Simulation::ShotResultEnum result = Simulation::ShotResultEnum::NO_IN_RANGE;
+            double angle = 0.0; //simulateShot angle
+            double elevation = 0.0; //above the horizontal
+            double time = 0.0;
+            uint32_t tries = 0;
+            bool warm = false;
+        };
+
+        Heatmap(){}
+
+        ~Heatmap(){
+            stop();
+        }
+
+        //refines in the background until done() or stop()
+        void start(const Settings& settings, ThreadPool& pool = ThreadPool::shared()){
+            stop();
+            reset(settings);
+            driver = std::thread([this, &pool](){
+                refine(pool);
+            });
+        }
+
+        void run(const Settings& settings, ThreadPool& pool = ThreadPool::shared()){
+            stop();
+            reset(settings);
+            refine(pool);
+        }
+
+        void stop(){
+            cancelled = true;
+            if(driver.joinable()){
+                driver.join();
+            }
+        }
+
+        bool done() const{
+            return finished;
+        }
+
+        //0 while the coarse lattice is solved
+        int level() const{
+            return current_level;
+        }
+
+        //lattice points per side
+        int size() const{
+            return lattice;
+        }
+
+        const Settings& getSettings() const{
+            return settings;
+        }
+
+        uint64_t solved() const{
+            return solved_count;
+        }
+
+        uint64_t shots() const{
+            return shot_count;
+        }
+
+        uint64_t warmSolves() const{
+            return warm_count;
+        }
+
+        uint64_t coldSolves() const{
+            return solved_count - warm_count;
+        }
+
+        glm::dvec3 target(int i, int j) const{
+            double u = (2.0 * i / (lattice - 1) - 1.0) * settings.extent;
+            double v = (2.0 * j / (lattice - 1) - 1.0) * settings.extent;
+            return settings.shooter + u * axis_u + v * axis_v + settings.height * Simulation::UP_VECTOR;
+        }
+
+        //the sample itself once solved, otherwise the lower corner of the smallest solved tile around it
+        const Sample* lookup(int i, int j) const{
+            if(!samples || i < 0 || j < 0 || i >= lattice || j >= lattice){
+                return nullptr;
+            }
+            for(int stride = 1; stride <= coarse_stride; stride *= 2){
+                const Sample& sample = at(i / stride * stride, j / stride * stride);
+                if(sample.state.load(std::memory_order_acquire) == SOLVED){
+                    return &sample;
+                }
+            }
+            return nullptr;
+        }
+
+    private:
+        struct Tile{
+            int i;
+            int j;
+        };
+
+        void reset(const Settings& settings){
+            this->settings = settings;
+            this->settings.coarse = std::max(1, settings.coarse);
+            this->settings.levels = glm::clamp(settings.levels, 0, 12);
+            coarse_stride = 1 << this->settings.levels;
+            lattice = this->settings.coarse * coarse_stride + 1;
+            samples.reset(new Sample[(size_t)lattice * lattice]);
+
+            const glm::dvec3& up = Simulation::UP_VECTOR;
+            axis_u = glm::cross(up, glm::dvec3(0.0, 0.0, 1.0));
+            if(glm::length(axis_u) < 0.5){
+                axis_u = glm::cross(up, glm::dvec3(1.0, 0.0, 0.0));
+            }
+            axis_u = glm::normalize(axis_u);
+            axis_v = glm::cross(axis_u, up);
+
+            cancelled = false;
+            finished = false;
+            current_level = 0;
+            solved_count = 0;
+            shot_count = 0;
+            warm_count = 0;
+        }
+
+        Sample& at(int i, int j) const{
+            return samples[(size_t)j * lattice + i];
+        }
+
+        void refine(ThreadPool& pool){
+            int stride = coarse_stride;
+            std::vector<std::future<void>> tasks;
+            for(int j = 0; j < lattice; j += stride){
+                tasks.push_back(pool.submit([this, j, stride](){
+                    for(int i = 0; i < lattice && !cancelled; i += stride){
+                        solve(i, j, {i > 0 ? &at(i - stride, j) : nullptr});
+                    }
+                }));
+            }
+            wait(pool, tasks);
+
+            std::vector<Tile> tiles;
+            for(int j = 0; j + stride < lattice; j += stride){
+                for(int i = 0; i + stride < lattice; i += stride){
+                    tiles.push_back({i, j});
+                }
+            }
+
+            for(int level = 1; level <= settings.levels && !cancelled; level++){
+                current_level = level;
+                std::vector<Tile> split;
+                for(const Tile& tile : tiles){
+                    if(disagree(tile, stride)){
+                        split.push_back(tile);
+                    }
+                }
+
+                const size_t chunk = 8;
+                for(size_t begin = 0; begin < split.size(); begin += chunk){
+                    size_t end = std::min(begin + chunk, split.size());
+                    tasks.push_back(pool.submit([this, &split, begin, end, stride](){
+                        for(size_t k = begin; k < end && !cancelled; k++){
+                            solveTile(split[k], stride);
+                        }
+                    }));
+                }
+                wait(pool, tasks);
+
+                int half = stride / 2;
+                tiles.clear();
+                for(const Tile& tile : split){
+                    tiles.push_back({tile.i, tile.j});
+                    tiles.push_back({tile.i + half, tile.j});
+                    tiles.push_back({tile.i, tile.j + half});
+                    tiles.push_back({tile.i + half, tile.j + half});
+                }
+                stride = half;
+            }
+            finished = !cancelled;
+        }
+
+        static void wait(ThreadPool& pool, std::vector<std::future<void>>& tasks){
+            for(auto& task : tasks){
+                pool.wait(task);
+            }
+            tasks.clear();
+        }
+
+        bool disagree(const Tile& tile, int stride) const{
+            const Sample* corners[4] = {&at(tile.i, tile.j), &at(tile.i + stride, tile.j), &at(tile.i, tile.j + stride), &at(tile.i + stride, tile.j + stride)};
+            for(const Sample* corner : corners){
+                if(corner->state.load(std::memory_order_acquire) != SOLVED){
+                    return false;
+                }
+            }
+            for(int k = 1; k < 4; k++){
+                bool hit = corners[0]->result == Simulation::ShotResultEnum::HIT;
+                if(hit != (corners[k]->result == Simulation::ShotResultEnum::HIT)){
+                    return true;
+                }
+                if(hit && (std::abs(corners[k]->elevation - corners[0]->elevation) > settings.angle_tolerance
+                        || std::abs(corners[k]->time - corners[0]->time) > settings.time_tolerance)){
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //edge midpoints first, so the centre can start from the nearest of them
+        void solveTile(const Tile& tile, int stride){
+            int i = tile.i;
+            int j = tile.j;
+            int half = stride / 2;
+            Sample* c00 = &at(i, j);
+            Sample* c10 = &at(i + stride, j);
+            Sample* c01 = &at(i, j + stride);
+            Sample* c11 = &at(i + stride, j + stride);
+            solve(i + half, j, {c00, c10});
+            solve(i, j + half, {c00, c01});
+            solve(i + stride, j + half, {c10, c11});
+            solve(i + half, j + stride, {c01, c11});
+            solve(i + half, j + half, {&at(i + half, j), &at(i, j + half), &at(i + stride, j + half), &at(i + half, j + stride), c00, c10, c01, c11});
+        }
+
+        //warm started from the first neighbour that hits, cold otherwise; a sample claimed by another tile is left to it
+        void solve(int i, int j, std::initializer_list<const Sample*> neighbours){
+            Sample& sample = at(i, j);
+            uint8_t expected = EMPTY;
+            if(!sample.state.compare_exchange_strong(expected, CLAIMED)){
+                return;
+            }
+
+            const Sample* guess = nullptr;
+            for(const Sample* neighbour : neighbours){
+                if(neighbour && neighbour->state.load(std::memory_order_acquire) == SOLVED && neighbour->result == Simulation::ShotResultEnum::HIT){
+                    guess = neighbour;
+                    break;
+                }
+            }
+
+            glm::dvec3 position = target(i, j);
+            glm::dvec3 offset = position - settings.shooter;
+            if(glm::length(offset) < 1e-9){
+                //the muzzle itself
+                sample.result = Simulation::ShotResultEnum::HIT;
+            } else {
+                Simulation simulation(settings.shooter, position, settings.shoot_speed, settings.shoot_height, settings.delta_time);
+                simulation.setTerrain(settings.terrain);
+                Simulation::StrategyResult result = guess ? simulation.find_angle_warm(guess->angle, settings.warm_width)
+                                                          : simulation.find_angle(settings.strategy);
+                double rise = glm::dot(offset, Simulation::UP_VECTOR);
+                double run = glm::length(offset - rise * Simulation::UP_VECTOR);
+                sample.result = result.best_result.result;
+                sample.angle = result.best_angle;
+                sample.elevation = result.best_angle + glm::degrees(std::atan2(rise, run));
+                sample.time = result.best_result.time;
+                sample.tries = result.tries;
+                sample.warm = guess != nullptr;
+                shot_count += result.tries;
+                warm_count += guess ? 1 : 0;
+            }
+            solved_count++;
+            sample.state.store(SOLVED, std::memory_order_release);
+        }
+
+        Settings settings;
+        int coarse_stride = 1;
+        int lattice = 0;
+        std::unique_ptr<Sample[]> samples;
+        glm::dvec3 axis_u = glm::dvec3(1.0, 0.0, 0.0);
+        glm::dvec3 axis_v = glm::dvec3(0.0, 0.0, 1.0);
+
+        std::thread driver;
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> finished{false};
+        std::atomic<int> current_level{0};
+        std::atomic<uint64_t> solved_count{0};
+        std::atomic<uint64_t> shot_count{0};
+        std::atomic<uint64_t> warm_count{0};
+};
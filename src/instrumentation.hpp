@@ -0,0 +1,313 @@
+#pragma once
+
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//set BALLISTICS_INSTRUMENTATION to 0 to compile all counters out
+#ifndef BALLISTICS_INSTRUMENTATION
+#define BALLISTICS_INSTRUMENTATION 1
+#endif
+
+class Instrumentation {
+    public:
+        static constexpr bool ENABLED = BALLISTICS_INSTRUMENTATION != 0;
+
+        enum Termination{
+            HIT,
+            BRACKET_COLLAPSE,
+            MAX_TRIES,
+            NO_IN_RANGE,
+            TERMINATION_COUNT
+        };
+
+        static const char* terminationName(Termination termination){
+            switch(termination){
+                case HIT: return "hit";
+                case BRACKET_COLLAPSE: return "bracket_collapse";
+                case MAX_TRIES: return "max_tries";
+                case NO_IN_RANGE: return "no_in_range";
+                default: return "unknown";
+            }
+        }
+
+        //power of two buckets, bucket i holds values in [2^(i-1), 2^i)
+        struct Histogram{
+            static constexpr int BUCKETS = 48;
+            uint64_t buckets[BUCKETS] = {};
+            uint64_t count = 0;
+            double sum = 0.0;
+            uint64_t min = UINT64_MAX;
+            uint64_t max = 0;
+
+            void add(uint64_t value){
+                int bucket = 0;
+                while(bucket < BUCKETS - 1 && (uint64_t(1) << bucket) <= value){
+                    bucket++;
+                }
+                buckets[bucket]++;
+                count++;
+                sum += (double)value;
+                min = std::min(min, value);
+                max = std::max(max, value);
+            }
+
+            void merge(const Histogram& other){
+                for(int i = 0; i < BUCKETS; i++){
+                    buckets[i] += other.buckets[i];
+                }
+                count += other.count;
+                sum += other.sum;
+                min = std::min(min, other.min);
+                max = std::max(max, other.max);
+            }
+
+            double mean() const{
+                return count ? sum / (double)count : 0.0;
+            }
+
+            //upper bound of the bucket containing the quantile
+            uint64_t quantile(double q) const{
+                if(count == 0){
+                    return 0;
+                }
+                uint64_t rank = (uint64_t)(q * (double)(count - 1));
+                uint64_t seen = 0;
+                for(int i = 0; i < BUCKETS; i++){
+                    seen += buckets[i];
+                    if(seen > rank){
+                        return std::min(max, i == 0 ? uint64_t(0) : (uint64_t(1) << i) - 1);
+                    }
+                }
+                return max;
+            }
+        };
+
+        struct SolveStats{
+            Histogram shots_per_solve;
+            Histogram solve_ns;
+            uint64_t terminations[TERMINATION_COUNT] = {};
+
+            void merge(const SolveStats& other){
+                shots_per_solve.merge(other.shots_per_solve);
+                solve_ns.merge(other.solve_ns);
+                for(int i = 0; i < TERMINATION_COUNT; i++){
+                    terminations[i] += other.terminations[i];
+                }
+            }
+        };
+
+        struct Stats{
+            Histogram steps_per_shot;
+            Histogram ns_per_step;
+            uint64_t steps = 0;
+            uint64_t shot_ns = 0;
+            std::map<std::string, SolveStats> solves;
+
+            void merge(const Stats& other){
+                steps_per_shot.merge(other.steps_per_shot);
+                ns_per_step.merge(other.ns_per_step);
+                steps += other.steps;
+                shot_ns += other.shot_ns;
+                for(const auto& [name, solve] : other.solves){
+                    solves[name].merge(solve);
+                }
+            }
+
+            double nsPerStep() const{
+                return steps ? (double)shot_ns / (double)steps : 0.0;
+            }
+        };
+
+        typedef std::chrono::steady_clock Clock;
+
+        static uint64_t elapsedNs(Clock::time_point start){
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        }
+
+        //records one simulated shot when it goes out of scope, and its span while tracing
+        class ShotScope{
+            public:
+                ShotScope(){
+                    if constexpr (ENABLED){
+                        start = Clock::now();
+                    }
+                }
+                ~ShotScope(){
+                    if constexpr (ENABLED){
+                        recordShot(steps, elapsedNs(start));
+                        trace.arg("steps", (int64_t)steps);
+                    }
+                }
+                void step(){
+                    if constexpr (ENABLED){
+                        steps++;
+                    }
+                }
+            private:
+                Trace::Scope trace{"shot", "simulation"};
+                Clock::time_point start;
+                uint64_t steps = 0;
+        };
+
+        //records one strategy run when it goes out of scope, MAX_TRIES unless told otherwise
+        class SolveScope{
+            public:
+                SolveScope(const char* strategy) : trace(strategy, "solver"), strategy(strategy){
+                    if constexpr (ENABLED){
+                        start = Clock::now();
+                    }
+                }
+                ~SolveScope(){
+                    if constexpr (ENABLED){
+                        recordSolve(strategy, shots, elapsedNs(start), termination);
+                        trace.arg("shots", (int64_t)shots);
+                    }
+                }
+                void shot(uint64_t count = 1){
+                    if constexpr (ENABLED){
+                        shots += count;
+                    }
+                }
+                void terminate(Termination termination){
+                    this->termination = termination;
+                }
+            private:
+                Trace::Scope trace;
+                const char* strategy;
+                Clock::time_point start;
+                uint64_t shots = 0;
+                Termination termination = MAX_TRIES;
+        };
+
+        static void recordShot(uint64_t steps, uint64_t ns){
+            ThreadSlot& slot = threadSlot();
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            slot.stats.steps_per_shot.add(steps);
+            if(steps > 0){
+                slot.stats.ns_per_step.add(ns / steps);
+            }
+            slot.stats.steps += steps;
+            slot.stats.shot_ns += ns;
+        }
+
+        static void recordSolve(const char* strategy, uint64_t shots, uint64_t ns, Termination termination){
+            ThreadSlot& slot = threadSlot();
+            std::lock_guard<std::mutex> lock(slot.mutex);
+            SolveStats& solve = slot.stats.solves[strategy];
+            solve.shots_per_solve.add(shots);
+            solve.solve_ns.add(ns);
+            solve.terminations[termination]++;
+        }
+
+        //merges the histograms of every thread that ever recorded something
+        static Stats snapshot(){
+            Stats merged;
+            std::lock_guard<std::mutex> lock(registryMutex());
+            for(const auto& slot : slots()){
+                std::lock_guard<std::mutex> slot_lock(slot->mutex);
+                merged.merge(slot->stats);
+            }
+            return merged;
+        }
+
+        static void reset(){
+            std::lock_guard<std::mutex> lock(registryMutex());
+            for(const auto& slot : slots()){
+                std::lock_guard<std::mutex> slot_lock(slot->mutex);
+                slot->stats = Stats();
+            }
+        }
+
+        static std::string toJson(const Stats& stats){
+            std::ostringstream out;
+            out << "{\n";
+            out << "  \"enabled\": " << (ENABLED ? "true" : "false") << ",\n";
+            out << "  \"shots\": " << stats.steps_per_shot.count << ",\n";
+            out << "  \"steps\": " << stats.steps << ",\n";
+            out << "  \"ns_per_step\": " << stats.nsPerStep() << ",\n";
+            out << "  \"steps_per_shot\": " << histogramJson(stats.steps_per_shot) << ",\n";
+            out << "  \"ns_per_step_histogram\": " << histogramJson(stats.ns_per_step) << ",\n";
+            out << "  \"solves\": {";
+            bool first = true;
+            for(const auto& [name, solve] : stats.solves){
+                out << (first ? "\n" : ",\n");
+                first = false;
+                out << "    \"" << name << "\": {\n";
+                out << "      \"shots_per_solve\": " << histogramJson(solve.shots_per_solve) << ",\n";
+                out << "      \"solve_ns\": " << histogramJson(solve.solve_ns) << ",\n";
+                out << "      \"terminations\": {";
+                for(int i = 0; i < TERMINATION_COUNT; i++){
+                    out << (i ? ", " : "") << "\"" << terminationName((Termination)i) << "\": " << solve.terminations[i];
+                }
+                out << "}\n    }";
+            }
+            out << (first ? "}\n" : "\n  }\n");
+            out << "}\n";
+            return out.str();
+        }
+
+        static bool dumpJson(const std::string& path){
+            std::ofstream file(path);
+            if(!file){
+                return false;
+            }
+            file << toJson(snapshot());
+            return (bool)file;
+        }
+
+    private:
+        struct ThreadSlot{
+            std::mutex mutex;
+            Stats stats;
+        };
+
+        static std::string histogramJson(const Histogram& histogram){
+            std::ostringstream out;
+            out << "{\"count\": " << histogram.count
+                << ", \"mean\": " << histogram.mean()
+                << ", \"min\": " << (histogram.count ? histogram.min : 0)
+                << ", \"max\": " << histogram.max
+                << ", \"p50\": " << histogram.quantile(0.5)
+                << ", \"p99\": " << histogram.quantile(0.99)
+                << ", \"buckets\": [";
+            int last = Histogram::BUCKETS - 1;
+            while(last > 0 && histogram.buckets[last] == 0){
+                last--;
+            }
+            for(int i = 0; i <= last; i++){
+                out << (i ? ", " : "") << histogram.buckets[i];
+            }
+            out << "]}";
+            return out.str();
+        }
+
+        static std::mutex& registryMutex(){
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        //slots outlive their threads so nothing recorded is lost when a worker exits
+        static std::vector<std::shared_ptr<ThreadSlot>>& slots(){
+            static std::vector<std::shared_ptr<ThreadSlot>> slots;
+            return slots;
+        }
+
+        static ThreadSlot& threadSlot(){
+            thread_local std::shared_ptr<ThreadSlot> slot = [](){
+                auto slot = std::make_shared<ThreadSlot>();
+                std::lock_guard<std::mutex> lock(registryMutex());
+                slots().push_back(slot);
+                return slot;
+            }();
+            return *slot;
+        }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "track.hpp"
+#include "trace.hpp"
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstdint>
+
+//Lead solution against a moving target: aim at where the track puts the target when the shot arrives,
+//solve the angle for that point, and repeat with the new time of flight until it stops changing. The
+//time of flight is a fixed point t = tof(predict(fire + t)); after the first step it is found with the
+//secant method on tof(predict(fire + t)) - t. Every angle solve after the first is warm started from
+//the one before, and the whole search from a previous solution of the same track when one is given.
+class Intercept {
+    public:
+        struct Settings{
+            double tolerance = 0.001; //on the time of flight, seconds
+            int max_iterations = 8;
+            double latency = 0.0; //from the solve to the shot leaving the muzzle, seconds
+            double warm_width = 0.5; //degrees
+            Simulation::Strategy strategy = Simulation::BISECTION; //without any earlier angle
+        };
+
+        struct Solution{
+            bool valid = false; //hit and converged
+            Simulation::ShotResultEnum result = Simulation::ShotResultEnum::NO_IN_RANGE;
+            glm::dvec3 aim_point = glm::dvec3(0.0);
+            double angle = 0.0; //simulateShot angle towards aim_point
+            double fire_time = 0.0;
+            double flight_time = 0.0;
+            double lead = 0.0; //degrees between the target at fire_time and aim_point, seen from the shooter
+            uint32_t iterations = 0;
+            uint32_t shots = 0;
+        };
+
+        //simulation supplies the shooter, speed, mass, step and terrain; its target is overwritten
+        static Solution solve(Simulation& simulation, const Track& track, double now, const Settings& settings, const Solution* previous = nullptr){
+            Trace::Scope trace("intercept", "solver");
+            Solution solution;
+            solution.fire_time = now + settings.latency;
+            if(track.empty()){
+                return solution;
+            }
+            const glm::dvec3& shooter = simulation.getShooterPosition();
+            glm::dvec3 current = track.predict(solution.fire_time);
+
+            bool warm = previous && previous->result == Simulation::ShotResultEnum::HIT;
+            double guess = warm ? previous->angle : 0.0;
+            double time = warm ? previous->flight_time : glm::length(current - shooter) / std::max(simulation.getShootSpeed(), 1e-9);
+
+            double previous_time = 0.0;
+            double previous_error = 0.0;
+            for(int iteration = 0; iteration < settings.max_iterations; iteration++){
+                solution.iterations++;
+                glm::dvec3 aim = track.predict(solution.fire_time + time);
+                simulation.setTargetPosition(aim);
+                Simulation::StrategyResult result = warm ? simulation.find_angle_warm(guess, settings.warm_width)
+                                                         : simulation.find_angle(settings.strategy);
+                solution.shots += result.tries;
+                solution.result = result.best_result.result;
+                if(result.best_result.result != Simulation::ShotResultEnum::HIT){
+                    return solution;
+                }
+                warm = true;
+                guess = result.best_angle;
+                solution.aim_point = aim;
+                solution.angle = result.best_angle;
+                solution.flight_time = result.best_result.time;
+
+                double error = result.best_result.time - time;
+                if(std::abs(error) < settings.tolerance){
+                    solution.valid = true;
+                    break;
+                }
+                double next = result.best_result.time;
+                if(iteration > 0 && error != previous_error){
+                    double secant = time - error * (time - previous_time) / (error - previous_error);
+                    if(secant > 0.0 && std::isfinite(secant)){
+                        next = secant;
+                    }
+                }
+                previous_time = time;
+                previous_error = error;
+                time = next;
+            }
+
+            glm::dvec3 sight = current - shooter;
+            glm::dvec3 aimed = solution.aim_point - shooter;
+            if(glm::length(sight) > 0.0 && glm::length(aimed) > 0.0){
+                solution.lead = glm::degrees(std::acos(glm::clamp(glm::dot(glm::normalize(sight), glm::normalize(aimed)), -1.0, 1.0)));
+            }
+            return solution;
+        }
+};
@@ -1,16 +1,179 @@
 #include <iostream>
+#include <cstring>
+#include <memory>
+#include <fstream>
+#include <signal.h>
 #include "simulation.hpp"
+#include "batch.hpp"
+#include "service.hpp"
+#include "accuracy.hpp"
+#include "shards.hpp"
 #include "gui.hpp"
 
 
-int main() {
+int main(int argc, char** argv) {
     try {
-        // Create and run the simulation GUI
-        GUI gui;
-        gui.run();
+        std::string batch_path;
+        std::string perf_json_path;
+        std::string trace_path;
+        std::string terrain_path;
+        std::string serve_path;
+        std::string load_path;
+        std::string accuracy_path;
+        std::string accuracy_json_path;
+        std::string work_dir;
+        std::string shard_worker_dir;
+        size_t shard_worker = 0;
+        size_t shards = 0;
+        unsigned processes = 2;
+        unsigned connections = 4;
+        size_t requests = 1000;
+        unsigned threads = 1;
+        size_t cache_entries = 0;
+        for (int i = 1; i < argc; i++) {
+            if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+                batch_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                threads = (unsigned)std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+                cache_entries = (size_t)std::stoull(argv[++i]);
+            } else if (std::strcmp(argv[i], "--perf-json") == 0 && i + 1 < argc) {
+                perf_json_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+                trace_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--terrain") == 0 && i + 1 < argc) {
+                terrain_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--accuracy") == 0 && i + 1 < argc) {
+                accuracy_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--accuracy-json") == 0 && i + 1 < argc) {
+                accuracy_json_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+                shards = (size_t)std::stoull(argv[++i]);
+            } else if (std::strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+                processes = (unsigned)std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--work-dir") == 0 && i + 1 < argc) {
+                work_dir = argv[++i];
+            } else if (std::strcmp(argv[i], "--shard-worker") == 0 && i + 2 < argc) {
+                shard_worker_dir = argv[++i];
+                shard_worker = (size_t)std::stoull(argv[++i]);
+            } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+                serve_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+                load_path = argv[++i];
+            } else if (std::strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+                connections = (unsigned)std::stoul(argv[++i]);
+            } else if (std::strcmp(argv[i], "--requests") == 0 && i + 1 < argc) {
+                requests = (size_t)std::stoull(argv[++i]);
+            } else {
+                std::cerr << "Usage: " << argv[0] << " [--batch <scenario file> [--threads <n>] [--cache <entries>]] [--terrain <heightfield file>] [--perf-json <file>] [--trace <file>]" << std::endl;
+                std::cerr << "       " << argv[0] << " --batch <scenario file> --shards <n> [--processes <n>] [--threads <n>] [--work-dir <dir>] [--terrain <heightfield file>]" << std::endl;
+                std::cerr << "       " << argv[0] << " --serve <socket> [--threads <n>] [--cache <entries>] [--terrain <heightfield file>]" << std::endl;
+                std::cerr << "       " << argv[0] << " --accuracy <scenario file> [--accuracy-json <file>]" << std::endl;
+                std::cerr << "       " << argv[0] << " --load <socket> --batch <scenario file> [--connections <n>] [--requests <n>]" << std::endl;
+                return 1;
+            }
+        }
+
+        Trace::setThreadName("main");
+        if (!trace_path.empty()) {
+            Trace::start();
+        }
+
+        std::unique_ptr<Terrain> terrain;
+        if (!terrain_path.empty()) {
+            terrain = std::make_unique<Terrain>(Terrain::load(terrain_path));
+        }
+
+        if (!shard_worker_dir.empty()) {
+            // One shard of a sharded batch, started by the coordinator below
+            return Shards::runShard(shard_worker_dir, shard_worker, threads, terrain.get()) ? 0 : 1;
+        } else if (!batch_path.empty() && shards > 0 && load_path.empty()) {
+            // Split the batch over worker processes, rerunning with the same work directory resumes it
+            Shards::Settings settings;
+            settings.shards = shards;
+            settings.processes = processes;
+            settings.threads = threads;
+            settings.executable = "/proc/self/exe";
+            settings.terrain_path = terrain_path;
+            Shards::Report report = Shards::run(batch_path, work_dir.empty() ? batch_path + ".shards" : work_dir, settings, std::cout);
+            std::cerr << "Shards: " << report.shards << " launched: " << report.launched << " restarts: " << report.restarts
+                      << " reused: " << report.reused << std::endl;
+        } else if (!accuracy_path.empty()) {
+            // Error against a fine reference and cost for every integrator and time step, Pareto front as CSV
+            std::vector<Accuracy::Measurement> measurements = Accuracy::run(Batch::load(accuracy_path));
+            std::vector<Accuracy::Point> points = Accuracy::pareto(measurements);
+            std::cout << Accuracy::csv(points);
+            if (!accuracy_json_path.empty()) {
+                std::ofstream file(accuracy_json_path);
+                file << Accuracy::json(points, measurements);
+                if (!file) {
+                    std::cerr << "Cannot write " << accuracy_json_path << std::endl;
+                    return 1;
+                }
+            }
+        } else if (!load_path.empty()) {
+            // Drive a running service with the scenarios of the batch file
+            if (batch_path.empty()) {
+                std::cerr << "--load needs --batch <scenario file>" << std::endl;
+                return 1;
+            }
+            ServiceClient::LoadResult result = ServiceClient::load(load_path, Batch::load(batch_path), connections, requests);
+            std::cout << "requests " << result.requests << " errors " << result.errors << " seconds " << result.seconds
+                      << " throughput " << result.throughput << "/s p50 " << result.p50_ms << " ms p99 " << result.p99_ms << " ms" << std::endl;
+        } else if (!serve_path.empty()) {
+            // Serve until SIGINT or SIGTERM, the signals are taken synchronously by this thread
+            sigset_t signals;
+            sigemptyset(&signals);
+            sigaddset(&signals, SIGINT);
+            sigaddset(&signals, SIGTERM);
+            pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+            std::unique_ptr<Simulation::ShotCache> cache;
+            if (cache_entries > 0) {
+                cache = std::make_unique<Simulation::ShotCache>(cache_entries);
+            }
+            Service service(serve_path, threads, cache.get(), terrain.get());
+            service.start();
+            std::cerr << "Listening on " << serve_path << std::endl;
+            int signal = 0;
+            sigwait(&signals, &signal);
+            service.stop();
+            std::cerr << Service::statsJson(service.stats()) << std::endl;
+        } else if (!batch_path.empty()) {
+            // Solve every scenario without opening a window
+            std::vector<Batch::Scenario> scenarios = Batch::load(batch_path);
+            std::unique_ptr<Simulation::ShotCache> cache;
+            if (cache_entries > 0) {
+                cache = std::make_unique<Simulation::ShotCache>(cache_entries);
+            }
+            std::vector<Simulation::StrategyResult> results = Batch::run(scenarios, threads, cache.get(), terrain.get());
+            for (size_t i = 0; i < results.size(); i++) {
+                std::cout << Batch::format(i, results[i]) << '\n';
+            }
+            if (cache) {
+                std::cerr << "Cache hits: " << cache->hitCount() << " misses: " << cache->missCount() << std::endl;
+            }
+        } else {
+            // Create and run the simulation GUI
+            GUI gui;
+            gui.simulation.setTerrain(terrain.get());
+            gui.run();
+        }
+
+        if (!perf_json_path.empty() && !Instrumentation::dumpJson(perf_json_path)) {
+            std::cerr << "Cannot write " << perf_json_path << std::endl;
+            return 1;
+        }
+        if (!trace_path.empty()) {
+            Trace::stop();
+            if (!Trace::writeJson(trace_path)) {
+                std::cerr << "Cannot write " << trace_path << std::endl;
+                return 1;
+            }
+        }
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-} 
\ No newline at end of file
+}
\ No newline at end of file
@@ -3,6 +3,12 @@
 #include <glm/glm.hpp>
 #include <entt/entt.hpp>
 #include "components.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <utility>
+#include <vector>
 
 class Physics {
     public:
@@ -13,28 +19,451 @@ class Physics {
         Physics(){}
         virtual ~Physics(){}
 
+        //TRAPEZOID is the original scheme: Euler velocity, position from the mean of both velocities
+        enum Integrator{
+            TRAPEZOID,
+            EULER,
+            HEUN,
+            RK4
+        };
+        static Integrator INTEGRATOR;
+
+        //POINT_MASS is gravity and drag only. MODIFIED_POINT_MASS also carries the spin of entities that
+        //have Spin and Aerodynamics: lift and Magnus force from the yaw of repose, and the spin decay
+        enum Model{
+            POINT_MASS,
+            MODIFIED_POINT_MASS
+        };
+        static Model MODEL;
+
+        //groups at least this large are split across the shared thread pool
+        static size_t PARALLEL_THRESHOLD;
+        static size_t PARALLEL_CHUNK;
+
+        static const char* integratorName(Integrator integrator){
+            switch(integrator){
+                case TRAPEZOID: return "trapezoid";
+                case EULER: return "euler";
+                case HEUN: return "heun";
+                case RK4: return "rk4";
+                default: return "unknown";
+            }
+        }
+
+        static const char* modelName(Model model){
+            switch(model){
+                case POINT_MASS: return "point mass";
+                case MODIFIED_POINT_MASS: return "modified point mass";
+                default: return "unknown";
+            }
+        }
+
+        //acceleration evaluations per step
+        static int integratorStages(Integrator integrator){
+            switch(integrator){
+                case HEUN: return 2;
+                case RK4: return 4;
+                default: return 1;
+            }
+        }
+
+        static void update(entt::registry& registry, double deltaTime){
+            if(MODEL == MODIFIED_POINT_MASS){
+                switch(INTEGRATOR){
+                    case EULER: updateModified<EULER>(registry, deltaTime); break;
+                    case HEUN: updateModified<HEUN>(registry, deltaTime); break;
+                    case RK4: updateModified<RK4>(registry, deltaTime); break;
+                    default: updateModified<TRAPEZOID>(registry, deltaTime); break;
+                }
+                return;
+            }
+            switch(INTEGRATOR){
+                case EULER: update<EULER>(registry, deltaTime); break;
+                case HEUN: update<HEUN>(registry, deltaTime); break;
+                case RK4: update<RK4>(registry, deltaTime); break;
+                default: update<TRAPEZOID>(registry, deltaTime); break;
+            }
+        }
+
+        static void integrate(Position& position, Velocity& velocity, const Mass& mass, double deltaTime){
+            switch(INTEGRATOR){
+                case EULER: integrate<EULER>(position, velocity, mass, deltaTime); break;
+                case HEUN: integrate<HEUN>(position, velocity, mass, deltaTime); break;
+                case RK4: integrate<RK4>(position, velocity, mass, deltaTime); break;
+                default: integrate<TRAPEZOID>(position, velocity, mass, deltaTime); break;
+            }
+        }
+
+        //iterates an owning group so the three storages stay packed in the same order
+        template<Integrator I>
         static void update(entt::registry& registry, double deltaTime){
-            auto view = registry.view<Position, Velocity, Mass>();
+            auto group = registry.group<Position, Velocity, Mass>();
+            size_t count = group.size();
 
-            view.each([deltaTime](auto entity, auto& position, auto& velocity, auto& mass){
+            if(count < PARALLEL_THRESHOLD || PARALLEL_CHUNK == 0){
+                updateRange<I>(group, 0, count, deltaTime);
+                return;
+            }
 
-                glm::dvec3 vel = velocity.velocity + GRAVITY * deltaTime;
+            ThreadPool& pool = ThreadPool::shared();
+            std::vector<std::future<void>> chunks;
+            for(size_t begin = PARALLEL_CHUNK; begin < count; begin += PARALLEL_CHUNK){
+                size_t end = std::min(begin + PARALLEL_CHUNK, count);
+                chunks.push_back(pool.submit([&group, begin, end, deltaTime](){
+                    updateRange<I>(group, begin, end, deltaTime);
+                }));
+            }
+            updateRange<I>(group, 0, std::min(PARALLEL_CHUNK, count), deltaTime);
+            for(auto& chunk : chunks){
+                pool.wait(chunk);
+            }
+        }
 
-                double speed = glm::length(velocity.velocity);
+        //Same groups as update(), but held in one array per scalar so the step is a single loop of plain
+        //arithmetic across entities that the compiler vectorises. The arrays live in the context of the
+        //registry and own the state of the group between steps; Position, Velocity and Spin are only written
+        //back. They are loaded again when Position, Velocity, Mass, Spin or Aerodynamics is emplaced, removed,
+        //patched or replaced in the registry, when AIR_DENSITY changes, or after reloadModified(). Entities
+        //without Spin and Aerodynamics get zero coefficients, which leaves exactly the point mass terms.
+        template<Integrator I>
+        static void updateModified(entt::registry& registry, double deltaTime){
+            auto group = registry.group<Position, Velocity, Mass>();
+            size_t count = group.size();
+            if(!registry.ctx().contains<Lanes>()){
+                watch<Position>(registry);
+                watch<Velocity>(registry);
+                watch<Mass>(registry);
+                watch<Spin>(registry);
+                watch<Aerodynamics>(registry);
+            }
+            Lanes& lanes = registry.ctx().emplace<Lanes>();
+            if(!lanes.current()){
+                lanes.reload(registry, group);
+            }
+
+            if(count < PARALLEL_THRESHOLD || PARALLEL_CHUNK == 0){
+                modifiedRange<I>(lanes, 0, count, deltaTime);
+            } else {
+                ThreadPool& pool = ThreadPool::shared();
+                std::vector<std::future<void>> chunks;
+                for(size_t begin = PARALLEL_CHUNK; begin < count; begin += PARALLEL_CHUNK){
+                    size_t end = std::min(begin + PARALLEL_CHUNK, count);
+                    chunks.push_back(pool.submit([begin, end, deltaTime, lanes = &lanes](){
+                        modifiedRange<I>(*lanes, begin, end, deltaTime);
+                    }));
+                }
+                modifiedRange<I>(lanes, 0, std::min(PARALLEL_CHUNK, count), deltaTime);
+                for(auto& chunk : chunks){
+                    pool.wait(chunk);
+                }
+            }
+
+            size_t i = 0;
+            for(auto entity : group){
+                auto [position, velocity] = group.template get<Position, Velocity>(entity);
+                lanes.store(i++, position, velocity);
+            }
+            for(const auto& [lane, entity] : lanes.spinning){
+                lanes.storeSpin(lane, registry.get<Spin>(entity));
+            }
+        }
+
+        //for writes through get() to Position, Velocity, Mass, Spin or Aerodynamics of entities the modified
+        //model already holds; patch() and replace() reload by themselves
+        static void reloadModified(entt::registry& registry){
+            if(Lanes* lanes = registry.ctx().find<Lanes>()){
+                lanes->loaded = false;
+            }
+        }
+
+        //gravity plus quadratic drag, drag only depends on the velocity
+        static glm::dvec3 acceleration(const glm::dvec3& velocity, const Mass& mass){
+            glm::dvec3 result = GRAVITY;
+            double speed = glm::length(velocity);
+            if(speed > 0.0){
+                double F_resistance = 0.5 * AIR_DENSITY * speed * speed * mass.air_resistance;
+                result += -glm::normalize(velocity) * F_resistance / mass.mass;
+            }
+            return result;
+        }
+
+        template<Integrator I>
+        static void integrate(Position& position, Velocity& velocity, const Mass& mass, double deltaTime){
+            const glm::dvec3 v = velocity.velocity;
+            position.previous_position = position.position;
+
+            if constexpr (I == EULER){
+                position.position += v * deltaTime;
+                velocity.velocity = v + acceleration(v, mass) * deltaTime;
+            } else if constexpr (I == HEUN){
+                glm::dvec3 a1 = acceleration(v, mass);
+                glm::dvec3 predicted = v + a1 * deltaTime;
+                glm::dvec3 a2 = acceleration(predicted, mass);
+                position.position += (v + predicted) * 0.5 * deltaTime;
+                velocity.velocity = v + (a1 + a2) * 0.5 * deltaTime;
+            } else if constexpr (I == RK4){
+                double half = 0.5 * deltaTime;
+                glm::dvec3 a1 = acceleration(v, mass);
+                glm::dvec3 v2 = v + a1 * half;
+                glm::dvec3 a2 = acceleration(v2, mass);
+                glm::dvec3 v3 = v + a2 * half;
+                glm::dvec3 a3 = acceleration(v3, mass);
+                glm::dvec3 v4 = v + a3 * deltaTime;
+                glm::dvec3 a4 = acceleration(v4, mass);
+                position.position += (v + 2.0 * v2 + 2.0 * v3 + v4) * (deltaTime / 6.0);
+                velocity.velocity = v + (a1 + 2.0 * a2 + 2.0 * a3 + a4) * (deltaTime / 6.0);
+            } else {
+                glm::dvec3 vel = v + GRAVITY * deltaTime;
+
+                double speed = glm::length(v);
                 if(speed > 0.0){
                     double F_resistance = 0.5 * AIR_DENSITY * speed * speed * mass.air_resistance;
-                    glm::dvec3 a_resistance = -glm::normalize(velocity.velocity) * F_resistance / mass.mass;
+                    glm::dvec3 a_resistance = -glm::normalize(v) * F_resistance / mass.mass;
                     vel += a_resistance * deltaTime;
                 }
-                
-                position.previous_position = position.position;
-                position.position += (vel + velocity.velocity) * 0.5 * deltaTime;
+
+                position.position += (vel + v) * 0.5 * deltaTime;
                 velocity.velocity = vel;
+            }
+        }
+
+        static void integratePlanar(glm::dvec2& position, glm::dvec2& velocity, double gravity, double drag, double deltaTime){
+            switch(INTEGRATOR){
+                case EULER: integratePlanar<EULER>(position, velocity, gravity, drag, deltaTime); break;
+                case HEUN: integratePlanar<HEUN>(position, velocity, gravity, drag, deltaTime); break;
+                case RK4: integratePlanar<RK4>(position, velocity, gravity, drag, deltaTime); break;
+                default: integratePlanar<TRAPEZOID>(position, velocity, gravity, drag, deltaTime); break;
+            }
+        }
+
+        //The same schemes as integrate() for a point mass that stays in a vertical plane, x downrange and
+        //y up. gravity is the magnitude of GRAVITY and drag is 0.5 * AIR_DENSITY * air_resistance / mass.
+        template<Integrator I>
+        static void integratePlanar(glm::dvec2& position, glm::dvec2& velocity, double gravity, double drag, double deltaTime){
+            const glm::dvec2 v = velocity;
+            auto acceleration = [gravity, drag](const glm::dvec2& u){
+                return glm::dvec2(0.0, -gravity) - u * (drag * glm::length(u));
+            };
+
+            if constexpr (I == EULER){
+                position += v * deltaTime;
+                velocity = v + acceleration(v) * deltaTime;
+            } else if constexpr (I == HEUN){
+                glm::dvec2 a1 = acceleration(v);
+                glm::dvec2 predicted = v + a1 * deltaTime;
+                glm::dvec2 a2 = acceleration(predicted);
+                position += (v + predicted) * 0.5 * deltaTime;
+                velocity = v + (a1 + a2) * 0.5 * deltaTime;
+            } else if constexpr (I == RK4){
+                double half = 0.5 * deltaTime;
+                glm::dvec2 a1 = acceleration(v);
+                glm::dvec2 v2 = v + a1 * half;
+                glm::dvec2 a2 = acceleration(v2);
+                glm::dvec2 v3 = v + a2 * half;
+                glm::dvec2 a3 = acceleration(v3);
+                glm::dvec2 v4 = v + a3 * deltaTime;
+                glm::dvec2 a4 = acceleration(v4);
+                position += (v + 2.0 * v2 + 2.0 * v3 + v4) * (deltaTime / 6.0);
+                velocity = v + (a1 + 2.0 * a2 + 2.0 * a3 + a4) * (deltaTime / 6.0);
+            } else {
+                glm::dvec2 vel = v + acceleration(v) * deltaTime;
+                position += (vel + v) * 0.5 * deltaTime;
+                velocity = vel;
+            }
+        }
+
+    private:
+        //modified point mass state and per entity constants, one array each
+        struct Lanes{
+            std::vector<double> x, y, z, vx, vy, vz, rate, yaw_x, yaw_y, yaw_z;
+            std::vector<double> drag, lift, magnus, repose, damping;
+
+            //cleared by the registry signals watch() connects
+            bool loaded = false;
+            double density = 0.0;
+            std::vector<std::pair<size_t, entt::entity>> spinning; //lane and entity of every Spin
+
+            bool current() const{
+                return loaded && density == AIR_DENSITY;
+            }
+
+            template<typename Group>
+            void reload(entt::registry& registry, Group& group){
+                resize(group.size());
+                spinning.clear();
+                size_t i = 0;
+                for(auto entity : group){
+                    auto [position, velocity, mass] = group.template get<Position, Velocity, Mass>(entity);
+                    const Spin* spin = registry.try_get<Spin>(entity);
+                    const Aerodynamics* aerodynamics = spin ? registry.try_get<Aerodynamics>(entity) : nullptr;
+                    if(spin){
+                        spinning.push_back({i, entity});
+                    }
+                    load(i++, position, velocity, mass, spin, aerodynamics);
+                }
+                loaded = true;
+                density = AIR_DENSITY;
+            }
+
+            void resize(size_t count){
+                for(std::vector<double>* lane : {&x, &y, &z, &vx, &vy, &vz, &rate, &yaw_x, &yaw_y, &yaw_z, &drag, &lift, &magnus, &repose, &damping}){
+                    lane->resize(count);
+                }
+            }
+
+            //folds density, area and inertia into the constants so the kernel only multiplies
+            void load(size_t i, const Position& position, const Velocity& velocity, const Mass& mass, const Spin* spin, const Aerodynamics* aerodynamics){
+                x[i] = position.position.x;
+                y[i] = position.position.y;
+                z[i] = position.position.z;
+                vx[i] = velocity.velocity.x;
+                vy[i] = velocity.velocity.y;
+                vz[i] = velocity.velocity.z;
+                drag[i] = 0.5 * AIR_DENSITY * mass.air_resistance / mass.mass;
+                rate[i] = spin ? spin->rate : 0.0;
+                yaw_x[i] = spin ? spin->yaw.x : 0.0;
+                yaw_y[i] = spin ? spin->yaw.y : 0.0;
+                yaw_z[i] = spin ? spin->yaw.z : 0.0;
+                lift[i] = magnus[i] = repose[i] = damping[i] = 0.0;
+                if(aerodynamics && aerodynamics->diameter > 0.0){
+                    double d = aerodynamics->diameter;
+                    double area = glm::pi<double>() * d * d * 0.25;
+                    double q = AIR_DENSITY * area;
+                    lift[i] = q * aerodynamics->lift / (2.0 * mass.mass);
+                    magnus[i] = q * d * aerodynamics->magnus / (2.0 * mass.mass);
+                    repose[i] = aerodynamics->overturning != 0.0 && AIR_DENSITY > 0.0 ? 2.0 * aerodynamics->axial_inertia / (q * d * aerodynamics->overturning) : 0.0;
+                    damping[i] = aerodynamics->axial_inertia > 0.0 ? q * d * d * aerodynamics->spin_damping / (2.0 * aerodynamics->axial_inertia) : 0.0;
+                }
+            }
+
+            void store(size_t i, Position& position, Velocity& velocity) const{
+                position.previous_position = position.position;
+                position.position = glm::dvec3(x[i], y[i], z[i]);
+                velocity.velocity = glm::dvec3(vx[i], vy[i], vz[i]);
+            }
+
+            void storeSpin(size_t i, Spin& spin) const{
+                spin.rate = rate[i];
+                spin.yaw = glm::dvec3(yaw_x[i], yaw_y[i], yaw_z[i]);
+            }
+        };
+
+        //any change to the component that the lanes could be holding stale
+        template<typename Component>
+        static void watch(entt::registry& registry){
+            registry.on_construct<Component>().template connect<&invalidate>();
+            registry.on_update<Component>().template connect<&invalidate>();
+            registry.on_destroy<Component>().template connect<&invalidate>();
+        }
+
+        static void invalidate(entt::registry& registry, entt::entity){
+            reloadModified(registry);
+        }
+
+        //yaw of repose from the gravity turn of the velocity, 2 I p (g x v) / (rho S d V^4 C_Ma); drag is
+        //along the velocity and does not turn it
+        static glm::dvec3 yawOfRepose(const glm::dvec3& v, double p, double repose){
+            //without a branch, so the loop stays vectorisable; at rest the cross product is zero anyway
+            double v2 = glm::dot(v, v);
+            return glm::cross(GRAVITY, v) * (repose * p / std::max(v2 * v2, 1e-300));
+        }
+
+        //acceleration and spin decay of one lane
+        static glm::dvec3 modifiedAcceleration(const glm::dvec3& v, double p, double drag, double lift, double magnus, double repose, double damping,
+                                               double& spin_decay){
+            double v2 = glm::dot(v, v);
+            double speed = std::sqrt(v2);
+            glm::dvec3 alpha = yawOfRepose(v, p, repose);
+            spin_decay = damping * speed * p;
+            return GRAVITY - v * (drag * speed) + alpha * (lift * v2) - glm::cross(alpha, v) * (magnus * p);
+        }
+
+        //the same schemes as integrate(), with the spin rate integrated alongside the velocity
+        template<Integrator I>
+        static void modifiedRange(Lanes& lanes, size_t begin, size_t end, double deltaTime){
+            double* x = lanes.x.data();
+            double* y = lanes.y.data();
+            double* z = lanes.z.data();
+            double* vx = lanes.vx.data();
+            double* vy = lanes.vy.data();
+            double* vz = lanes.vz.data();
+            double* rate = lanes.rate.data();
+            double* yaw_x = lanes.yaw_x.data();
+            double* yaw_y = lanes.yaw_y.data();
+            double* yaw_z = lanes.yaw_z.data();
+            const double* drag = lanes.drag.data();
+            const double* lift = lanes.lift.data();
+            const double* magnus = lanes.magnus.data();
+            const double* repose = lanes.repose.data();
+            const double* damping = lanes.damping.data();
+
+            #pragma omp simd
+            for(size_t i = begin; i < end; i++){
+                const glm::dvec3 v(vx[i], vy[i], vz[i]);
+                const double p = rate[i];
+                glm::dvec3 position_step;
+                glm::dvec3 next;
+                double next_rate;
+
+                double d1;
+                glm::dvec3 a1 = modifiedAcceleration(v, p, drag[i], lift[i], magnus[i], repose[i], damping[i], d1);
+                if constexpr (I == EULER){
+                    position_step = v * deltaTime;
+                    next = v + a1 * deltaTime;
+                    next_rate = p + d1 * deltaTime;
+                } else if constexpr (I == HEUN){
+                    glm::dvec3 predicted = v + a1 * deltaTime;
+                    double d2;
+                    glm::dvec3 a2 = modifiedAcceleration(predicted, p + d1 * deltaTime, drag[i], lift[i], magnus[i], repose[i], damping[i], d2);
+                    position_step = (v + predicted) * 0.5 * deltaTime;
+                    next = v + (a1 + a2) * 0.5 * deltaTime;
+                    next_rate = p + (d1 + d2) * 0.5 * deltaTime;
+                } else if constexpr (I == RK4){
+                    double half = 0.5 * deltaTime;
+                    double d2, d3, d4;
+                    glm::dvec3 v2 = v + a1 * half;
+                    glm::dvec3 a2 = modifiedAcceleration(v2, p + d1 * half, drag[i], lift[i], magnus[i], repose[i], damping[i], d2);
+                    glm::dvec3 v3 = v + a2 * half;
+                    glm::dvec3 a3 = modifiedAcceleration(v3, p + d2 * half, drag[i], lift[i], magnus[i], repose[i], damping[i], d3);
+                    glm::dvec3 v4 = v + a3 * deltaTime;
+                    glm::dvec3 a4 = modifiedAcceleration(v4, p + d3 * deltaTime, drag[i], lift[i], magnus[i], repose[i], damping[i], d4);
+                    position_step = (v + 2.0 * v2 + 2.0 * v3 + v4) * (deltaTime / 6.0);
+                    next = v + (a1 + 2.0 * a2 + 2.0 * a3 + a4) * (deltaTime / 6.0);
+                    next_rate = p + (d1 + 2.0 * d2 + 2.0 * d3 + d4) * (deltaTime / 6.0);
+                } else {
+                    next = v + a1 * deltaTime;
+                    position_step = (next + v) * 0.5 * deltaTime;
+                    next_rate = p + d1 * deltaTime;
+                }
+
+                glm::dvec3 alpha = yawOfRepose(next, next_rate, repose[i]);
+                x[i] += position_step.x;
+                y[i] += position_step.y;
+                z[i] += position_step.z;
+                vx[i] = next.x;
+                vy[i] = next.y;
+                vz[i] = next.z;
+                rate[i] = next_rate;
+                yaw_x[i] = alpha.x;
+                yaw_y[i] = alpha.y;
+                yaw_z[i] = alpha.z;
+            }
+        }
 
-            });
+        template<Integrator I, typename Group>
+        static void updateRange(Group& group, size_t begin, size_t end, double deltaTime){
+            auto it = group.begin() + begin;
+            for(size_t i = begin; i < end; i++, ++it){
+                auto [position, velocity, mass] = group.template get<Position, Velocity, Mass>(*it);
+                integrate<I>(position, velocity, mass, deltaTime);
+            }
         }
 
 };
 
 glm::dvec3 Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
-double Physics::AIR_DENSITY = 1.225;
\ No newline at end of file
+double Physics::AIR_DENSITY = 1.225;
+Physics::Integrator Physics::INTEGRATOR = Physics::TRAPEZOID;
+Physics::Model Physics::MODEL = Physics::POINT_MASS;
+size_t Physics::PARALLEL_THRESHOLD = 8192;
+size_t Physics::PARALLEL_CHUNK = 4096;
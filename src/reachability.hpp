@@ -0,0 +1,196 @@
+#pragma once
+
+#include "components.hpp"
+#include "physics.hpp"
+#include <entt/entt.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//Maximum horizontal range reachable at each height difference for one (speed, drag, environment).
+//Built once from a sweep of elevations and cached, so a solver can reject a target that is out of
+//range without simulating a single shot.
+class Reachability {
+    public:
+        //relative slack around the envelope edge, covers the finite sweep and step size
+        static double MARGIN;
+        static int SWEEP_ANGLES;
+        static int HEIGHT_BINS;
+        //how far below the shooter the envelope reaches, in vacuum apex heights
+        static double DEPTH_FACTOR;
+
+        enum Verdict{
+            REACHABLE,
+            MARGINAL,
+            UNREACHABLE
+        };
+
+        struct Envelope{
+            double min_height;
+            double max_height;
+            double bin_size;
+            std::vector<double> max_range; //negative where no trajectory reaches the height
+
+            //max over the bin and its neighbours so the answer is never an underestimate of the sweep
+            double rangeAt(double height) const{
+                if(max_range.empty() || height > max_height + bin_size){
+                    return -1.0;
+                }
+                int bin = (int)((height - min_height) / bin_size);
+                double range = -1.0;
+                for(int i = bin - 1; i <= bin + 1; i++){
+                    if(i >= 0 && i < (int)max_range.size()){
+                        range = std::max(range, max_range[i]);
+                    }
+                }
+                return range;
+            }
+
+            bool covers(double height) const{
+                return !max_range.empty() && height >= min_height;
+            }
+        };
+
+        //nullptr when the envelope is not meaningful (no gravity or no speed), nothing is pruned then
+        static std::shared_ptr<const Envelope> envelope(double shoot_speed, double mass, double air_resistance, const glm::dvec3& up, double max_time){
+            EnvelopeKey key = {shoot_speed, mass, air_resistance, Physics::AIR_DENSITY, (double)Physics::INTEGRATOR,
+                Physics::GRAVITY.x, Physics::GRAVITY.y, Physics::GRAVITY.z, up.x, up.y, up.z, max_time};
+            {
+                std::lock_guard<std::mutex> lock(cacheMutex());
+                auto it = cache().find(key);
+                if(it != cache().end()){
+                    return it->second;
+                }
+            }
+
+            std::shared_ptr<const Envelope> result = compute(shoot_speed, mass, air_resistance, up, max_time);
+
+            std::lock_guard<std::mutex> lock(cacheMutex());
+            if(cache().size() >= 256){
+                cache().clear();
+            }
+            cache()[key] = result;
+            return result;
+        }
+
+        static Verdict classify(const Envelope* envelope, const glm::dvec3& shooter_position, const glm::dvec3& target_position, const glm::dvec3& up){
+            if(!envelope){
+                return REACHABLE;
+            }
+            glm::dvec3 offset = target_position - shooter_position;
+            double height = glm::dot(offset, up);
+            double distance = glm::length(offset - height * up);
+            if(!envelope->covers(height)){
+                return REACHABLE;
+            }
+            double range = envelope->rangeAt(height);
+            if(range < 0.0){
+                return height > 0.0 ? UNREACHABLE : REACHABLE;
+            }
+            if(distance > range * (1.0 + MARGIN) + envelope->bin_size){
+                return UNREACHABLE;
+            }
+            if(distance > range * (1.0 - MARGIN)){
+                return MARGINAL;
+            }
+            return REACHABLE;
+        }
+
+        static void clearCache(){
+            std::lock_guard<std::mutex> lock(cacheMutex());
+            cache().clear();
+        }
+
+    private:
+        typedef std::array<double, 12> EnvelopeKey;
+
+        static std::shared_ptr<const Envelope> compute(double shoot_speed, double mass, double air_resistance, const glm::dvec3& up, double max_time){
+            double g = glm::dot(-Physics::GRAVITY, up);
+            if(shoot_speed <= 0.0 || g <= 0.0 || mass <= 0.0){
+                return nullptr;
+            }
+
+            //drag only lowers the apex, so the vacuum apex bounds every reachable height
+            double apex = shoot_speed * shoot_speed / (2.0 * g);
+            auto envelope = std::make_shared<Envelope>();
+            envelope->max_height = apex;
+            envelope->min_height = -DEPTH_FACTOR * apex;
+            envelope->bin_size = (envelope->max_height - envelope->min_height) / HEIGHT_BINS;
+            envelope->max_range.assign(HEIGHT_BINS + 1, -1.0);
+
+            glm::dvec3 horizontal = glm::cross(up, glm::dvec3(0.0, 0.0, 1.0));
+            if(glm::length(horizontal) < 0.5){
+                horizontal = glm::cross(up, glm::dvec3(1.0, 0.0, 0.0));
+            }
+            horizontal = glm::normalize(horizontal);
+
+            //the whole sweep flies as one registry, finished shots are removed as they go
+            entt::registry registry;
+            for(int i = 0; i < SWEEP_ANGLES; i++){
+                double elevation = glm::radians(-90.0 + 180.0 * i / (SWEEP_ANGLES - 1));
+                glm::dvec3 velocity = shoot_speed * (glm::cos(elevation) * horizontal + glm::sin(elevation) * up);
+                auto projectile = registry.create();
+                registry.emplace<Position>(projectile, glm::dvec3(0.0), glm::dvec3(0.0));
+                registry.emplace<Velocity>(projectile, velocity);
+                registry.emplace<Mass>(projectile, Mass{mass, air_resistance});
+            }
+
+            //a couple of thousand steps over the nominal vacuum flight time
+            double delta_time = 2.0 * shoot_speed / g / 2000.0;
+            std::vector<entt::entity> finished;
+            int remaining = SWEEP_ANGLES;
+            for(double time = 0.0; time < max_time && remaining > 0; time += delta_time){
+                Physics::update(registry, delta_time);
+                finished.clear();
+                registry.view<Position>().each([&](auto entity, auto& position){
+                    double h0 = glm::dot(position.previous_position, up);
+                    double h1 = glm::dot(position.position, up);
+                    double r0 = glm::length(position.previous_position - h0 * up);
+                    double r1 = glm::length(position.position - h1 * up);
+                    addSegment(*envelope, r0, h0, r1, h1);
+                    if(h1 < envelope->min_height){
+                        finished.push_back(entity);
+                    }
+                });
+                for(auto entity : finished){
+                    registry.destroy(entity);
+                }
+                remaining -= (int)finished.size();
+            }
+            return envelope;
+        }
+
+        static void addSegment(Envelope& envelope, double r0, double h0, double r1, double h1){
+            int last = (int)envelope.max_range.size() - 1;
+            int b0 = glm::clamp((int)((std::min(h0, h1) - envelope.min_height) / envelope.bin_size), 0, last);
+            int b1 = glm::clamp((int)((std::max(h0, h1) - envelope.min_height) / envelope.bin_size), 0, last);
+            for(int bin = b0; bin <= b1; bin++){
+                double height = envelope.min_height + (bin + 0.5) * envelope.bin_size;
+                double range = std::max(r0, r1);
+                if(h1 != h0 && b0 != b1){
+                    double s = glm::clamp((height - h0) / (h1 - h0), 0.0, 1.0);
+                    range = r0 + (r1 - r0) * s;
+                }
+                envelope.max_range[bin] = std::max(envelope.max_range[bin], range);
+            }
+        }
+
+        static std::mutex& cacheMutex(){
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static std::map<EnvelopeKey, std::shared_ptr<const Envelope>>& cache(){
+            static std::map<EnvelopeKey, std::shared_ptr<const Envelope>> cache;
+            return cache;
+        }
+};
+
+double Reachability::MARGIN = 0.02;
+int Reachability::SWEEP_ANGLES = 181;
+int Reachability::HEIGHT_BINS = 1024;
+double Reachability::DEPTH_FACTOR = 4.0;
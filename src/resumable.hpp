@@ -0,0 +1,743 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "instrumentation.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//The find_angle strategies as state machines: next() proposes the angle of the next shot and accept()
+//takes its result. resume() flies at most a budget of integration steps or microseconds per call, so a
+//caller with a frame to draw can solve a little every frame on its own thread, the K-ary angles of an
+//iteration one after the other. run() flies the whole solve at once, the K-ary iterations concurrently
+//on the shared thread pool, and is what Simulation::find_angle calls. Both end with the same
+//StrategyResult. A strategy cache hit or a target outside the reachability envelope answers the solve
+//before its first shot; the envelope is cached, only the first solve with new parameters pays for its
+//sweep. The result callback sees every shot as it finishes, with result() holding the best so far.
+class ResumableSolve {
+    public:
+        typedef std::function<void(const Simulation::ShotResult& result, const double& angle)> ResultCallback;
+        typedef std::function<void(const Position& position, const double& time)> StepCallback;
+
+        //whichever runs out first, a shot in flight is carried over to the next resume()
+        struct Budget{
+            uint64_t steps = std::numeric_limits<uint64_t>::max();
+            double microseconds = std::numeric_limits<double>::infinity();
+        };
+
+        //steps between clock reads when there is a time budget
+        static uint64_t CLOCK_INTERVAL;
+
+        //copies the simulation, later changes to it do not affect the solve; throws std::invalid_argument
+        //for a value that is not one of the four strategies
+        ResumableSolve(const Simulation& simulation, Simulation::Strategy strategy, ResultCallback callback = nullptr, StepCallback callback2 = nullptr) :
+            simulation(simulation), strategy(strategy), callback(callback), callback2(callback2){
+            if(strategy != Simulation::BISECTION && strategy != Simulation::THREE_POINT && strategy != Simulation::MULTI_RESOLUTION && strategy != Simulation::K_ARY){
+                throw std::invalid_argument("Unknown strategy " + std::to_string((int)strategy));
+            }
+            glm::dvec3 direction = glm::normalize(this->simulation.getTargetPosition() - this->simulation.getShooterPosition());
+            initial_max_angle = glm::degrees(glm::acos(glm::dot(direction, Simulation::UP_VECTOR)));
+            fine_delta_time = this->simulation.getDeltaTime();
+            min_angle = initial_min_angle;
+            max_angle = initial_max_angle;
+            if(strategy == Simulation::MULTI_RESOLUTION){
+                while(level < Simulation::getMultiresLevels() && fine_delta_time * (1 << (level + 1)) <= Simulation::getMultiresMaxDeltaTime()){
+                    level++;
+                }
+            }
+            if(strategy == Simulation::K_ARY){
+                width = std::max(1, Simulation::getKaryWidth());
+                angles.resize(width);
+                results.resize(width);
+            }
+        }
+
+        ResumableSolve(const ResumableSolve&) = delete;
+        ResumableSolve& operator=(const ResumableSolve&) = delete;
+
+        //true once the solve has finished, then result() is final
+        bool resume(const Budget& budget){
+            if(finished){
+                return true;
+            }
+            Trace::Scope trace("resume", "solver");
+            slice_start = Clock::now();
+            if(!started && !prepare()){
+                return true;
+            }
+            uint64_t used = 0;
+            auto outOfTime = [&](){
+                return std::chrono::duration<double, std::micro>(Clock::now() - slice_start).count() >= budget.microseconds;
+            };
+            uint64_t slice = std::isinf(budget.microseconds) ? std::numeric_limits<uint64_t>::max() : std::max<uint64_t>(1, CLOCK_INTERVAL);
+
+            while(!finished){
+                if(!in_flight){
+                    double angle;
+                    if(!next(angle)){
+                        break;
+                    }
+                    shots++;
+                    //multires flies the coarse levels on a longer step
+                    simulation.setDeltaTime(shotDeltaTime());
+                    simulation.beginShot(shot, angle, !callback2);
+                    simulation.setDeltaTime(fine_delta_time);
+                    in_flight = true;
+                }
+                if(used >= budget.steps){
+                    break;
+                }
+                uint64_t before = shot.steps;
+                bool landed = simulation.advanceShot(shot, std::min(budget.steps - used, slice), callback2);
+                used += shot.steps - before;
+                if(landed){
+                    in_flight = false;
+                    accept(shot.angle, shot.result);
+                }
+                if(!finished && outOfTime()){
+                    break;
+                }
+            }
+            steps += used;
+            ns += Instrumentation::elapsedNs(slice_start);
+            trace.arg("steps", (int64_t)used);
+            return finished;
+        }
+
+        //Flies the rest of the solve on the calling thread, its shots through Simulation::simulateShot()
+        //which getSteps() does not count
+        const Simulation::StrategyResult& run(){
+            if(finished){
+                return best_result;
+            }
+            slice_start = Clock::now();
+            if(!started && !prepare()){
+                return best_result;
+            }
+            if(in_flight){
+                simulation.advanceShot(shot, std::numeric_limits<uint64_t>::max(), callback2);
+                in_flight = false;
+                accept(shot.angle, shot.result);
+            }
+            double angle;
+            while(!finished && next(angle)){
+                if(strategy == Simulation::K_ARY && index == 0){
+                    shootIteration();
+                    continue;
+                }
+                shots++;
+                simulation.setDeltaTime(shotDeltaTime());
+                Simulation::ShotResult result = simulation.simulateShot(angle, callback2);
+                simulation.setDeltaTime(fine_delta_time);
+                accept(angle, result);
+            }
+            ns += Instrumentation::elapsedNs(slice_start);
+            return best_result;
+        }
+
+        //run() as part of the solve of scope, which counts its shots; the strategy cache, the precheck and
+        //the record of the solve are left to the caller
+        const Simulation::StrategyResult& runWithin(Instrumentation::SolveScope& scope){
+            nested = true;
+            run();
+            scope.shot(shots);
+            return best_result;
+        }
+
+        bool done() const{
+            return finished;
+        }
+
+        //best so far while running
+        const Simulation::StrategyResult& result() const{
+            return best_result;
+        }
+
+        Simulation::Strategy getStrategy() const{
+            return strategy;
+        }
+
+        uint64_t getSteps() const{
+            return steps;
+        }
+
+        uint32_t getShots() const{
+            return shots;
+        }
+
+        //current bracket, it only shrinks between levels of the multires strategy
+        double bracket() const{
+            return max_angle - min_angle;
+        }
+
+    private:
+        typedef Instrumentation::Clock Clock;
+
+        //multires control flow between shots
+        enum Phase{
+            LEVEL_START,
+            CHECK_MIN,
+            CHECK_MAX,
+            ITERATE_START,
+            ITERATE,
+            LEVEL_END
+        };
+
+        //strategy cache and reachability precheck ahead of the first shot, false when they answer the solve
+        bool prepare(){
+            started = true;
+            if(nested){
+                return true;
+            }
+            if(!callback && !callback2 && simulation.findStrategy(kind(), best_result)){
+                finished = true;
+                return false;
+            }
+            Reachability::Verdict verdict = simulation.precheckTarget(name());
+            marginal = verdict == Reachability::MARGINAL;
+            if(verdict == Reachability::UNREACHABLE){
+                best_result = simulation.unreachableResult();
+                finished = true;
+                store();
+                return false;
+            }
+            solve_span.emplace(name(), "solver");
+            return true;
+        }
+
+        //the angle of the next shot, false when the strategy is done without one
+        bool next(double& angle){
+            switch(strategy){
+                case Simulation::BISECTION: return nextBisection(angle);
+                case Simulation::THREE_POINT: return nextThreePoint(angle);
+                case Simulation::MULTI_RESOLUTION: return nextMultires(angle);
+                case Simulation::K_ARY: return nextKary(angle);
+            }
+            return false;
+        }
+
+        void accept(double angle, const Simulation::ShotResult& result){
+            switch(strategy){
+                case Simulation::BISECTION: acceptBisection(angle, result); break;
+                case Simulation::THREE_POINT: acceptThreePoint(angle, result); break;
+                case Simulation::MULTI_RESOLUTION: acceptMultires(angle, result); break;
+                case Simulation::K_ARY: acceptKary(result); break;
+            }
+        }
+
+        //the angles of a K-ary iteration shot concurrently, the calling thread takes the first one itself
+        void shootIteration(){
+            std::mutex callback_mutex;
+            StepCallback step_callback = nullptr;
+            if(callback2){
+                step_callback = [&](const Position& position, const double& time){
+                    std::lock_guard<std::mutex> lock(callback_mutex);
+                    callback2(position, time);
+                };
+            }
+            ThreadPool& pool = ThreadPool::shared();
+            std::vector<std::future<Simulation::ShotResult>> futures(width);
+            for(int i = 1; i < width; i++){
+                double angle = angles[i];
+                futures[i] = pool.submit([this, angle, &step_callback](){
+                    return simulation.simulateShot(angle, step_callback);
+                });
+            }
+            std::vector<Simulation::ShotResult> flown(width);
+            flown[0] = simulation.simulateShot(angles[0], step_callback);
+            for(int i = 1; i < width; i++){
+                flown[i] = pool.wait(futures[i]);
+            }
+            shots += width;
+            for(int i = 0; i < width; i++){
+                acceptKary(flown[i]);
+            }
+        }
+
+        //one span per try, closed when the next one starts or the solve finishes
+        void beginIteration(){
+            iteration_span.reset();
+            iteration_span.emplace("iteration", "solver");
+        }
+
+        void finish(Instrumentation::Termination termination){
+            finished = true;
+            best_result.marginal = marginal;
+            iteration_span.reset();
+            level_span.reset();
+            if constexpr (Instrumentation::ENABLED){
+                if(!nested){
+                    Instrumentation::recordSolve(name(), shots, ns + Instrumentation::elapsedNs(slice_start), termination);
+                    solve_span->arg("shots", (int64_t)shots);
+                }
+            }
+            solve_span.reset();
+            store();
+        }
+
+        void store(){
+            if(!nested && !callback && !callback2){
+                simulation.storeStrategy(kind(), best_result);
+            }
+        }
+
+        double shotDeltaTime() const{
+            return strategy == Simulation::MULTI_RESOLUTION ? fine_delta_time * (1 << level) : fine_delta_time;
+        }
+
+        const char* name() const{
+            switch(strategy){
+                case Simulation::BISECTION: return "strategy1";
+                case Simulation::THREE_POINT: return "strategy2";
+                case Simulation::MULTI_RESOLUTION: return "multires";
+                case Simulation::K_ARY: return "kary";
+            }
+            return "";
+        }
+
+        Simulation::ShotCache::Kind kind() const{
+            switch(strategy){
+                case Simulation::BISECTION: return Simulation::ShotCache::STRATEGY_1;
+                case Simulation::THREE_POINT: return Simulation::ShotCache::STRATEGY_2;
+                case Simulation::MULTI_RESOLUTION: return Simulation::ShotCache::STRATEGY_MULTIRES;
+                case Simulation::K_ARY: return Simulation::ShotCache::STRATEGY_KARY;
+            }
+            return Simulation::ShotCache::SHOT;
+        }
+
+        //negative below the target, positive above it
+        static double signedMiss(const Simulation::ShotResult& result){
+            return result.result == Simulation::ShotResultEnum::TOO_HIGH ? result.distance : -result.distance;
+        }
+
+        //strategy 1: bisection from flat to the straight line at the target, good for air density 0
+        bool nextBisection(double& angle){
+            if(tries >= Simulation::getMaxTries()){
+                finish(Instrumentation::MAX_TRIES);
+                return false;
+            }
+            tries++;
+            beginIteration();
+            angle = current;
+            return true;
+        }
+
+        void acceptBisection(double angle, const Simulation::ShotResult& result){
+            if(callback){
+                callback(result, angle);
+            }
+            if(best_result.best_result.distance > result.distance){
+                best_result = {result, angle, tries};
+            }
+            if(result.result == Simulation::ShotResultEnum::HIT){
+                finish(Instrumentation::HIT);
+                return;
+            }
+            if(result.result == Simulation::ShotResultEnum::TOO_HIGH){
+                max_angle = angle;
+            }
+            if(Simulation::isShort(result.result)){
+                min_angle = angle;
+                if(Simulation::isShort(best_result.best_result.result) && best_result.best_result.distance < result.distance && best_result.best_angle < angle){
+                    best_result.best_result.result = Simulation::ShotResultEnum::NO_IN_RANGE;
+                    finish(Instrumentation::NO_IN_RANGE);
+                    return;
+                }
+            }
+            if(max_angle - min_angle < 0.000000001){
+                finish(Instrumentation::BRACKET_COLLAPSE);
+                return;
+            }
+            current = (min_angle + max_angle) / 2.0;
+        }
+
+        //strategy 2: both ends, the middle, then a pair around the middle per try
+        bool nextThreePoint(double& angle){
+            switch(stage){
+                case 0: angle = max_angle; return true;
+                case 1: angle = min_angle; return true;
+                case 2: angle = current = (max_angle - min_angle) / 2.0; return true;
+                case 3:
+                    if(tries >= Simulation::getMaxTries()){
+                        finish(Instrumentation::MAX_TRIES);
+                        return false;
+                    }
+                    tries++;
+                    beginIteration();
+                    angle = (max_angle + current) / 2.0;
+                    return true;
+                default: angle = (min_angle + current) / 2.0; return true;
+            }
+        }
+
+        void acceptThreePoint(double angle, const Simulation::ShotResult& result){
+            if(stage < 3){
+                if(stage == 2 && callback){
+                    callback(result, angle);
+                }
+                if(result.result == Simulation::ShotResultEnum::HIT){
+                    best_result = {result, angle, 1};
+                    finish(Instrumentation::HIT);
+                    return;
+                }
+                (stage == 0 ? result_max : stage == 1 ? result_min : result_mid) = result;
+                if(++stage == 3){
+                    tries = 1;
+                }
+                return;
+            }
+            if(result.result == Simulation::ShotResultEnum::HIT){
+                best_result = {result, angle, tries};
+                finish(Instrumentation::HIT);
+                return;
+            }
+            if(stage == 3){
+                result_max_mid = result;
+                stage = 4;
+                return;
+            }
+            const Simulation::ShotResult& result_min_mid = result;
+            double angle_max_mid = (max_angle + current) / 2.0;
+            double angle_min_mid = angle;
+            stage = 3;
+
+            if(result_max_mid.distance < result_mid.distance){
+                result_min = result_mid;
+                result_mid = result_max_mid;
+                min_angle = current;
+            } else if(result_min_mid.distance < result_mid.distance){
+                result_max = result_mid;
+                result_mid = result_min_mid;
+                max_angle = current;
+            } else {
+                result_min = result_min_mid;
+                result_max = result_max_mid;
+                min_angle = angle_min_mid;
+                max_angle = angle_max_mid;
+            }
+
+            if(callback){
+                callback(result_mid, current);
+            }
+            if(best_result.best_result.distance > result_mid.distance){
+                best_result = {result_mid, current, tries};
+            }
+            if(max_angle - min_angle < 0.000000001){
+                finish(Instrumentation::BRACKET_COLLAPSE);
+                return;
+            }
+            current = (max_angle + min_angle) / 2.0;
+        }
+
+        //Strategy 1 generalised to KARY_WIDTH evenly spread angles per iteration. The bracket shrinks to the
+        //sub-interval in front of the first TOO_HIGH angle, so each iteration divides it by KARY_WIDTH + 1.
+        //Callbacks are still called from one thread at a time.
+        bool nextKary(double& angle){
+            if(index == 0){
+                if(tries >= Simulation::getMaxTries()){
+                    finish(Instrumentation::MAX_TRIES);
+                    return false;
+                }
+                tries++;
+                beginIteration();
+                for(int i = 0; i < width; i++){
+                    angles[i] = min_angle + (max_angle - min_angle) * (i + 1) / (width + 1);
+                }
+            }
+            angle = angles[index];
+            return true;
+        }
+
+        void acceptKary(const Simulation::ShotResult& result){
+            results[index++] = result;
+            if(index < width){
+                return;
+            }
+            index = 0;
+
+            int first_high = width;
+            for(int i = 0; i < width; i++){
+                if(callback){
+                    callback(results[i], angles[i]);
+                }
+                if(best_result.best_result.distance > results[i].distance){
+                    best_result = {results[i], angles[i], tries};
+                }
+                if(results[i].result == Simulation::ShotResultEnum::TOO_HIGH && first_high == width){
+                    first_high = i;
+                }
+            }
+            for(int i = 0; i < width; i++){
+                if(results[i].result == Simulation::ShotResultEnum::HIT){
+                    best_result = {results[i], angles[i], tries};
+                    finish(Instrumentation::HIT);
+                    return;
+                }
+            }
+            for(int i = 0; i < first_high; i++){
+                if(!Simulation::isShort(results[i].result)){
+                    continue;
+                }
+                if(low_distance < results[i].distance && low_angle < angles[i]){
+                    best_result.best_result.result = Simulation::ShotResultEnum::NO_IN_RANGE;
+                    finish(Instrumentation::NO_IN_RANGE);
+                    return;
+                }
+                low_distance = results[i].distance;
+                low_angle = angles[i];
+            }
+            if(first_high < width){
+                max_angle = angles[first_high];
+            }
+            if(first_high > 0){
+                min_angle = angles[first_high - 1];
+            }
+            if(max_angle - min_angle < 0.000000001){
+                finish(Instrumentation::BRACKET_COLLAPSE);
+            }
+        }
+
+        //Solves on time steps of delta_time * 2^level, from the coarsest level allowed by MULTIRES_MAX_DELTA_TIME
+        //down to delta_time. Each level narrows the bracket with false position on the signed miss distance
+        //(bisection until both ends are known). When the step is halved the next bracket is centred on the
+        //last estimate, twice as wide as the estimate moved between levels, and both ends are re-shot; an end
+        //that no longer classifies the same way on the finer step is pushed outwards until it does.
+        //Only full resolution shots can become the result. The loops of each level are unrolled into phases.
+        bool nextMultires(double& angle){
+            const double nan = std::numeric_limits<double>::quiet_NaN();
+            while(true){
+                switch(phase){
+                    case LEVEL_START:
+                        if(level < 0){
+                            finish(Instrumentation::MAX_TRIES);
+                            return false;
+                        }
+                        level_span.emplace("level", "solver");
+                        level_span->arg("level", level);
+                        min_miss = max_miss = nan;
+                        if(std::isnan(estimate)){
+                            phase = ITERATE_START;
+                            break;
+                        }
+                        check_width = std::isnan(previous_estimate) ? (max_angle - min_angle) : 2.0 * std::abs(estimate - previous_estimate);
+                        check_width = std::max(check_width, 0.000001);
+                        min_angle = std::max(initial_min_angle, estimate - check_width);
+                        max_angle = std::min(initial_max_angle, estimate + check_width);
+                        phase = CHECK_MIN;
+                        break;
+                    case CHECK_MIN:
+                        if(tries < Simulation::getMaxTries()){
+                            tries++;
+                            angle = min_angle;
+                            return true;
+                        }
+                        phase = CHECK_MAX;
+                        break;
+                    case CHECK_MAX:
+                        if(std::isnan(max_miss) && tries < Simulation::getMaxTries()){
+                            tries++;
+                            angle = max_angle;
+                            return true;
+                        }
+                        phase = ITERATE_START;
+                        break;
+                    case ITERATE_START:
+                        low_angle = 0.0;
+                        low_distance = std::numeric_limits<double>::max();
+                        last_side = 0;
+                        iterations = 0;
+                        phase = ITERATE;
+                        break;
+                    case ITERATE:
+                        if(tries < Simulation::getMaxTries() && (level == 0 || iterations < Simulation::getMultiresIterations())){
+                            iterations++;
+                            beginIteration();
+                            angle = (min_angle + max_angle) / 2.0;
+                            if(!std::isnan(min_miss) && !std::isnan(max_miss)){
+                                angle = (min_angle * max_miss - max_angle * min_miss) / (max_miss - min_miss);
+                                if(!(angle > min_angle && angle < max_angle)){
+                                    angle = (min_angle + max_angle) / 2.0;
+                                }
+                            }
+                            tries++;
+                            return true;
+                        }
+                        phase = LEVEL_END;
+                        break;
+                    case LEVEL_END:
+                        iteration_span.reset();
+                        level_span.reset();
+                        previous_estimate = estimate;
+                        if(!std::isnan(min_miss) && !std::isnan(max_miss) && max_miss != min_miss){
+                            estimate = (min_angle * max_miss - max_angle * min_miss) / (max_miss - min_miss);
+                        } else {
+                            estimate = (min_angle + max_angle) / 2.0;
+                        }
+                        if(tries >= Simulation::getMaxTries()){
+                            finish(Instrumentation::MAX_TRIES);
+                            return false;
+                        }
+                        level--;
+                        phase = LEVEL_START;
+                        break;
+                }
+            }
+        }
+
+        void acceptMultires(double angle, const Simulation::ShotResult& result){
+            const double nan = std::numeric_limits<double>::quiet_NaN();
+            if(callback){
+                callback(result, angle);
+            }
+            if(level == 0 && best_result.best_result.distance > result.distance){
+                best_result = {result, angle, tries};
+            }
+            bool hit = result.result == Simulation::ShotResultEnum::HIT;
+            bool high = result.result == Simulation::ShotResultEnum::TOO_HIGH;
+
+            if(phase == CHECK_MIN || phase == CHECK_MAX){
+                if(hit && level == 0){
+                    finish(Instrumentation::HIT);
+                    return;
+                }
+                if(phase == CHECK_MIN){
+                    if(!high || min_angle <= initial_min_angle){
+                        min_miss = high ? nan : signedMiss(result);
+                        phase = CHECK_MAX;
+                        return;
+                    }
+                    max_angle = min_angle;
+                    max_miss = signedMiss(result);
+                    check_width *= 4.0;
+                    min_angle = std::max(initial_min_angle, estimate - check_width);
+                } else {
+                    if(high || max_angle >= initial_max_angle){
+                        max_miss = high ? signedMiss(result) : nan;
+                        phase = ITERATE_START;
+                        return;
+                    }
+                    min_angle = max_angle;
+                    min_miss = signedMiss(result);
+                    check_width *= 4.0;
+                    max_angle = std::min(initial_max_angle, estimate + check_width);
+                }
+                return;
+            }
+
+            if(hit){
+                if(level == 0){
+                    finish(Instrumentation::HIT);
+                    return;
+                }
+                min_angle = max_angle = angle;
+                phase = LEVEL_END;
+                return;
+            }
+            if(high){
+                max_angle = angle;
+                max_miss = signedMiss(result);
+                if(last_side == 1 && !std::isnan(min_miss)){
+                    min_miss /= 2.0;
+                }
+                last_side = 1;
+            } else {
+                if(level == 0 && low_distance < result.distance && low_angle < angle){
+                    best_result.best_result.result = Simulation::ShotResultEnum::NO_IN_RANGE;
+                    finish(Instrumentation::NO_IN_RANGE);
+                    return;
+                }
+                if(result.distance < low_distance){
+                    low_distance = result.distance;
+                    low_angle = angle;
+                }
+                min_angle = angle;
+                min_miss = signedMiss(result);
+                if(last_side == -1 && !std::isnan(max_miss)){
+                    max_miss /= 2.0;
+                }
+                last_side = -1;
+            }
+            if(max_angle - min_angle < 0.000000001){
+                if(level == 0){
+                    finish(Instrumentation::BRACKET_COLLAPSE);
+                    return;
+                }
+                phase = LEVEL_END;
+            }
+        }
+
+        Simulation simulation;
+        Simulation::Strategy strategy;
+        ResultCallback callback;
+        StepCallback callback2;
+
+        Simulation::PendingShot shot;
+        bool started = false;
+        bool nested = false;
+        bool in_flight = false;
+        bool finished = false;
+        bool marginal = false;
+        uint64_t steps = 0;
+        uint32_t shots = 0;
+        uint64_t ns = 0;
+        Clock::time_point slice_start;
+        std::optional<Trace::Scope> solve_span;
+        std::optional<Trace::Scope> level_span;
+        std::optional<Trace::Scope> iteration_span;
+
+        Simulation::StrategyResult best_result = {{Simulation::ShotResultEnum::NO_TIME, std::numeric_limits<double>::max(), 0.0}, 0.0, 0};
+        uint32_t tries = 0;
+        double initial_min_angle = 0.0;
+        double initial_max_angle = 0.0;
+        double min_angle = 0.0;
+        double max_angle = 0.0;
+        double current = 0.0; //bisection angle, three point middle
+
+        //three point
+        int stage = 0;
+        Simulation::ShotResult result_min, result_max, result_mid, result_max_mid;
+
+        //k-ary
+        int width = 1;
+        int index = 0;
+        std::vector<double> angles;
+        std::vector<Simulation::ShotResult> results;
+        double low_angle = 0.0;
+        double low_distance = std::numeric_limits<double>::max();
+
+        //multires
+        Phase phase = LEVEL_START;
+        int level = 0;
+        double fine_delta_time = 0.0;
+        double check_width = 0.0;
+        double min_miss = std::numeric_limits<double>::quiet_NaN();
+        double max_miss = std::numeric_limits<double>::quiet_NaN();
+        double estimate = std::numeric_limits<double>::quiet_NaN();
+        double previous_estimate = std::numeric_limits<double>::quiet_NaN();
+        int last_side = 0;
+        int iterations = 0;
+};
+
+uint64_t ResumableSolve::CLOCK_INTERVAL = 64;
+
+Simulation::StrategyResult Simulation::find_angle(Strategy strategy, std::function<void(const ShotResult& result, const double& angle)> callback,
+                                                  std::function<void(const Position& position, const double& time)> callback2){
+    return ResumableSolve(*this, strategy, callback, callback2).run();
+}
+
+Simulation::StrategyResult Simulation::find_angle_within(Strategy strategy, Instrumentation::SolveScope& scope,
+                                                         std::function<void(const ShotResult& result, const double& angle)> callback,
+                                                         std::function<void(const Position& position, const double& time)> callback2){
+    return ResumableSolve(*this, strategy, callback, callback2).runWithin(scope);
+}
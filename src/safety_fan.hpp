@@ -0,0 +1,178 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "thread_pool.hpp"
+#include "trajectory.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <vector>
+
+//Outer envelope of every trajectory over a range of elevations and azimuths ("safety fan").
+//Each azimuth starts from a uniform elevation sweep; wherever two neighbouring trajectories are
+//further apart than the tolerance a shot is added half way between them, until the fan is dense
+//enough or the ray budget is spent. Every round of new shots is flown in parallel.
+class SafetyFan {
+    public:
+        struct Settings{
+            //simulateShot angles, 0 points at the target
+            double min_angle = 0.0;
+            double max_angle = 90.0;
+            //total azimuth width centred on the target direction, in degrees
+            double azimuth_span = 0.0;
+            int azimuths = 1;
+            int initial_rays = 16;
+            int max_rays = 512; //per azimuth
+            //largest allowed gap between neighbouring trajectories, in meters
+            double tolerance = 1.0;
+            double min_angle_step = 0.001;
+            //impact plane relative to the shooter, along UP_VECTOR
+            double ground_offset = 0.0;
+            //width of the range bins of the height profile
+            double range_bin = 1.0;
+        };
+
+        struct Ray{
+            double angle;
+            double azimuth;
+            Simulation::Flight flight;
+            Trajectory trajectory;
+        };
+
+        struct Result{
+            std::vector<Ray> rays; //by azimuth, then by angle
+            double max_height = 0.0; //above the shooter
+            double max_range = 0.0; //horizontal, from the shooter
+            //outer profile in the vertical plane: x is the horizontal range, y the highest point at that range
+            std::vector<glm::dvec2> profile;
+            //every impact point, and the farthest impact of each azimuth in azimuth order
+            std::vector<glm::dvec3> footprint;
+            std::vector<glm::dvec3> outline;
+        };
+
+        static Result compute(Simulation& simulation, const Settings& settings, ThreadPool& pool = ThreadPool::shared()){
+            Result result;
+            const glm::dvec3& shooter = simulation.getShooterPosition();
+            double ground_height = glm::dot(shooter, Simulation::UP_VECTOR) + settings.ground_offset;
+
+            int azimuths = std::max(1, settings.azimuths);
+            for(int a = 0; a < azimuths; a++){
+                double azimuth = azimuths > 1 ? -0.5 * settings.azimuth_span + settings.azimuth_span * a / (azimuths - 1) : 0.0;
+                std::vector<Ray> rays = sweep(simulation, settings, azimuth, ground_height, pool);
+                for(Ray& ray : rays){
+                    result.rays.push_back(std::move(ray));
+                }
+            }
+            summarize(result, shooter, settings);
+            return result;
+        }
+
+    private:
+        static std::vector<Ray> sweep(Simulation& simulation, const Settings& settings, double azimuth, double ground_height, ThreadPool& pool){
+            int initial = std::max(2, settings.initial_rays);
+            std::vector<double> angles;
+            for(int i = 0; i < initial; i++){
+                angles.push_back(settings.min_angle + (settings.max_angle - settings.min_angle) * i / (initial - 1));
+            }
+
+            std::vector<Ray> rays;
+            while(!angles.empty()){
+                std::vector<Ray> added = fly(simulation, angles, azimuth, ground_height, pool);
+                for(Ray& ray : added){
+                    rays.push_back(std::move(ray));
+                }
+                std::sort(rays.begin(), rays.end(), [](const Ray& a, const Ray& b){
+                    return a.angle < b.angle;
+                });
+
+                angles.clear();
+                for(size_t i = 0; i + 1 < rays.size() && (int)(rays.size() + angles.size()) < settings.max_rays; i++){
+                    const Ray& a = rays[i];
+                    const Ray& b = rays[i + 1];
+                    if(b.angle - a.angle > 2.0 * settings.min_angle_step && gap(a, b) > settings.tolerance){
+                        angles.push_back(0.5 * (a.angle + b.angle));
+                    }
+                }
+            }
+            return rays;
+        }
+
+        static std::vector<Ray> fly(Simulation& simulation, const std::vector<double>& angles, double azimuth, double ground_height, ThreadPool& pool){
+            std::vector<std::future<Ray>> futures;
+            for(double angle : angles){
+                futures.push_back(pool.submit([&simulation, angle, azimuth, ground_height](){
+                    Ray ray = {angle, azimuth, {}, Trajectory()};
+                    ray.flight = simulation.simulateFlight(angle, azimuth, ground_height, &ray.trajectory);
+                    return ray;
+                }));
+            }
+            std::vector<Ray> rays;
+            for(auto& future : futures){
+                rays.push_back(pool.wait(future));
+            }
+            return rays;
+        }
+
+        //largest distance between two trajectories compared at the same fraction of their flight
+        static double gap(const Ray& a, const Ray& b){
+            const int samples = 16;
+            double result = 0.0;
+            for(int i = 0; i <= samples; i++){
+                double s = (double)i / samples;
+                glm::dvec3 pa = a.trajectory.position(a.trajectory.startTime() + s * (a.trajectory.endTime() - a.trajectory.startTime()));
+                glm::dvec3 pb = b.trajectory.position(b.trajectory.startTime() + s * (b.trajectory.endTime() - b.trajectory.startTime()));
+                result = std::max(result, glm::length(pa - pb));
+            }
+            return result;
+        }
+
+        static void summarize(Result& result, const glm::dvec3& shooter, const Settings& settings){
+            const glm::dvec3& up = Simulation::UP_VECTOR;
+            double bin = settings.range_bin > 0.0 ? settings.range_bin : 1.0;
+            std::vector<double> heights;
+
+            auto horizontal = [&](const glm::dvec3& point){
+                glm::dvec3 offset = point - shooter;
+                return glm::length(offset - glm::dot(offset, up) * up);
+            };
+
+            double best_range = -1.0;
+            double current_azimuth = std::numeric_limits<double>::quiet_NaN();
+            for(const Ray& ray : result.rays){
+                if(ray.azimuth != current_azimuth){
+                    current_azimuth = ray.azimuth;
+                    best_range = -1.0;
+                    result.outline.push_back(ray.flight.impact);
+                }
+
+                for(const glm::dvec3& point : ray.trajectory.sampleByArcLength(0.5 * bin)){
+                    double range = horizontal(point);
+                    double height = glm::dot(point - shooter, up);
+                    size_t index = (size_t)(range / bin);
+                    if(index >= heights.size()){
+                        heights.resize(index + 1, -std::numeric_limits<double>::infinity());
+                    }
+                    heights[index] = std::max(heights[index], height);
+                    result.max_height = std::max(result.max_height, height);
+                    result.max_range = std::max(result.max_range, range);
+                }
+
+                if(ray.flight.landed){
+                    result.footprint.push_back(ray.flight.impact);
+                    double range = horizontal(ray.flight.impact);
+                    if(range > best_range){
+                        best_range = range;
+                        result.outline.back() = ray.flight.impact;
+                    }
+                }
+            }
+
+            for(size_t i = 0; i < heights.size(); i++){
+                if(std::isfinite(heights[i])){
+                    result.profile.push_back(glm::dvec2((i + 0.5) * bin, heights[i]));
+                }
+            }
+        }
+};
@@ -0,0 +1,744 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "batch.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//Long running solver behind a Unix domain socket, one JSON object per line each way.
+//Request:  {"id":1,"shooter":[0,0,0],"target":[100,0,0],"speed":100,"mass":1,"dt":0.01,"strategy":2}
+//Response: {"id":1,"result":"HIT","angle":..,"distance":..,"time":..,"tries":..,"marginal":false}
+//{"stats":true} answers with the service counters instead. Requests from all connections that
+//arrive within BATCH_WINDOW_MS of the first waiting one are solved together on the thread pool.
+//Sockets are non-blocking: answers wait in a per-connection buffer the I/O thread flushes on POLLOUT,
+//a connection whose unsent answers pass MAX_OUTPUT or whose line passes MAX_LINE is closed.
+class Service {
+    public:
+        static double BATCH_WINDOW_MS;
+        static size_t MAX_BATCH;
+        //latencies kept for the quantiles
+        static size_t LATENCY_WINDOW;
+        //bytes of a request line and of unsent answers per connection
+        static size_t MAX_LINE;
+        static size_t MAX_OUTPUT;
+
+        typedef std::chrono::steady_clock Clock;
+
+        //flat JSON object of numbers, number arrays, booleans and strings
+        struct Message{
+            std::map<std::string, std::vector<double>> numbers;
+            std::map<std::string, std::string> strings;
+
+            bool has(const std::string& key) const{
+                return numbers.count(key) > 0;
+            }
+            double number(const std::string& key, double fallback = 0.0) const{
+                auto it = numbers.find(key);
+                return it != numbers.end() && it->second.size() == 1 ? it->second[0] : fallback;
+            }
+            bool vector(const std::string& key, glm::dvec3& value) const{
+                auto it = numbers.find(key);
+                if(it == numbers.end() || it->second.size() != 3){
+                    return false;
+                }
+                value = glm::dvec3(it->second[0], it->second[1], it->second[2]);
+                return true;
+            }
+        };
+
+        struct Stats{
+            uint64_t requests = 0;
+            uint64_t batches = 0;
+            uint64_t errors = 0;
+            uint64_t connections = 0;
+            double mean_batch = 0.0;
+            double p50_ms = 0.0;
+            double p99_ms = 0.0;
+            double throughput = 0.0; //requests per second since start
+        };
+
+        Service(const std::string& socket_path, unsigned threads = 1, Simulation::ShotCache* cache = nullptr, const Terrain* terrain = nullptr) :
+            socket_path(socket_path), cache(cache), terrain(terrain), pool(std::max(1u, threads)) {}
+
+        ~Service(){
+            stop();
+        }
+
+        Service(const Service&) = delete;
+        Service& operator=(const Service&) = delete;
+
+        //binds the socket and starts the I/O and dispatch threads, throws when the socket cannot be opened
+        void start(){
+            sockaddr_un address = socketAddress(socket_path);
+            listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if(listen_fd < 0){
+                throw std::runtime_error(std::string("Cannot create socket: ") + std::strerror(errno));
+            }
+            ::unlink(socket_path.c_str());
+            if(::bind(listen_fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listen_fd, 64) != 0){
+                std::string error = std::strerror(errno);
+                ::close(listen_fd);
+                listen_fd = -1;
+                throw std::runtime_error("Cannot listen on " + socket_path + ": " + error);
+            }
+            if(::pipe(wake_pipe) != 0){
+                std::string error = std::strerror(errno);
+                ::close(listen_fd);
+                ::unlink(socket_path.c_str());
+                listen_fd = -1;
+                throw std::runtime_error("Cannot create pipe: " + error);
+            }
+            setNonBlocking(wake_pipe[0]);
+            setNonBlocking(wake_pipe[1]);
+            started = Clock::now();
+            stopping = false;
+            io_thread = std::thread([this](){ ioLoop(); });
+            dispatch_thread = std::thread([this](){ dispatchLoop(); });
+        }
+
+        void stop(){
+            if(listen_fd < 0){
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                stopping = true;
+            }
+            queue_condition.notify_all();
+            char byte = 0;
+            (void)!::write(wake_pipe[1], &byte, 1);
+            io_thread.join();
+            dispatch_thread.join();
+            ::close(wake_pipe[0]);
+            ::close(wake_pipe[1]);
+            ::close(listen_fd);
+            ::unlink(socket_path.c_str());
+            listen_fd = -1;
+        }
+
+        Stats stats(){
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            Stats result = counters;
+            result.mean_batch = counters.batches > 0 ? (double)counters.requests / counters.batches : 0.0;
+            std::vector<double> sorted = latencies;
+            result.p50_ms = quantile(sorted, 0.5);
+            result.p99_ms = quantile(sorted, 0.99);
+            double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+            result.throughput = seconds > 0.0 ? counters.requests / seconds : 0.0;
+            return result;
+        }
+
+        static std::string statsJson(const Stats& stats){
+            char line[512];
+            std::snprintf(line, sizeof(line), "{\"requests\":%llu,\"batches\":%llu,\"errors\":%llu,\"connections\":%llu,"
+                "\"mean_batch\":%.3f,\"p50_ms\":%.6f,\"p99_ms\":%.6f,\"throughput\":%.3f}",
+                (unsigned long long)stats.requests, (unsigned long long)stats.batches, (unsigned long long)stats.errors,
+                (unsigned long long)stats.connections, stats.mean_batch, stats.p50_ms, stats.p99_ms, stats.throughput);
+            return line;
+        }
+
+        static std::string requestJson(uint64_t id, const Batch::Scenario& scenario){
+            char line[512];
+            std::snprintf(line, sizeof(line), "{\"id\":%llu,\"shooter\":[%.17g,%.17g,%.17g],\"target\":[%.17g,%.17g,%.17g],"
+                "\"speed\":%.17g,\"mass\":%.17g,\"dt\":%.17g,\"strategy\":%d}", (unsigned long long)id,
+                scenario.shooter_position.x, scenario.shooter_position.y, scenario.shooter_position.z,
+                scenario.target_position.x, scenario.target_position.y, scenario.target_position.z,
+                scenario.shoot_speed, scenario.shoot_height, scenario.delta_time, scenario.strategy);
+            return line;
+        }
+
+        static std::string resultJson(double id, const Simulation::StrategyResult& result){
+            char line[512];
+            std::snprintf(line, sizeof(line), "{\"id\":%.17g,\"result\":\"%s\",\"angle\":%.17g,\"distance\":%.17g,\"time\":%.17g,\"tries\":%u,\"marginal\":%s}",
+                id, Batch::resultName(result.best_result.result), result.best_angle, result.best_result.distance,
+                result.best_result.time, result.tries, result.marginal ? "true" : "false");
+            return line;
+        }
+
+        static std::string errorJson(double id, const std::string& error){
+            std::string escaped;
+            for(char c : error){
+                if(c == '"' || c == '\\'){
+                    escaped += '\\';
+                }
+                escaped += c;
+            }
+            char prefix[64];
+            std::snprintf(prefix, sizeof(prefix), "{\"id\":%.17g,\"error\":\"", id);
+            return prefix + escaped + "\"}";
+        }
+
+        static bool parseMessage(const std::string& line, Message& message){
+            size_t i = 0;
+            auto skip = [&](){
+                while(i < line.size() && std::isspace((unsigned char)line[i])){
+                    i++;
+                }
+            };
+            auto consume = [&](char c){
+                skip();
+                if(i < line.size() && line[i] == c){
+                    i++;
+                    return true;
+                }
+                return false;
+            };
+            auto text = [&](std::string& out){
+                if(!consume('"')){
+                    return false;
+                }
+                out.clear();
+                while(i < line.size() && line[i] != '"'){
+                    if(line[i] == '\\' && i + 1 < line.size()){
+                        i++;
+                    }
+                    out += line[i++];
+                }
+                return consume('"');
+            };
+            auto number = [&](double& out){
+                skip();
+                const char* begin = line.c_str() + i;
+                char* end = nullptr;
+                out = std::strtod(begin, &end);
+                if(end == begin){
+                    return false;
+                }
+                i += end - begin;
+                return true;
+            };
+
+            message = Message();
+            if(!consume('{')){
+                return false;
+            }
+            if(consume('}')){
+                return true;
+            }
+            do{
+                std::string key;
+                if(!text(key) || !consume(':')){
+                    return false;
+                }
+                skip();
+                std::vector<double>& values = message.numbers[key];
+                if(line.compare(i, 4, "true") == 0){
+                    values.push_back(1.0);
+                    i += 4;
+                } else if(line.compare(i, 5, "false") == 0){
+                    values.push_back(0.0);
+                    i += 5;
+                } else if(i < line.size() && line[i] == '"'){
+                    message.numbers.erase(key);
+                    if(!text(message.strings[key])){
+                        return false;
+                    }
+                } else if(consume('[')){
+                    if(!consume(']')){
+                        do{
+                            double value;
+                            if(!number(value)){
+                                return false;
+                            }
+                            values.push_back(value);
+                        } while(consume(','));
+                        if(!consume(']')){
+                            return false;
+                        }
+                    }
+                } else {
+                    double value;
+                    if(!number(value)){
+                        return false;
+                    }
+                    values.push_back(value);
+                }
+            } while(consume(','));
+            return consume('}');
+        }
+
+        static bool parseRequest(const Message& message, Batch::Scenario& scenario, std::string& error){
+            if(!message.vector("shooter", scenario.shooter_position) || !message.vector("target", scenario.target_position)){
+                error = "shooter and target must be [x,y,z]";
+                return false;
+            }
+            if(!message.has("speed") || !message.has("mass") || !message.has("dt")){
+                error = "speed, mass and dt are required";
+                return false;
+            }
+            scenario.shoot_speed = message.number("speed");
+            scenario.shoot_height = message.number("mass");
+            scenario.delta_time = message.number("dt");
+            double strategy = message.number("strategy", 2.0);
+            if(!(scenario.shoot_speed > 0.0) || !std::isfinite(scenario.shoot_speed)){
+                error = "speed must be positive";
+                return false;
+            }
+            if(!(scenario.shoot_height > 0.0) || !std::isfinite(scenario.shoot_height)){
+                error = "mass must be positive";
+                return false;
+            }
+            if(!(scenario.delta_time > 0.0) || !std::isfinite(scenario.delta_time)){
+                error = "dt must be positive";
+                return false;
+            }
+            if(!(strategy >= Simulation::BISECTION && strategy <= Simulation::K_ARY) || strategy != std::floor(strategy)){
+                error = "strategy must be 1, 2, 3 or 4";
+                return false;
+            }
+            scenario.strategy = (int)strategy;
+            return true;
+        }
+
+        static sockaddr_un socketAddress(const std::string& path){
+            sockaddr_un address;
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if(path.size() >= sizeof(address.sun_path)){
+                throw std::runtime_error("Socket path too long: " + path);
+            }
+            std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+            return address;
+        }
+
+    private:
+        struct Connection{
+            int fd;
+            std::string input; //I/O thread only
+            std::mutex mutex; //output and closed
+            std::string output;
+            bool closed = false;
+
+            Connection(int fd) : fd(fd) {}
+            ~Connection(){
+                ::close(fd);
+            }
+
+            //queues the line and writes what the socket takes now, true when some of it waits for POLLOUT
+            bool send(const std::string& line){
+                std::lock_guard<std::mutex> lock(mutex);
+                if(closed){
+                    return false;
+                }
+                if(output.size() + line.size() + 1 > MAX_OUTPUT){
+                    close();
+                    return false;
+                }
+                output += line;
+                output += '\n';
+                flush();
+                return !output.empty();
+            }
+
+            //under the mutex, never blocks
+            void flush(){
+                while(!closed && !output.empty()){
+                    ssize_t count = ::send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+                    if(count < 0 && errno == EINTR){
+                        continue;
+                    }
+                    if(count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                        return;
+                    }
+                    if(count <= 0){
+                        close();
+                        return;
+                    }
+                    output.erase(0, count);
+                }
+            }
+
+            //under the mutex, the I/O thread drops the connection on its next round
+            void close(){
+                closed = true;
+                output.clear();
+            }
+        };
+
+        struct Request{
+            std::shared_ptr<Connection> connection;
+            double id;
+            Batch::Scenario scenario;
+            Clock::time_point arrival;
+        };
+
+        static void setNonBlocking(int fd){
+            int flags = ::fcntl(fd, F_GETFL, 0);
+            if(flags >= 0){
+                ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+            }
+        }
+
+        //has the I/O thread poll again, for answers left waiting for POLLOUT
+        void wake(){
+            char byte = 0;
+            (void)!::write(wake_pipe[1], &byte, 1);
+        }
+
+        //answers from any thread, none of them ever blocks on a client that stopped reading
+        void reply(const std::shared_ptr<Connection>& connection, const std::string& line){
+            if(connection->send(line)){
+                wake();
+            }
+        }
+
+        //one thread polls the listening socket and every connection, parsed requests go to the queue
+        void ioLoop(){
+            std::map<int, std::shared_ptr<Connection>> connections;
+            std::vector<pollfd> fds;
+            char buffer[65536];
+            while(true){
+                fds.clear();
+                fds.push_back({wake_pipe[0], POLLIN, 0});
+                fds.push_back({listen_fd, POLLIN, 0});
+                for(auto it = connections.begin(); it != connections.end();){
+                    short events = POLLIN;
+                    bool closed;
+                    {
+                        std::lock_guard<std::mutex> lock(it->second->mutex);
+                        closed = it->second->closed;
+                        if(!it->second->output.empty()){
+                            events |= POLLOUT;
+                        }
+                    }
+                    if(closed){
+                        it = connections.erase(it);
+                        continue;
+                    }
+                    fds.push_back({it->first, events, 0});
+                    ++it;
+                }
+                if(::poll(fds.data(), fds.size(), -1) < 0){
+                    if(errno == EINTR){
+                        continue;
+                    }
+                    break;
+                }
+                if(fds[0].revents){
+                    while(::read(wake_pipe[0], buffer, sizeof(buffer)) > 0){
+                    }
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    if(stopping){
+                        break;
+                    }
+                }
+                if(fds[1].revents & POLLIN){
+                    int fd = ::accept(listen_fd, nullptr, nullptr);
+                    if(fd >= 0){
+                        setNonBlocking(fd);
+                        connections[fd] = std::make_shared<Connection>(fd);
+                        std::lock_guard<std::mutex> lock(stats_mutex);
+                        counters.connections++;
+                    }
+                }
+                for(size_t k = 2; k < fds.size(); k++){
+                    if(!fds[k].revents){
+                        continue;
+                    }
+                    auto connection = connections[fds[k].fd];
+                    if(fds[k].revents & POLLOUT){
+                        std::lock_guard<std::mutex> lock(connection->mutex);
+                        connection->flush();
+                    }
+                    if(!(fds[k].revents & (POLLIN | POLLHUP | POLLERR))){
+                        continue;
+                    }
+                    ssize_t count = ::recv(connection->fd, buffer, sizeof(buffer), 0);
+                    if(count <= 0){
+                        if(count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+                            continue;
+                        }
+                        std::lock_guard<std::mutex> lock(connection->mutex);
+                        connection->close();
+                        continue;
+                    }
+                    connection->input.append(buffer, count);
+                    readLines(connection);
+                    if(connection->input.size() > MAX_LINE){
+                        //no newline within MAX_LINE bytes, the rest of the line is not worth reading
+                        reply(connection, errorJson(0.0, "line too long"));
+                        std::lock_guard<std::mutex> lock(connection->mutex);
+                        connection->close();
+                    }
+                }
+            }
+            for(auto& [fd, connection] : connections){
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                connection->closed = true;
+            }
+        }
+
+        void readLines(const std::shared_ptr<Connection>& connection){
+            size_t start = 0;
+            size_t end;
+            std::vector<Request> parsed;
+            while((end = connection->input.find('\n', start)) != std::string::npos){
+                std::string line = connection->input.substr(start, end - start);
+                start = end + 1;
+                if(line.find_first_not_of(" \t\r") == std::string::npos){
+                    continue;
+                }
+
+                Message message;
+                Request request = {connection, 0.0, Batch::Scenario(), Clock::now()};
+                std::string error;
+                if(!parseMessage(line, message)){
+                    error = "invalid JSON";
+                } else {
+                    request.id = message.number("id");
+                    if(message.has("stats")){
+                        reply(connection, statsJson(stats()));
+                        continue;
+                    }
+                    parseRequest(message, request.scenario, error);
+                }
+                if(!error.empty()){
+                    reply(connection, errorJson(request.id, error));
+                    std::lock_guard<std::mutex> lock(stats_mutex);
+                    counters.errors++;
+                    continue;
+                }
+                parsed.push_back(std::move(request));
+            }
+            connection->input.erase(0, start);
+
+            if(!parsed.empty()){
+                {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    for(auto& request : parsed){
+                        queue.push_back(std::move(request));
+                    }
+                }
+                queue_condition.notify_one();
+            }
+        }
+
+        //waits for the first request, then up to BATCH_WINDOW_MS for company, and solves the batch on the pool
+        void dispatchLoop(){
+            std::vector<Request> batch;
+            std::vector<std::future<Simulation::StrategyResult>> results;
+            while(true){
+                {
+                    Trace::Scope wait("queue_wait", "service");
+                    std::unique_lock<std::mutex> lock(queue_mutex);
+                    queue_condition.wait(lock, [this](){ return stopping || !queue.empty(); });
+                    if(stopping){
+                        return;
+                    }
+                    auto deadline = queue.front().arrival + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(BATCH_WINDOW_MS));
+                    queue_condition.wait_until(lock, deadline, [this](){ return stopping || queue.size() >= MAX_BATCH; });
+                    size_t count = std::min(queue.size(), std::max<size_t>(1, MAX_BATCH));
+                    batch.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.begin() + count));
+                    queue.erase(queue.begin(), queue.begin() + count);
+                }
+
+                Trace::Scope trace("batch", "service");
+                trace.arg("requests", (int64_t)batch.size());
+                results.clear();
+                for(const Request& request : batch){
+                    const Batch::Scenario* scenario = &request.scenario;
+                    results.push_back(pool.submit([this, scenario](){
+                        return Batch::solve(*scenario, cache, terrain);
+                    }));
+                }
+
+                //counted before answering so a client that saw its answer also sees it in the stats
+                std::vector<std::string> responses;
+                for(size_t i = 0; i < batch.size(); i++){
+                    responses.push_back(resultJson(batch[i].id, pool.wait(results[i])));
+                }
+                recordBatch(batch);
+                for(size_t i = 0; i < batch.size(); i++){
+                    reply(batch[i].connection, responses[i]);
+                }
+            }
+        }
+
+        void recordBatch(const std::vector<Request>& batch){
+            Clock::time_point now = Clock::now();
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            counters.requests += batch.size();
+            counters.batches++;
+            for(const Request& request : batch){
+                double latency = std::chrono::duration<double, std::milli>(now - request.arrival).count();
+                if(latencies.size() < LATENCY_WINDOW){
+                    latencies.push_back(latency);
+                } else {
+                    latencies[next_latency] = latency;
+                }
+                next_latency = (next_latency + 1) % std::max<size_t>(1, LATENCY_WINDOW);
+            }
+        }
+
+        static double quantile(std::vector<double>& values, double q){
+            if(values.empty()){
+                return 0.0;
+            }
+            size_t index = std::min(values.size() - 1, (size_t)(q * values.size()));
+            std::nth_element(values.begin(), values.begin() + index, values.end());
+            return values[index];
+        }
+
+        std::string socket_path;
+        Simulation::ShotCache* cache;
+        const Terrain* terrain;
+        ThreadPool pool;
+
+        int listen_fd = -1;
+        int wake_pipe[2] = {-1, -1};
+        std::thread io_thread;
+        std::thread dispatch_thread;
+
+        std::mutex queue_mutex;
+        std::condition_variable queue_condition;
+        std::deque<Request> queue;
+        bool stopping = false;
+
+        std::mutex stats_mutex;
+        Stats counters;
+        std::vector<double> latencies;
+        size_t next_latency = 0;
+        Clock::time_point started;
+};
+
+double Service::BATCH_WINDOW_MS = 1.0;
+size_t Service::MAX_BATCH = 256;
+size_t Service::LATENCY_WINDOW = 65536;
+size_t Service::MAX_LINE = 65536;
+size_t Service::MAX_OUTPUT = 1 << 20;
+
+//Blocking client for the service, one request in flight per connection.
+class ServiceClient {
+    public:
+        struct LoadResult{
+            uint64_t requests = 0;
+            uint64_t errors = 0;
+            double seconds = 0.0;
+            double p50_ms = 0.0;
+            double p99_ms = 0.0;
+            double throughput = 0.0;
+        };
+
+        ServiceClient(const std::string& socket_path){
+            sockaddr_un address = Service::socketAddress(socket_path);
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if(fd < 0 || ::connect(fd, (sockaddr*)&address, sizeof(address)) != 0){
+                std::string error = std::strerror(errno);
+                if(fd >= 0){
+                    ::close(fd);
+                }
+                throw std::runtime_error("Cannot connect to " + socket_path + ": " + error);
+            }
+        }
+
+        ~ServiceClient(){
+            ::close(fd);
+        }
+
+        ServiceClient(const ServiceClient&) = delete;
+        ServiceClient& operator=(const ServiceClient&) = delete;
+
+        //sends one line and returns the response line, throws when the service goes away
+        std::string request(const std::string& line){
+            std::string data = line + "\n";
+            size_t sent = 0;
+            while(sent < data.size()){
+                ssize_t count = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if(count <= 0){
+                    throw std::runtime_error("Service connection lost");
+                }
+                sent += count;
+            }
+            size_t end;
+            char buffer[4096];
+            while((end = input.find('\n')) == std::string::npos){
+                ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+                if(count <= 0){
+                    throw std::runtime_error("Service connection lost");
+                }
+                input.append(buffer, count);
+            }
+            std::string response = input.substr(0, end);
+            input.erase(0, end + 1);
+            return response;
+        }
+
+        //closed loop load: every connection sends its share of requests back to back, cycling through the scenarios
+        static LoadResult load(const std::string& socket_path, const std::vector<Batch::Scenario>& scenarios, unsigned connections, size_t requests){
+            LoadResult result;
+            if(scenarios.empty() || requests == 0){
+                return result;
+            }
+            connections = std::max(1u, connections);
+            std::vector<std::vector<double>> latencies(connections);
+            std::vector<uint64_t> errors(connections, 0);
+            std::vector<std::string> failures(connections);
+
+            auto start = Service::Clock::now();
+            std::vector<std::thread> threads;
+            for(unsigned c = 0; c < connections; c++){
+                threads.emplace_back([&, c](){
+                    try {
+                        ServiceClient client(socket_path);
+                        for(size_t i = c; i < requests; i += connections){
+                            auto sent = Service::Clock::now();
+                            std::string response = client.request(Service::requestJson(i, scenarios[i % scenarios.size()]));
+                            latencies[c].push_back(std::chrono::duration<double, std::milli>(Service::Clock::now() - sent).count());
+                            if(response.find("\"error\"") != std::string::npos){
+                                errors[c]++;
+                            }
+                        }
+                    } catch (const std::exception& e) {
+                        failures[c] = e.what();
+                    }
+                });
+            }
+            for(auto& thread : threads){
+                thread.join();
+            }
+            result.seconds = std::chrono::duration<double>(Service::Clock::now() - start).count();
+            for(const std::string& failure : failures){
+                if(!failure.empty()){
+                    throw std::runtime_error(failure);
+                }
+            }
+
+            std::vector<double> all;
+            for(unsigned c = 0; c < connections; c++){
+                all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+                result.errors += errors[c];
+            }
+            result.requests = all.size();
+            std::sort(all.begin(), all.end());
+            result.p50_ms = all[std::min(all.size() - 1, all.size() / 2)];
+            result.p99_ms = all[std::min(all.size() - 1, (size_t)(all.size() * 0.99))];
+            result.throughput = result.seconds > 0.0 ? result.requests / result.seconds : 0.0;
+            return result;
+        }
+
+    private:
+        int fd = -1;
+        std::string input;
+};
@@ -0,0 +1,393 @@
+#pragma once
+
+#include "batch.hpp"
+#include "simulation.hpp"
+#include "terrain.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//Batch run split over worker processes. The scenario file is streamed into shard files in a work
+//directory; each worker solves one shard with its own threads and appends the formatted results to
+//shard-N.partial, flushed every CHECKPOINT_BLOCK scenarios. A restarted worker keeps the complete
+//lines and goes on from there, a finished shard is renamed to shard-N.out. The outputs are then
+//concatenated in shard order, lines carry the global scenario index, so the merge is byte for byte
+//what a single process prints. Nothing but one shard is ever held in memory.
+class Shards {
+    public:
+        static size_t CHECKPOINT_BLOCK;
+
+        struct Settings{
+            size_t shards = 4;
+            unsigned processes = 2; //workers running at once
+            unsigned threads = 1; //per worker
+            int max_restarts = 2; //per shard
+            //exec'd as: executable --shard-worker <directory> <shard> --threads <n> [--terrain <file>].
+            //Empty forks without exec and calls worker (runShard by default) in the child. Only for a
+            //process with no other threads (ThreadPool::shared() included), the child could block on a
+            //lock one of them held at the fork.
+            std::string executable;
+            std::string terrain_path;
+            std::function<bool(const std::string& directory, size_t shard)> worker;
+        };
+
+        struct Report{
+            size_t scenarios = 0;
+            size_t shards = 0;
+            size_t launched = 0;
+            size_t restarts = 0;
+            size_t reused = 0; //shards already finished by an earlier run
+        };
+
+        static Report run(const std::string& input, const std::string& directory, const Settings& settings, std::ostream& output){
+            if(::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST){
+                throw std::runtime_error("Cannot create shard directory " + directory + ": " + std::strerror(errno));
+            }
+            Report report;
+            std::vector<Range> ranges = prepare(input, directory, std::max<size_t>(1, settings.shards), report);
+            report.shards = ranges.size();
+
+            std::deque<size_t> pending;
+            for(size_t shard = 0; shard < ranges.size(); shard++){
+                if(exists(outputPath(directory, shard))){
+                    report.reused++;
+                } else {
+                    pending.push_back(shard);
+                }
+            }
+
+            std::map<pid_t, size_t> running;
+            std::vector<int> failures(ranges.size(), 0);
+            std::string error;
+            unsigned processes = std::max(1u, settings.processes);
+            while(!running.empty() || (!pending.empty() && error.empty())){
+                while(running.size() < processes && !pending.empty() && error.empty()){
+                    size_t shard = pending.front();
+                    pending.pop_front();
+                    running[launch(directory, shard, settings)] = shard;
+                    report.launched++;
+                }
+
+                int status = 0;
+                pid_t pid = ::waitpid(-1, &status, 0);
+                if(pid < 0){
+                    if(errno == EINTR){
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("waitpid failed: ") + std::strerror(errno));
+                }
+                auto it = running.find(pid);
+                if(it == running.end()){
+                    continue;
+                }
+                size_t shard = it->second;
+                running.erase(it);
+
+                bool finished = WIFEXITED(status) && WEXITSTATUS(status) == 0 && exists(outputPath(directory, shard));
+                if(finished){
+                    continue;
+                }
+                if(failures[shard]++ < settings.max_restarts){
+                    report.restarts++;
+                    pending.push_back(shard);
+                } else if(error.empty()){
+                    error = "Shard " + std::to_string(shard) + " failed " + std::to_string(failures[shard]) + " times";
+                }
+            }
+            if(!error.empty()){
+                throw std::runtime_error(error);
+            }
+
+            for(size_t shard = 0; shard < ranges.size(); shard++){
+                std::ifstream file(outputPath(directory, shard), std::ios::binary);
+                if(!file){
+                    throw std::runtime_error("Missing output of shard " + std::to_string(shard));
+                }
+                output << file.rdbuf();
+            }
+            output.flush();
+            return report;
+        }
+
+        //Solves one shard, resuming after the last complete line of its partial output. With a limit it
+        //stops after that many new results and returns false, as if the worker had been killed.
+        static bool runShard(const std::string& directory, size_t shard, unsigned threads = 1, const Terrain* terrain = nullptr,
+                             size_t limit = std::numeric_limits<size_t>::max()){
+            std::string output_path = outputPath(directory, shard);
+            if(exists(output_path)){
+                return true;
+            }
+            std::vector<Range> ranges;
+            size_t scenarios = 0;
+            if(!readManifest(directory, ranges, scenarios) || shard >= ranges.size()){
+                throw std::runtime_error("No shard " + std::to_string(shard) + " in " + directory);
+            }
+            std::vector<Batch::Scenario> inputs = Batch::load(inputPath(directory, shard));
+            if(inputs.size() != ranges[shard].count){
+                throw std::runtime_error("Shard " + std::to_string(shard) + " input does not match the manifest");
+            }
+
+            std::string partial_path = partialPath(directory, shard);
+            size_t done = completeLines(partial_path);
+            std::ofstream partial(partial_path, std::ios::app | std::ios::binary);
+            if(!partial){
+                throw std::runtime_error("Cannot write " + partial_path);
+            }
+
+            size_t block = std::max<size_t>(1, CHECKPOINT_BLOCK);
+            while(done < inputs.size()){
+                if(limit == 0){
+                    return false;
+                }
+                size_t end = std::min(inputs.size(), done + std::min(block, limit));
+                std::vector<Batch::Scenario> slice(inputs.begin() + done, inputs.begin() + end);
+                std::vector<Simulation::StrategyResult> results = Batch::run(slice, threads, nullptr, terrain);
+                for(size_t i = 0; i < results.size(); i++){
+                    partial << Batch::format(ranges[shard].begin + done + i, results[i]) << '\n';
+                }
+                partial.flush();
+                if(!partial){
+                    throw std::runtime_error("Cannot write " + partial_path);
+                }
+                limit -= end - done;
+                done = end;
+            }
+            partial.close();
+            if(::rename(partial_path.c_str(), output_path.c_str()) != 0){
+                throw std::runtime_error("Cannot rename " + partial_path + ": " + std::strerror(errno));
+            }
+            return true;
+        }
+
+        static std::string inputPath(const std::string& directory, size_t shard){
+            return shardPath(directory, shard, ".in");
+        }
+
+        static std::string partialPath(const std::string& directory, size_t shard){
+            return shardPath(directory, shard, ".partial");
+        }
+
+        static std::string outputPath(const std::string& directory, size_t shard){
+            return shardPath(directory, shard, ".out");
+        }
+
+    private:
+        struct Range{
+            size_t begin;
+            size_t count;
+        };
+
+        static std::string shardPath(const std::string& directory, size_t shard, const char* extension){
+            char name[64];
+            std::snprintf(name, sizeof(name), "/shard-%04zu%s", shard, extension);
+            return directory + name;
+        }
+
+        static std::string manifestPath(const std::string& directory){
+            return directory + "/manifest";
+        }
+
+        static bool exists(const std::string& path){
+            struct stat info;
+            return ::stat(path.c_str(), &info) == 0;
+        }
+
+        //Splits the input unless the manifest already describes the same split, so a coordinator
+        //that is run again picks up the checkpoints of the previous run
+        static std::vector<Range> prepare(const std::string& input, const std::string& directory, size_t shards, Report& report){
+            size_t scenarios = 0;
+            uint64_t hash = 14695981039346656037ull;
+            forEachScenario(input, [&](const std::string& line){
+                scenarios++;
+                for(char c : line + '\n'){
+                    hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+                }
+            });
+            report.scenarios = scenarios;
+            shards = std::max<size_t>(1, std::min(shards, scenarios));
+
+            std::vector<Range> ranges;
+            size_t existing_scenarios = 0;
+            uint64_t existing_hash = 0;
+            if(readManifest(directory, ranges, existing_scenarios, &existing_hash) && existing_scenarios == scenarios
+               && existing_hash == hash && ranges.size() == shards){
+                return ranges;
+            }
+
+            ::unlink(manifestPath(directory).c_str());
+            ranges.clear();
+            for(size_t shard = 0, begin = 0; shard < shards; shard++){
+                size_t count = scenarios / shards + (shard < scenarios % shards ? 1 : 0);
+                ranges.push_back({begin, count});
+                begin += count;
+                ::unlink(partialPath(directory, shard).c_str());
+                ::unlink(outputPath(directory, shard).c_str());
+                std::ofstream(inputPath(directory, shard), std::ios::trunc);
+            }
+
+            size_t shard = 0;
+            size_t written = 0;
+            std::unique_ptr<std::ofstream> file;
+            forEachScenario(input, [&](const std::string& line){
+                while(!file || written == ranges[shard].count){
+                    if(file){
+                        shard++;
+                    }
+                    file = std::make_unique<std::ofstream>(inputPath(directory, shard), std::ios::trunc);
+                    written = 0;
+                    if(!*file){
+                        throw std::runtime_error("Cannot write " + inputPath(directory, shard));
+                    }
+                }
+                *file << line << '\n';
+                written++;
+            });
+            file.reset();
+
+            //the manifest is written last, a split that was interrupted is redone
+            std::ofstream manifest(manifestPath(directory), std::ios::trunc);
+            manifest << "scenarios " << scenarios << " shards " << ranges.size() << " hash " << hash << '\n';
+            for(const Range& range : ranges){
+                manifest << range.begin << ' ' << range.count << '\n';
+            }
+            if(!manifest){
+                throw std::runtime_error("Cannot write " + manifestPath(directory));
+            }
+            return ranges;
+        }
+
+        static bool readManifest(const std::string& directory, std::vector<Range>& ranges, size_t& scenarios, uint64_t* hash = nullptr){
+            std::ifstream manifest(manifestPath(directory));
+            std::string scenarios_word, shards_word, hash_word;
+            size_t shards = 0;
+            uint64_t input_hash = 0;
+            if(!(manifest >> scenarios_word >> scenarios >> shards_word >> shards >> hash_word >> input_hash)
+               || scenarios_word != "scenarios" || shards_word != "shards" || hash_word != "hash"){
+                return false;
+            }
+            if(hash){
+                *hash = input_hash;
+            }
+            ranges.resize(shards);
+            for(Range& range : ranges){
+                if(!(manifest >> range.begin >> range.count)){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //same lines as Batch::load accepts, in order
+        template<typename F>
+        static void forEachScenario(const std::string& path, F function){
+            std::ifstream file(path);
+            if(!file){
+                throw std::runtime_error("Cannot open scenario file " + path);
+            }
+            std::string line;
+            size_t line_number = 0;
+            Batch::Scenario scenario;
+            while(std::getline(file, line)){
+                line_number++;
+                size_t start = line.find_first_not_of(" \t\r");
+                if(start == std::string::npos || line[start] == '#'){
+                    continue;
+                }
+                if(!Batch::parseScenario(line, scenario)){
+                    throw std::runtime_error("Invalid scenario on line " + std::to_string(line_number) + " of " + path);
+                }
+                function(line);
+            }
+        }
+
+        //number of complete lines, a torn last line is cut off
+        static size_t completeLines(const std::string& path){
+            std::ifstream file(path, std::ios::binary);
+            if(!file){
+                return 0;
+            }
+            size_t lines = 0;
+            size_t bytes = 0;
+            size_t position = 0;
+            char buffer[65536];
+            while(file.read(buffer, sizeof(buffer)) || file.gcount() > 0){
+                std::streamsize count = file.gcount();
+                for(std::streamsize i = 0; i < count; i++){
+                    if(buffer[i] == '\n'){
+                        lines++;
+                        bytes = position + i + 1;
+                    }
+                }
+                position += count;
+            }
+            file.close();
+            if(bytes != position && ::truncate(path.c_str(), (off_t)bytes) != 0){
+                throw std::runtime_error("Cannot truncate " + path + ": " + std::strerror(errno));
+            }
+            return lines;
+        }
+
+        static pid_t launch(const std::string& directory, size_t shard, const Settings& settings){
+            std::vector<std::string> arguments;
+            if(!settings.executable.empty()){
+                arguments = {settings.executable, "--shard-worker", directory, std::to_string(shard), "--threads", std::to_string(settings.threads)};
+                if(!settings.terrain_path.empty()){
+                    arguments.push_back("--terrain");
+                    arguments.push_back(settings.terrain_path);
+                }
+            }
+            std::vector<char*> argv;
+            for(std::string& argument : arguments){
+                argv.push_back(&argument[0]);
+            }
+            argv.push_back(nullptr);
+
+            pid_t pid = ::fork();
+            if(pid < 0){
+                throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+            }
+            if(pid > 0){
+                return pid;
+            }
+
+            //child
+            if(!settings.executable.empty()){
+                ::execv(argv[0], argv.data());
+                std::fprintf(stderr, "Cannot exec %s: %s\n", argv[0], std::strerror(errno));
+                ::_exit(127);
+            }
+            int code = 1;
+            try{
+                if(settings.worker){
+                    code = settings.worker(directory, shard) ? 0 : 1;
+                } else {
+                    std::unique_ptr<Terrain> terrain;
+                    if(!settings.terrain_path.empty()){
+                        terrain = std::make_unique<Terrain>(Terrain::load(settings.terrain_path));
+                    }
+                    code = runShard(directory, shard, settings.threads, terrain.get()) ? 0 : 1;
+                }
+            } catch(const std::exception& e){
+                std::fprintf(stderr, "Shard %zu: %s\n", shard, e.what());
+            }
+            ::_exit(code);
+        }
+};
+
+size_t Shards::CHECKPOINT_BLOCK = 64;
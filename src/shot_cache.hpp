@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//Thread-safe sharded LRU cache of simulation results.
+//Inputs are quantised to the configured tolerances before hashing, so nearly identical
+//requests share an entry. Anything that changes the outcome of a shot is part of the key.
+template<typename ShotResult, typename StrategyResult>
+class BasicShotCache {
+    public:
+        enum Kind{
+            SHOT,
+            STRATEGY_1,
+            STRATEGY_2,
+            STRATEGY_MULTIRES,
+            STRATEGY_KARY
+        };
+
+        struct Tolerances{
+            double position = 0.000001;
+            double speed = 0.000001;
+            double mass = 0.000000001;
+            double delta_time = 0.000000000001;
+            double environment = 0.000000001;
+            double angle = 0.000000000001;
+        };
+
+        static constexpr size_t KEY_SIZE = 48;
+
+        struct Key{
+            std::array<int64_t, KEY_SIZE> values{};
+
+            bool operator==(const Key& other) const{
+                return values == other.values;
+            }
+        };
+
+        struct KeyHash{
+            size_t operator()(const Key& key) const{
+                uint64_t hash = 0xcbf29ce484222325ull;
+                for(int64_t value : key.values){
+                    hash ^= (uint64_t)value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+                    hash *= 0x100000001b3ull;
+                }
+                return (size_t)(hash ^ (hash >> 29));
+            }
+        };
+
+        //fills a key field by field, every add consumes one slot
+        class KeyBuilder{
+            public:
+                KeyBuilder(Kind kind){
+                    key.values[index++] = kind;
+                }
+                //a tolerance of 0 keys on the exact value
+                KeyBuilder& add(double value, double tolerance = 0.0){
+                    key.values.at(index++) = tolerance > 0.0 ? (int64_t)std::llround(value / tolerance) : exact(value);
+                    return *this;
+                }
+                Key build() const{
+                    return key;
+                }
+            private:
+                static int64_t exact(double value){
+                    int64_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    return bits;
+                }
+                Key key;
+                size_t index = 0;
+        };
+
+        BasicShotCache(size_t capacity = 65536, size_t shard_count = 16) : BasicShotCache(capacity, shard_count, Tolerances()) {}
+
+        BasicShotCache(size_t capacity, size_t shard_count, Tolerances tolerances) :
+            tolerances(tolerances), shards(std::max<size_t>(1, shard_count)) {
+            size_t per_shard = std::max<size_t>(1, capacity / shards.size());
+            for(auto& shard : shards){
+                shard.shots.capacity = per_shard;
+                shard.strategies.capacity = per_shard;
+            }
+        }
+
+        bool findShot(const Key& key, ShotResult& result){
+            Shard& shard = shardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            return count(shard.shots.find(key, result));
+        }
+
+        void storeShot(const Key& key, const ShotResult& result){
+            Shard& shard = shardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.shots.store(key, result);
+        }
+
+        bool findStrategy(const Key& key, StrategyResult& result){
+            Shard& shard = shardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            return count(shard.strategies.find(key, result));
+        }
+
+        void storeStrategy(const Key& key, const StrategyResult& result){
+            Shard& shard = shardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.strategies.store(key, result);
+        }
+
+        void clear(){
+            for(auto& shard : shards){
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.shots.clear();
+                shard.strategies.clear();
+            }
+            hits = 0;
+            misses = 0;
+        }
+
+        size_t size(){
+            size_t total = 0;
+            for(auto& shard : shards){
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                total += shard.shots.entries.size() + shard.strategies.entries.size();
+            }
+            return total;
+        }
+
+        uint64_t hitCount() const{
+            return hits.load(std::memory_order_relaxed);
+        }
+
+        uint64_t missCount() const{
+            return misses.load(std::memory_order_relaxed);
+        }
+
+        const Tolerances tolerances;
+        bool cache_strategies = true;
+
+    private:
+        template<typename Value>
+        struct Lru{
+            typedef std::list<std::pair<Key, Value>> List;
+            List entries;
+            std::unordered_map<Key, typename List::iterator, KeyHash> index;
+            size_t capacity = 1;
+
+            bool find(const Key& key, Value& value){
+                auto it = index.find(key);
+                if(it == index.end()){
+                    return false;
+                }
+                entries.splice(entries.begin(), entries, it->second);
+                value = it->second->second;
+                return true;
+            }
+
+            void store(const Key& key, const Value& value){
+                auto it = index.find(key);
+                if(it != index.end()){
+                    it->second->second = value;
+                    entries.splice(entries.begin(), entries, it->second);
+                    return;
+                }
+                entries.emplace_front(key, value);
+                index[key] = entries.begin();
+                if(entries.size() > capacity){
+                    index.erase(entries.back().first);
+                    entries.pop_back();
+                }
+            }
+
+            void clear(){
+                entries.clear();
+                index.clear();
+            }
+        };
+
+        struct Shard{
+            std::mutex mutex;
+            Lru<ShotResult> shots;
+            Lru<StrategyResult> strategies;
+        };
+
+        Shard& shardFor(const Key& key){
+            return shards[(KeyHash()(key) >> 7) % shards.size()];
+        }
+
+        bool count(bool hit){
+            (hit ? hits : misses).fetch_add(1, std::memory_order_relaxed);
+            return hit;
+        }
+
+        std::vector<Shard> shards;
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+};
@@ -2,12 +2,19 @@
 
 #include "components.hpp"
 #include "physics.hpp"
+#include "instrumentation.hpp"
+#include "shot_cache.hpp"
+#include "trajectory.hpp"
+#include "reachability.hpp"
+#include "terrain.hpp"
 #include <entt/entt.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
 #include <limits>
 #include <functional>
+#include <cmath>
+#include <algorithm>
 
 class Simulation {
     private:
@@ -15,6 +22,12 @@ class Simulation {
     static double MAX_SIMULATION_TIME;
     static double AIR_RESISTANCE;
     static uint32_t MAX_TRIES;
+    static bool REACHABILITY_PRECHECK;
+    static bool PLANAR;
+    static int MULTIRES_LEVELS;
+    static int MULTIRES_ITERATIONS;
+    static double MULTIRES_MAX_DELTA_TIME;
+    static int KARY_WIDTH;
 
     public:
     static glm::dvec3 UP_VECTOR;
@@ -23,7 +36,8 @@ class Simulation {
             TOO_HIGH,
             TOO_LOW,
             NO_TIME,
-            NO_IN_RANGE
+            NO_IN_RANGE,
+            TERRAIN
         };
 
         struct ShotResult{
@@ -37,8 +51,24 @@ class Simulation {
             ShotResult best_result;
             double best_angle;
             uint32_t tries;
+            bool marginal = false; //target close to the edge of the reachability envelope
         };
 
+        struct Flight{
+            glm::dvec3 impact;
+            double time;
+            bool landed; //false when MAX_SIMULATION_TIME ran out first
+        };
+
+        enum Strategy{
+            BISECTION = 1,
+            THREE_POINT = 2,
+            MULTI_RESOLUTION = 3,
+            K_ARY = 4
+        };
+
+        typedef BasicShotCache<ShotResult, StrategyResult> ShotCache;
+
         Simulation(){}
         void init(const glm::dvec3& shooter_position, const glm::dvec3& target_position, double shoot_speed, double shoot_height, double delta_time){
             this->shooter_position = shooter_position;
@@ -53,201 +83,822 @@ class Simulation {
         
         virtual ~Simulation(){}
 
+        //shared between simulations, shots and solves with callbacks are never cached
+        void setCache(ShotCache* cache){
+            this->cache = cache;
+        }
+
+        //terrain the shots collide with, nullptr for none; must outlive the simulation. Its grid lies across
+        //UP_VECTOR as toTerrain() maps it, in a y up world that is the world x/z plane.
+        void setTerrain(const Terrain* terrain){
+            this->terrain = terrain;
+        }
+
+        const Terrain* getTerrain() const{
+            return terrain;
+        }
+
+        //a shot stopped by the ground before reaching the target came in short
+        static bool isShort(ShotResultEnum result){
+            return result == ShotResultEnum::TOO_LOW || result == ShotResultEnum::TERRAIN;
+        }
+
+        //runs the strategy as a ResumableSolve to the end (defined in resumable.hpp): a strategy cache hit
+        //or a target outside the reachability envelope answer it without a shot
+        StrategyResult find_angle(Strategy strategy, std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
+                                  std::function<void(const Position& position, const double& time)> callback2 = nullptr);
+
+        //the same solve as part of an enclosing one: no cache, no precheck and no record of its own, its
+        //shots are counted by the scope of the caller
+        StrategyResult find_angle_within(Strategy strategy, Instrumentation::SolveScope& scope,
+                                         std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
+                                         std::function<void(const Position& position, const double& time)> callback2 = nullptr);
 
         //good for air density 0
         StrategyResult find_angle_strategy(std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
                                             std::function<void(const Position& position, const double& time)> callback2 = nullptr){
+            return find_angle(BISECTION, callback, callback2);
+        }
+
+        StrategyResult find_angle_strategy2(std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
+                                            std::function<void(const Position& position, const double& time)> callback2 = nullptr){
+            return find_angle(THREE_POINT, callback, callback2);
+        }
+
+        //starts on coarse time steps and refines them as the bracket shrinks
+        StrategyResult find_angle_strategy_multires(std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
+                                                    std::function<void(const Position& position, const double& time)> callback2 = nullptr){
+            return find_angle(MULTI_RESOLUTION, callback, callback2);
+        }
+
+        //fires KARY_WIDTH angles per iteration on the shared thread pool
+        StrategyResult find_angle_strategy_kary(std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
+                                                std::function<void(const Position& position, const double& time)> callback2 = nullptr){
+            return find_angle(K_ARY, callback, callback2);
+        }
+
+        //starts from the angle of a nearby solved target, never cached since the result depends on the guess
+        StrategyResult find_angle_warm(double guess, double width, std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
+                                       std::function<void(const Position& position, const double& time)> callback2 = nullptr){
+            return checkedStrategy("warm", [&](){
+                return solve_angle_warm(guess, width, callback, callback2);
+            });
+        }
+
+        //Warm start: the bracket guess +- width is widened four times at a time until its low end comes in
+        //short and its high end goes over the target, then closed with Illinois false position on the signed
+        //miss. When no such bracket exists below the straight up angle the cold strategy 1 solve is used.
+        StrategyResult solve_angle_warm(double guess, double width, std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
+                                        std::function<void(const Position& position, const double& time)> callback2 = nullptr){
+            Instrumentation::SolveScope solve_scope("warm");
             StrategyResult best_result = {{ShotResultEnum::NO_TIME, std::numeric_limits<double>::max(), 0.0}, 0.0, 0};
 
             glm::dvec3 direction = glm::normalize(target_position - shooter_position);
             double dotProduct = glm::dot(glm::normalize(direction), UP_VECTOR);
-            double max_angle = glm::degrees(glm::acos(dotProduct));
-            double min_angle = 0.0;
+            double initial_max_angle = glm::degrees(glm::acos(dotProduct));
+            double initial_min_angle = 0.0;
+            width = std::max(width, 0.000001);
 
-            double angle = min_angle;
-            
             uint32_t tries = 0;
-            while(tries < MAX_TRIES){
+            auto shoot = [&](double angle){
                 tries++;
+                solve_scope.shot();
                 ShotResult result = simulateShot(angle, callback2);
-
                 if(callback){
                     callback(result, angle);
                 }
-
                 if(best_result.best_result.distance > result.distance){
                     best_result = {result, angle, tries};
                 }
-
+                return result;
+            };
+            //negative below the target, positive above it
+            auto signedMiss = [](const ShotResult& result){
+                return result.result == ShotResultEnum::TOO_HIGH ? result.distance : -result.distance;
+            };
+            auto cold = [&](){
+                StrategyResult result = find_angle_within(BISECTION, solve_scope, callback, callback2);
+                result.tries += tries;
+                solve_scope.terminate(result.best_result.result == ShotResultEnum::HIT ? Instrumentation::HIT
+                                    : result.best_result.result == ShotResultEnum::NO_IN_RANGE ? Instrumentation::NO_IN_RANGE : Instrumentation::BRACKET_COLLAPSE);
+                return result;
+            };
+
+            double min_angle = glm::clamp(guess - width, initial_min_angle, initial_max_angle);
+            double max_angle = glm::clamp(guess + width, initial_min_angle, initial_max_angle);
+            double min_miss = 0.0;
+            double max_miss = 0.0;
+
+            while(true){
+                ShotResult result = shoot(min_angle);
                 if(result.result == ShotResultEnum::HIT){
+                    solve_scope.terminate(Instrumentation::HIT);
+                    return best_result;
+                }
+                if(result.result != ShotResultEnum::TOO_HIGH){
+                    min_miss = signedMiss(result);
+                    break;
+                }
+                if(min_angle <= initial_min_angle || tries >= MAX_TRIES){
+                    return cold();
+                }
+                max_angle = min_angle;
+                max_miss = signedMiss(result);
+                width *= 4.0;
+                min_angle = std::max(initial_min_angle, guess - width);
+            }
+            while(max_miss <= 0.0){
+                ShotResult result = shoot(max_angle);
+                if(result.result == ShotResultEnum::HIT){
+                    solve_scope.terminate(Instrumentation::HIT);
                     return best_result;
                 }
-
                 if(result.result == ShotResultEnum::TOO_HIGH){
-                    max_angle = angle;
+                    max_miss = signedMiss(result);
+                    break;
+                }
+                //short everywhere up to straight up, or past the maximum range
+                if(max_angle >= initial_max_angle || tries >= MAX_TRIES){
+                    return cold();
+                }
+                min_angle = max_angle;
+                min_miss = signedMiss(result);
+                width *= 4.0;
+                max_angle = std::min(initial_max_angle, guess + width);
+            }
+
+            int last_side = 0;
+            while(tries < MAX_TRIES){
+                Trace::Scope iteration("iteration", "solver");
+                double angle = (min_angle * max_miss - max_angle * min_miss) / (max_miss - min_miss);
+                if(!(angle > min_angle && angle < max_angle)){
+                    angle = (min_angle + max_angle) / 2.0;
                 }
 
-                
-                if(result.result == ShotResultEnum::TOO_LOW){
+                ShotResult result = shoot(angle);
+                if(result.result == ShotResultEnum::HIT){
+                    solve_scope.terminate(Instrumentation::HIT);
+                    return best_result;
+                }
+                if(result.result == ShotResultEnum::TOO_HIGH){
+                    max_angle = angle;
+                    max_miss = signedMiss(result);
+                    if(last_side == 1){
+                        min_miss /= 2.0;
+                    }
+                    last_side = 1;
+                } else {
                     min_angle = angle;
-                    if(best_result.best_result.result == ShotResultEnum::TOO_LOW){
-                        if(best_result.best_result.distance < result.distance){
-                            if(best_result.best_angle < angle){
-                                best_result.best_result.result = ShotResultEnum::NO_IN_RANGE;
-                                return best_result;
-                            }
-                        }
+                    min_miss = signedMiss(result);
+                    if(last_side == -1){
+                        max_miss /= 2.0;
                     }
+                    last_side = -1;
                 }
 
                 if(max_angle - min_angle < 0.000000001){
+                    solve_scope.terminate(Instrumentation::BRACKET_COLLAPSE);
                     return best_result;
                 }
-
-                angle = (min_angle + max_angle) / 2.0;
             }
             return best_result;
         }
 
-        StrategyResult find_angle_strategy2(std::function<void(const ShotResult& result, const double& angle)> callback = nullptr,
-                                            std::function<void(const Position& position, const double& time)> callback2 = nullptr){
-            StrategyResult best_result = {{ShotResultEnum::NO_TIME, std::numeric_limits<double>::max(), 0.0}, 0.0, 0};
+        //trajectory, when given, receives the flight as dense-output keyframes
+        ShotResult simulateShot(double angle, std::function<void(const Position& position, const double& time)> callback = nullptr, Trajectory* trajectory = nullptr){
+            if(cache && !callback && !trajectory){
+                ShotCache::Key key = cacheKey(ShotCache::SHOT, angle);
+                ShotResult result;
+                if(cache->findShot(key, result)){
+                    return result;
+                }
+                result = simulateShotUncached(angle, nullptr);
+                cache->storeShot(key, result);
+                return result;
+            }
+            return simulateShotUncached(angle, callback, trajectory);
+        }
 
-            glm::dvec3 direction = glm::normalize(target_position - shooter_position);
-            double dotProduct = glm::dot(glm::normalize(direction), UP_VECTOR);
-            double max_angle = glm::degrees(glm::acos(dotProduct));
-            double min_angle = 0.0;
-            double angle = (max_angle - min_angle) / 2.0;
+        ShotResult simulateShotUncached(double angle, std::function<void(const Position& position, const double& time)> callback = nullptr, Trajectory* trajectory = nullptr){
+            if(delta_time <= 0.0){
+                return {ShotResultEnum::NO_TIME, 0.0, 0.0};
+            }
+            if(isPlanar()){
+                return simulatePlanar(angle, callback, trajectory);
+            }
+            Instrumentation::ShotScope shot_scope;
+            double time = 0.0;
+
+            entt::registry registry;
+
+            glm::dvec3 velocity = launchVelocity(angle);
+
+            auto projectile = launch(registry, velocity);
 
+            double min_distance = glm::length(shooter_position - target_position);
 
-            ShotResult result_max = simulateShot(max_angle, callback2);
-            if(result_max.result == ShotResultEnum::HIT){
-                    return {result_max, max_angle, 1};
+            if(trajectory){
+                trajectory->clear();
+                trajectory->record(time, shooter_position, velocity);
             }
-            ShotResult result_min = simulateShot(min_angle, callback2);
-            if(result_min.result == ShotResultEnum::HIT){
-                return {result_min, min_angle, 1};
+
+            while(time < MAX_SIMULATION_TIME){
+                glm::dvec3 previous_velocity = registry.get<Velocity>(projectile).velocity;
+                Physics::update(registry, delta_time);
+                time += delta_time;
+                shot_scope.step();
+
+                const Position& position = registry.get<Position>(projectile);
+                const glm::dvec3& current_velocity = registry.get<Velocity>(projectile).velocity;
+
+                if(callback){
+                    callback(position, time);
+                }
+                if(trajectory){
+                    trajectory->record(time, position.position, current_velocity);
+                }
+
+                ShotResult result;
+                if(classifyStep(position, previous_velocity, current_velocity, time, delta_time, min_distance, result)){
+                    return result;
+                }
             }
 
-            ShotResult result_mid = simulateShot(angle, callback2);
-            if(callback){
-                callback(result_mid, angle);
+            return {ShotResultEnum::NO_TIME, min_distance, time};
+        }
+
+        //Vertical plane through the shooter that holds the launch velocity and gravity. A point mass under
+        //gravity and drag has no force across it, so the whole shot can be flown in its two coordinates.
+        struct Plane{
+            glm::dvec3 origin = glm::dvec3(0.0);
+            glm::dvec3 downrange = glm::dvec3(1.0, 0.0, 0.0);
+            glm::dvec3 up = glm::dvec3(0.0, 1.0, 0.0); //against gravity
+            glm::dvec2 velocity = glm::dvec2(0.0); //at launch
+            glm::dvec2 target = glm::dvec2(0.0);
+            double offset2 = 0.0; //squared distance of the target from the plane
+            double gravity = 0.0;
+            double drag = 0.0; //0.5 * AIR_DENSITY * air_resistance / mass
+
+            glm::dvec3 lift(const glm::dvec2& position) const{
+                return origin + downrange * position.x + up * position.y;
             }
-            if(result_mid.result == ShotResultEnum::HIT){
-                return {result_mid, angle, 1};
+
+            glm::dvec3 liftVelocity(const glm::dvec2& velocity) const{
+                return downrange * velocity.x + up * velocity.y;
             }
-            
-            uint32_t tries = 1;
-            while(tries < MAX_TRIES){
-                tries++;
+        };
 
-                double angle_max_mid = (max_angle + angle) / 2.0;
-                ShotResult result_max_mid = simulateShot(angle_max_mid, callback2);
-                if(result_max_mid.result == ShotResultEnum::HIT){
-                    return {result_max_mid, angle_max_mid, tries};
-                }
-                double angle_min_mid = (min_angle + angle) / 2.0;
-                ShotResult result_min_mid = simulateShot(angle_min_mid, callback2);
-                if(result_min_mid.result == ShotResultEnum::HIT){
-                    return {result_min_mid, angle_min_mid, tries};
+        //true when simulateShot() flies on the planar kernel, spin drift needs the full one
+        bool isPlanar() const{
+            return PLANAR && !isSpinning();
+        }
+
+        Plane planeOf(double angle) const{
+            Plane plane;
+            glm::dvec3 launch = launchVelocity(angle);
+            glm::dvec3 offset = target_position - shooter_position;
+            double gravity = glm::length(Physics::GRAVITY);
+            plane.origin = shooter_position;
+            plane.up = gravity > 0.0 ? -Physics::GRAVITY / gravity : glm::normalize(UP_VECTOR);
+            //shot straight up or down, any vertical plane will do and the one through the target is best
+            glm::dvec3 axis = std::abs(plane.up.x) < 0.9 ? glm::dvec3(1.0, 0.0, 0.0) : glm::dvec3(0.0, 1.0, 0.0);
+            for(const glm::dvec3& candidate : {launch, offset, axis}){
+                glm::dvec3 horizontal = candidate - glm::dot(candidate, plane.up) * plane.up;
+                double length = glm::length(horizontal);
+                if(length > 1e-9 * glm::length(candidate)){
+                    plane.downrange = horizontal / length;
+                    break;
                 }
+            }
+            plane.velocity = glm::dvec2(glm::dot(launch, plane.downrange), glm::dot(launch, plane.up));
+            plane.target = glm::dvec2(glm::dot(offset, plane.downrange), glm::dot(offset, plane.up));
+            glm::dvec3 across = offset - plane.downrange * plane.target.x - plane.up * plane.target.y;
+            plane.offset2 = glm::dot(across, across);
+            plane.gravity = gravity;
+            plane.drag = 0.5 * Physics::AIR_DENSITY * AIR_RESISTANCE / shoot_height;
+            return plane;
+        }
 
+        //A shot flown a bounded number of steps at a time by advanceShot(), for solvers that have to give
+        //the thread back between steps. Flown to the end it gives the same result as simulateShot().
+        struct PendingShot{
+            entt::registry registry;
+            entt::entity projectile = entt::null;
+            double angle = 0.0;
+            double delta_time = 0.0;
+            double time = 0.0;
+            double distance = 0.0; //of the last step
+            uint64_t steps = 0;
+            uint64_t ns = 0; //spent in advanceShot()
+            bool finished = false;
+            bool store = false; //into the cache when finished
+            bool planar = false;
+            Plane plane;
+            glm::dvec2 planar_position = glm::dvec2(0.0);
+            glm::dvec2 planar_velocity = glm::dvec2(0.0);
+            ShotCache::Key key;
+            ShotResult result = {ShotResultEnum::NO_TIME, 0.0, 0.0};
+        };
 
-                if(result_max_mid.distance < result_mid.distance){
-                    result_min = result_mid;
-                    result_mid = result_max_mid;
-                    min_angle = angle;
-                } else if(result_min_mid.distance < result_mid.distance){
-                    result_max = result_mid;
-                    result_mid = result_min_mid;
-                    max_angle = angle;
-                } else {
-                    result_min = result_min_mid;
-                    result_max = result_max_mid;
-                    min_angle = angle_min_mid;
-                    max_angle = angle_max_mid;
+        //a cached result finishes the shot right away, as simulateShot() does without a step callback
+        void beginShot(PendingShot& shot, double angle, bool use_cache = true){
+            shot.registry.clear();
+            shot.angle = angle;
+            shot.delta_time = delta_time;
+            shot.time = 0.0;
+            shot.steps = 0;
+            shot.ns = 0;
+            shot.finished = false;
+            shot.store = false;
+            if(delta_time <= 0.0){
+                shot.result = {ShotResultEnum::NO_TIME, 0.0, 0.0};
+                shot.finished = true;
+                return;
+            }
+            if(cache && use_cache){
+                shot.key = cacheKey(ShotCache::SHOT, angle);
+                if(cache->findShot(shot.key, shot.result)){
+                    shot.finished = true;
+                    return;
                 }
+                shot.store = true;
+            }
+            shot.distance = glm::length(shooter_position - target_position);
+            shot.planar = isPlanar();
+            if(shot.planar){
+                shot.plane = planeOf(angle);
+                shot.planar_position = glm::dvec2(0.0);
+                shot.planar_velocity = shot.plane.velocity;
+                return;
+            }
+            shot.projectile = launch(shot.registry, launchVelocity(angle));
+        }
 
-                if(callback){
-                    callback(result_mid, angle);
+        //flies at most max_steps steps, true once the shot has its result
+        bool advanceShot(PendingShot& shot, uint64_t max_steps, const std::function<void(const Position& position, const double& time)>& callback = nullptr){
+            if(shot.finished){
+                return true;
+            }
+            auto start = Instrumentation::Clock::now();
+            for(uint64_t step = 0; step < max_steps && !shot.finished; step++){
+                if(shot.time >= MAX_SIMULATION_TIME){
+                    shot.ns += Instrumentation::elapsedNs(start);
+                    finishShot(shot, {ShotResultEnum::NO_TIME, shot.distance, shot.time});
+                    return true;
                 }
-                if(best_result.best_result.distance > result_mid.distance){
-                    best_result = {result_mid, angle, tries};
+                ShotResult result;
+                bool landed;
+                if(shot.planar){
+                    shot.time += shot.delta_time;
+                    shot.steps++;
+                    landed = planarStep(shot.plane, shot.planar_position, shot.planar_velocity, shot.time, shot.delta_time, callback, nullptr, shot.distance, result);
+                } else {
+                    glm::dvec3 previous_velocity = shot.registry.get<Velocity>(shot.projectile).velocity;
+                    Physics::update(shot.registry, shot.delta_time);
+                    shot.time += shot.delta_time;
+                    shot.steps++;
+
+                    const Position& position = shot.registry.get<Position>(shot.projectile);
+                    const glm::dvec3& current_velocity = shot.registry.get<Velocity>(shot.projectile).velocity;
+                    if(callback){
+                        callback(position, shot.time);
+                    }
+                    landed = classifyStep(position, previous_velocity, current_velocity, shot.time, shot.delta_time, shot.distance, result);
                 }
-
-                if(max_angle - min_angle < 0.000000001){
-                    return best_result;
+                if(landed){
+                    shot.ns += Instrumentation::elapsedNs(start);
+                    finishShot(shot, result);
+                    return true;
                 }
-
-                angle = (max_angle + min_angle) / 2.0;
             }
-            return best_result;
+            shot.ns += Instrumentation::elapsedNs(start);
+            return shot.finished;
         }
-        
 
-        ShotResult simulateShot(double angle, std::function<void(const Position& position, const double& time)> callback = nullptr){
+        //Flies a shot without looking at the target until it goes below ground_height (along UP_VECTOR),
+        //into the terrain or out of time. azimuth turns the shot about UP_VECTOR, in degrees.
+        Flight simulateFlight(double angle, double azimuth, double ground_height, Trajectory* trajectory = nullptr){
             if(delta_time <= 0.0){
-                return {ShotResultEnum::NO_TIME, 0.0, 0.0};
+                return {shooter_position, 0.0, false};
             }
+            Instrumentation::ShotScope shot_scope;
             double time = 0.0;
 
             entt::registry registry;
+            glm::dvec3 velocity = launchVelocity(angle, azimuth);
+            auto projectile = launch(registry, velocity);
+
+            if(trajectory){
+                trajectory->clear();
+                trajectory->record(time, shooter_position, velocity);
+            }
 
+            while(time < MAX_SIMULATION_TIME){
+                Physics::update(registry, delta_time);
+                time += delta_time;
+                shot_scope.step();
+
+                const Position& position = registry.get<Position>(projectile);
+                const glm::dvec3& current = registry.get<Velocity>(projectile).velocity;
+
+                double impact = 1.0;
+                bool grounded = intersectTerrain(position.previous_position, position.position, impact);
+                double h0 = glm::dot(position.previous_position, UP_VECTOR) - ground_height;
+                double h1 = glm::dot(position.position, UP_VECTOR) - ground_height;
+                if(h1 < 0.0){
+                    double below = h0 > h1 ? glm::clamp(h0 / (h0 - h1), 0.0, 1.0) : 0.0;
+                    impact = grounded ? std::min(impact, below) : below;
+                    grounded = true;
+                }
+
+                if(grounded){
+                    glm::dvec3 point = position.previous_position + impact * (position.position - position.previous_position);
+                    double impact_time = time - (1.0 - impact) * delta_time;
+                    if(trajectory){
+                        trajectory->record(impact_time, point, current);
+                    }
+                    return {point, impact_time, true};
+                }
+                if(trajectory){
+                    trajectory->record(time, position.position, current);
+                }
+            }
+            return {registry.get<Position>(projectile).position, time, false};
+        }
+
+        const glm::dvec3& getShooterPosition() const{
+            return shooter_position;
+        }
+
+        const glm::dvec3& getTargetPosition() const{
+            return target_position;
+        }
+
+        void setTargetPosition(const glm::dvec3& target_position){
+            this->target_position = target_position;
+        }
+
+        double getShootSpeed() const{
+            return shoot_speed;
+        }
+
+        void setShootSpeed(double shoot_speed){
+            this->shoot_speed = shoot_speed;
+        }
+
+        //projectile component every shot starts with
+        Mass getMass() const{
+            return Mass{shoot_height, AIR_RESISTANCE};
+        }
+
+        //spin of the projectile and its aerodynamics for the modified point mass model; with the default
+        //zero diameter every shot flies as a point mass. The solvers only turn the elevation, so the drift
+        //across the line of fire stays in the miss distance.
+        void setAerodynamics(const Aerodynamics& aerodynamics, double spin_rate){
+            this->aerodynamics = aerodynamics;
+            this->spin_rate = spin_rate;
+        }
+
+        const Aerodynamics& getAerodynamics() const{
+            return aerodynamics;
+        }
+
+        double getSpinRate() const{
+            return spin_rate;
+        }
+
+        //true when shots carry Spin and Aerodynamics
+        bool isSpinning() const{
+            return Physics::MODEL == Physics::MODIFIED_POINT_MASS && aerodynamics.diameter > 0.0;
+        }
+
+        //turns the reachability precheck off for this simulation only, for callers that bound the target
+        //themselves; with REACHABILITY_PRECHECK off it never runs
+        void setPrecheck(bool precheck){
+            this->precheck = precheck;
+        }
+
+        bool usesPrecheck() const{
+            return REACHABILITY_PRECHECK && precheck;
+        }
+
+        //Where the target stands against the reachability envelope, REACHABLE without the precheck. An
+        //unreachable target is recorded as a solve of name that took no shots.
+        Reachability::Verdict precheckTarget(const char* name) const{
+            if(!usesPrecheck()){
+                return Reachability::REACHABLE;
+            }
+            auto start = Instrumentation::Clock::now();
+            auto envelope = Reachability::envelope(shoot_speed, shoot_height, AIR_RESISTANCE, UP_VECTOR, MAX_SIMULATION_TIME);
+            Reachability::Verdict verdict = Reachability::classify(envelope.get(), shooter_position, target_position, UP_VECTOR);
+            if(verdict == Reachability::UNREACHABLE){
+                if constexpr (Instrumentation::ENABLED){
+                    Instrumentation::recordSolve(name, 0, Instrumentation::elapsedNs(start), Instrumentation::NO_IN_RANGE);
+                }
+            }
+            return verdict;
+        }
+
+        //the answer to a target the precheck rejected
+        StrategyResult unreachableResult() const{
+            return {{ShotResultEnum::NO_IN_RANGE, glm::length(target_position - shooter_position), 0.0}, 0.0, 0, false};
+        }
+
+        //strategy cache of solves without callbacks, false on a miss or without a cache that keeps strategies
+        bool findStrategy(ShotCache::Kind kind, StrategyResult& result) const{
+            return cache && cache->cache_strategies && cache->findStrategy(cacheKey(kind, 0.0), result);
+        }
+
+        void storeStrategy(ShotCache::Kind kind, const StrategyResult& result) const{
+            if(cache && cache->cache_strategies){
+                cache->storeStrategy(cacheKey(kind, 0.0), result);
+            }
+        }
+
+        double getDeltaTime() const{
+            return delta_time;
+        }
+
+        void setDeltaTime(double delta_time){
+            this->delta_time = delta_time;
+        }
+
+        static double getMaxSimulationTime(){
+            return MAX_SIMULATION_TIME;
+        }
+
+        static uint32_t getMaxTries(){
+            return MAX_TRIES;
+        }
+
+        static int getKaryWidth(){
+            return KARY_WIDTH;
+        }
+
+        static int getMultiresLevels(){
+            return MULTIRES_LEVELS;
+        }
+
+        static int getMultiresIterations(){
+            return MULTIRES_ITERATIONS;
+        }
+
+        static double getMultiresMaxDeltaTime(){
+            return MULTIRES_MAX_DELTA_TIME;
+        }
+
+        //angle rotates the direction to the target towards UP_VECTOR, azimuth then turns it about UP_VECTOR
+        glm::dvec3 launchVelocity(double angle, double azimuth = 0.0) const{
             glm::dvec3 direction = glm::normalize(target_position - shooter_position);
             glm::dvec3 right = glm::normalize(glm::cross(direction, UP_VECTOR));
             if(glm::isnan(right.x)){
                 right = glm::dvec3(1, 0, 0);
             }
             glm::dmat4 rotation = glm::rotate(glm::dmat4(1.0), glm::radians(angle), right);
+            if(azimuth != 0.0){
+                rotation = glm::rotate(glm::dmat4(1.0), glm::radians(azimuth), UP_VECTOR) * rotation;
+            }
             glm::dvec3 new_direction = rotation * glm::dvec4(direction, 1.0);
-            glm::dvec3 velocity = new_direction * shoot_speed;
+            return new_direction * shoot_speed;
+        }
+        
+    private:
+        //Classifies the step that ended at time against the target, false while the shot is still on its way.
+        //distance is the miss of this step either way.
+        bool classifyStep(const Position& position, const glm::dvec3& previous_velocity, const glm::dvec3& current_velocity, double time, double delta_time,
+                          double& distance, ShotResult& result) const{
+            //closest approach on the Hermite curve through both ends of the step instead of the chord,
+            //so the miss distance and time do not depend on the step size
+            Trajectory::Keyframe start = {time - delta_time, position.previous_position, previous_velocity};
+            Trajectory::Keyframe end = {time, position.position, current_velocity};
+            double closest_time = Trajectory::closestApproach(start, end, target_position);
+            double t = closest_time < end.time ? (closest_time - start.time) / delta_time : 1.0;
+            glm::dvec3 nearest_point = Trajectory::position(start, end, closest_time);
+
+            distance = glm::length(target_position - nearest_point);
+
+            double impact = 1.0;
+            bool grounded = intersectTerrain(position.previous_position, position.position, impact);
+
+            if(distance < HIT_TRASHOLD && (!grounded || t <= impact)){
+                result = {ShotResultEnum::HIT, distance, closest_time};
+                return true;
+            }
+            if(grounded && (t >= 1.0 || impact < t)){
+                result = terrainResult(position.previous_position, position.position, impact, time, delta_time);
+                return true;
+            }
+            //I assume that I want to hit the target as directly as possible, without considering a higher arc trajectory.
+            if(t<1.0){
+            
+                //if air density is not 0, can be wrong
+                if(glm::dot(target_position - nearest_point, UP_VECTOR) < 0.0){
+                    result = {ShotResultEnum::TOO_HIGH, distance, closest_time};
+                    return true;
+                }
+                result = {ShotResultEnum::TOO_LOW, distance, closest_time};
+                return true;
+            }
+            return false;
+        }
 
-            auto projectile = registry.create();
+        //simulateShotUncached() on the planar kernel
+        ShotResult simulatePlanar(double angle, const std::function<void(const Position& position, const double& time)>& callback, Trajectory* trajectory){
+            Instrumentation::ShotScope shot_scope;
+            double time = 0.0;
 
-            registry.emplace<Position>(projectile, shooter_position);
-            registry.emplace<Velocity>(projectile, velocity);
-            registry.emplace<Mass>(projectile, Mass{shoot_height, AIR_RESISTANCE});
+            Plane plane = planeOf(angle);
+            glm::dvec2 position(0.0);
+            glm::dvec2 velocity = plane.velocity;
 
             double min_distance = glm::length(shooter_position - target_position);
 
+            if(trajectory){
+                trajectory->clear();
+                trajectory->record(time, shooter_position, plane.liftVelocity(velocity));
+            }
+
             while(time < MAX_SIMULATION_TIME){
-                Physics::update(registry, delta_time);
                 time += delta_time;
+                shot_scope.step();
 
-                const Position& position = registry.get<Position>(projectile);
+                ShotResult result;
+                if(planarStep(plane, position, velocity, time, delta_time, callback, trajectory, min_distance, result)){
+                    return result;
+                }
+            }
 
+            return {ShotResultEnum::NO_TIME, min_distance, time};
+        }
+
+        //a step from a to b that met the ground at fraction impact of its length
+        ShotResult terrainResult(const glm::dvec3& a, const glm::dvec3& b, double impact, double time, double delta_time) const{
+            glm::dvec3 impact_point = a + impact * (b - a);
+            return {ShotResultEnum::TERRAIN, glm::length(target_position - impact_point), time - (1.0 - impact) * delta_time};
+        }
+
+        //One step of the planar kernel ending at time. While the shot is still closing in on the target the
+        //end of the step is the nearest point and the miss is measured in the plane; the step is only lifted
+        //back into the world for the callbacks and classifyStep() once the target is passed, and for the
+        //terrain before that only when it comes down below the highest sample.
+        bool planarStep(const Plane& plane, glm::dvec2& position, glm::dvec2& velocity, double time, double delta_time,
+                        const std::function<void(const Position& position, const double& time)>& callback, Trajectory* trajectory,
+                        double& distance, ShotResult& result) const{
+            glm::dvec2 previous_position = position;
+            glm::dvec2 previous_velocity = velocity;
+            Physics::integratePlanar(position, velocity, plane.gravity, plane.drag, delta_time);
+
+            Position lifted;
+            glm::dvec3 current_velocity(0.0);
+            bool world = callback || trajectory;
+            if(world){
+                lifted = {plane.lift(position), plane.lift(previous_position)};
+                current_velocity = plane.liftVelocity(velocity);
                 if(callback){
-                    callback(position, time);
+                    callback(lifted, time);
+                }
+                if(trajectory){
+                    trajectory->record(time, lifted.position, current_velocity);
                 }
+            }
 
-                glm::dvec3 AB = position.position - position.previous_position;
-                glm::dvec3 AP = target_position - position.previous_position;
+            glm::dvec2 miss = position - plane.target;
+            if(glm::dot(miss, velocity) <= 0.0){
+                distance = std::sqrt(glm::dot(miss, miss) + plane.offset2);
+                if(distance >= HIT_TRASHOLD){
+                    return terrain && groundedPlanarStep(plane, previous_position, position, time, delta_time, result);
+                }
+            }
+            if(!world){
+                lifted = {plane.lift(position), plane.lift(previous_position)};
+                current_velocity = plane.liftVelocity(velocity);
+            }
+            return classifyStep(lifted, plane.liftVelocity(previous_velocity), current_velocity, time, delta_time, distance, result);
+        }
 
-                double t = glm::dot(AP, AB) / glm::dot(AB, AB);
-                glm::dvec3 nearest_point = position.previous_position + glm::clamp(t, 0.0, 1.0) * AB;
+        //World point in the frame of the terrain: height along UP_VECTOR, grid x along world x laid flat
+        //(world z when UP_VECTOR is close to x) and grid z completing the frame. Unchanged when y is up.
+        static glm::dvec3 toTerrain(const glm::dvec3& point){
+            if(UP_VECTOR == glm::dvec3(0.0, 1.0, 0.0)){
+                return point;
+            }
+            glm::dvec3 up = glm::normalize(UP_VECTOR);
+            glm::dvec3 axis = std::abs(up.x) < 0.9 ? glm::dvec3(1.0, 0.0, 0.0) : glm::dvec3(0.0, 0.0, 1.0);
+            glm::dvec3 east = glm::normalize(axis - glm::dot(axis, up) * up);
+            glm::dvec3 north = glm::cross(east, up);
+            return glm::dvec3(glm::dot(point, east), glm::dot(point, up), glm::dot(point, north));
+        }
 
-                double distance = glm::length(target_position - nearest_point);
+        bool intersectTerrain(const glm::dvec3& a, const glm::dvec3& b, double& impact) const{
+            return terrain && terrain->intersect(toTerrain(a), toTerrain(b), impact);
+        }
 
-                if(distance < HIT_TRASHOLD){
-                    return {ShotResultEnum::HIT, distance, time};
-                }
-                //I assume that I want to hit the target as directly as possible, without considering a higher arc trajectory.
-                if(t<1.0){
-                
-                    //if air density is not 0, can be wrong
-                    if(glm::dot(target_position - nearest_point, UP_VECTOR) < 0.0){
-                        return {ShotResultEnum::TOO_HIGH, distance, time};
-                    }
-                    return {ShotResultEnum::TOO_LOW, distance, time};
-                }
+        //terrain test of a planar step still closing in on the target, where it is the only way the step ends
+        bool groundedPlanarStep(const Plane& plane, const glm::dvec2& previous_position, const glm::dvec2& position, double time, double delta_time,
+                                ShotResult& result) const{
+            glm::dvec3 up = glm::normalize(UP_VECTOR);
+            double downrange = glm::dot(plane.downrange, up);
+            double vertical = glm::dot(plane.up, up);
+            double low = glm::dot(plane.origin, up) + std::min(downrange * previous_position.x + vertical * previous_position.y,
+                                                              downrange * position.x + vertical * position.y);
+            if(low > terrain->maxHeight()){
+                return false;
+            }
+            glm::dvec3 a = plane.lift(previous_position);
+            glm::dvec3 b = plane.lift(position);
+            double impact;
+            if(!intersectTerrain(a, b, impact)){
+                return false;
+            }
+            result = terrainResult(a, b, impact, time, delta_time);
+            return true;
+        }
+
+        entt::entity launch(entt::registry& registry, const glm::dvec3& velocity) const{
+            auto projectile = registry.create();
+            registry.emplace<Position>(projectile, shooter_position);
+            registry.emplace<Velocity>(projectile, velocity);
+            registry.emplace<Mass>(projectile, Mass{shoot_height, AIR_RESISTANCE});
+            if(isSpinning()){
+                registry.emplace<Spin>(projectile, Spin{spin_rate, glm::dvec3(0.0)});
+                registry.emplace<Aerodynamics>(projectile, aerodynamics);
+            }
+            return projectile;
+        }
 
-                min_distance = distance;
+        void finishShot(PendingShot& shot, const ShotResult& result){
+            shot.result = result;
+            shot.finished = true;
+            shot.registry.clear();
+            if constexpr (Instrumentation::ENABLED){
+                Instrumentation::recordShot(shot.steps, shot.ns);
             }
+            if(shot.store){
+                cache->storeShot(shot.key, result);
+            }
+        }
 
-            return {ShotResultEnum::NO_TIME, min_distance, time};
+        //rejects targets outside the reachability envelope before any shot is simulated
+        template<typename Solve>
+        StrategyResult checkedStrategy(const char* name, Solve solve){
+            Reachability::Verdict verdict = precheckTarget(name);
+            if(verdict == Reachability::UNREACHABLE){
+                return unreachableResult();
+            }
+            StrategyResult result = solve();
+            result.marginal = verdict == Reachability::MARGINAL;
+            return result;
         }
-        
-    private:
+
+        //everything a shot depends on, including the static environment
+        ShotCache::Key cacheKey(ShotCache::Kind kind, double angle) const{
+            const ShotCache::Tolerances& tolerances = cache->tolerances;
+            return ShotCache::KeyBuilder(kind)
+                .add(shooter_position.x, tolerances.position)
+                .add(shooter_position.y, tolerances.position)
+                .add(shooter_position.z, tolerances.position)
+                .add(target_position.x, tolerances.position)
+                .add(target_position.y, tolerances.position)
+                .add(target_position.z, tolerances.position)
+                .add(shoot_speed, tolerances.speed)
+                .add(shoot_height, tolerances.mass)
+                .add(delta_time, tolerances.delta_time)
+                .add(angle, tolerances.angle)
+                .add(Physics::GRAVITY.x, tolerances.environment)
+                .add(Physics::GRAVITY.y, tolerances.environment)
+                .add(Physics::GRAVITY.z, tolerances.environment)
+                .add(Physics::AIR_DENSITY, tolerances.environment)
+                .add(Physics::INTEGRATOR)
+                .add(Physics::MODEL)
+                .add(isSpinning() ? aerodynamics.diameter : 0.0)
+                .add(isSpinning() ? aerodynamics.axial_inertia : 0.0)
+                .add(isSpinning() ? aerodynamics.lift : 0.0)
+                .add(isSpinning() ? aerodynamics.overturning : 0.0)
+                .add(isSpinning() ? aerodynamics.magnus : 0.0)
+                .add(isSpinning() ? aerodynamics.spin_damping : 0.0)
+                .add(isSpinning() ? spin_rate : 0.0)
+                .add(AIR_RESISTANCE, tolerances.environment)
+                .add(UP_VECTOR.x, tolerances.environment)
+                .add(UP_VECTOR.y, tolerances.environment)
+                .add(UP_VECTOR.z, tolerances.environment)
+                .add(HIT_TRASHOLD)
+                .add(MAX_SIMULATION_TIME)
+                .add(MAX_TRIES)
+                .add(usesPrecheck())
+                .add(PLANAR)
+                .add(MULTIRES_LEVELS)
+                .add(MULTIRES_ITERATIONS)
+                .add(MULTIRES_MAX_DELTA_TIME)
+                .add(KARY_WIDTH)
+                .add(terrain ? (double)terrain->getId() : 0.0)
+                .build();
+        }
+
+        ShotCache* cache = nullptr;
+        const Terrain* terrain = nullptr;
+        Aerodynamics aerodynamics = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        double spin_rate = 0.0;
+        bool precheck = true;
         glm::dvec3 shooter_position;
         glm::dvec3 target_position;
         double shoot_speed;
@@ -260,4 +911,13 @@ double Simulation::HIT_TRASHOLD = 0.0000001;
 double Simulation::MAX_SIMULATION_TIME = 100.0;
 double Simulation::AIR_RESISTANCE = 0.01;
 glm::dvec3 Simulation::UP_VECTOR = -glm::normalize(Physics::GRAVITY);
-uint32_t Simulation::MAX_TRIES = 1000;
\ No newline at end of file
+uint32_t Simulation::MAX_TRIES = 1000;
+bool Simulation::REACHABILITY_PRECHECK = true;
+bool Simulation::PLANAR = true;
+int Simulation::MULTIRES_LEVELS = 6;
+int Simulation::MULTIRES_ITERATIONS = 4;
+int Simulation::KARY_WIDTH = 7;
+double Simulation::MULTIRES_MAX_DELTA_TIME = 0.05;
+
+//find_angle runs the strategies of ResumableSolve
+#include "resumable.hpp"
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Heightfield terrain on a regular grid in the x/z plane, heights along y; Simulation maps world points
+//into this frame through UP_VECTOR.
+//A min/max pyramid over the cells lets a segment high above the ground be rejected, and one deep
+//under it be answered, after looking at a handful of coarse nodes; only segments that come near the
+//surface are split down to single cells and intersected exactly with the bilinear surface.
+class Terrain {
+    public:
+        //segment splits before falling back to walking the cells it crosses
+        static int MAX_SPLIT_DEPTH;
+
+        //pieces of a segment walked at once, a range that crosses more grid lines is halved first
+        static constexpr int MAX_BREAKS = 16;
+
+        Terrain(int width, int depth, double cell_size, double origin_x, double origin_z, std::vector<double> heights) :
+            width(width), depth(depth), cell_size(cell_size), origin_x(origin_x), origin_z(origin_z), heights(std::move(heights)), id(nextId()) {
+            if(width < 2 || depth < 2 || cell_size <= 0.0 || this->heights.size() != (size_t)width * depth){
+                throw std::invalid_argument("Terrain needs at least 2x2 samples, a positive cell size and width * depth heights");
+            }
+            buildPyramid();
+        }
+
+        //text file: width depth cell_size origin_x origin_z, then width * depth heights row by row (z major)
+        static Terrain load(const std::string& path){
+            std::ifstream file(path);
+            if(!file){
+                throw std::runtime_error("Cannot open terrain file " + path);
+            }
+            int width = 0;
+            int depth = 0;
+            double cell_size = 0.0;
+            double origin_x = 0.0;
+            double origin_z = 0.0;
+            if(!(file >> width >> depth >> cell_size >> origin_x >> origin_z) || width < 2 || depth < 2){
+                throw std::runtime_error("Invalid terrain header in " + path);
+            }
+            std::vector<double> heights((size_t)width * depth);
+            for(double& height : heights){
+                if(!(file >> height)){
+                    throw std::runtime_error("Not enough terrain heights in " + path);
+                }
+            }
+            return Terrain(width, depth, cell_size, origin_x, origin_z, std::move(heights));
+        }
+
+        //bilinear height, -infinity outside the grid
+        double height(double x, double z) const{
+            double gx = (x - origin_x) / cell_size;
+            double gz = (z - origin_z) / cell_size;
+            if(gx < 0.0 || gz < 0.0 || gx > width - 1 || gz > depth - 1){
+                return -std::numeric_limits<double>::infinity();
+            }
+            int i = std::min((int)gx, width - 2);
+            int j = std::min((int)gz, depth - 2);
+            double fx = gx - i;
+            double fz = gz - j;
+            return sample(i, j) * (1.0 - fx) * (1.0 - fz) + sample(i + 1, j) * fx * (1.0 - fz)
+                 + sample(i, j + 1) * (1.0 - fx) * fz + sample(i + 1, j + 1) * fx * fz;
+        }
+
+        //First point where the segment a->b goes under the surface, as a fraction of the segment.
+        //A segment that starts under the surface hits at 0, one that only touches it does not hit.
+        bool intersect(const glm::dvec3& a, const glm::dvec3& b, double& fraction) const{
+            return intersectRange(a, b, 0.0, 1.0, 0, fraction);
+        }
+
+        double minHeight() const{
+            return levels.back().min[0];
+        }
+
+        double maxHeight() const{
+            return levels.back().max[0];
+        }
+
+        int getWidth() const{
+            return width;
+        }
+
+        int getDepth() const{
+            return depth;
+        }
+
+        double getCellSize() const{
+            return cell_size;
+        }
+
+        //distinct for every terrain built, used to key cached shots
+        uint64_t getId() const{
+            return id;
+        }
+
+    private:
+        struct Level{
+            int width;
+            int depth;
+            std::vector<double> min;
+            std::vector<double> max;
+        };
+
+        double sample(int i, int j) const{
+            return heights[(size_t)j * width + i];
+        }
+
+        void buildPyramid(){
+            Level base = {width - 1, depth - 1, {}, {}};
+            base.min.resize((size_t)base.width * base.depth);
+            base.max.resize(base.min.size());
+            for(int j = 0; j < base.depth; j++){
+                for(int i = 0; i < base.width; i++){
+                    double h00 = sample(i, j), h10 = sample(i + 1, j), h01 = sample(i, j + 1), h11 = sample(i + 1, j + 1);
+                    base.min[(size_t)j * base.width + i] = std::min(std::min(h00, h10), std::min(h01, h11));
+                    base.max[(size_t)j * base.width + i] = std::max(std::max(h00, h10), std::max(h01, h11));
+                }
+            }
+            levels.push_back(std::move(base));
+
+            while(levels.back().width > 1 || levels.back().depth > 1){
+                const Level& fine = levels.back();
+                Level coarse = {(fine.width + 1) / 2, (fine.depth + 1) / 2, {}, {}};
+                coarse.min.assign((size_t)coarse.width * coarse.depth, std::numeric_limits<double>::infinity());
+                coarse.max.assign(coarse.min.size(), -std::numeric_limits<double>::infinity());
+                for(int j = 0; j < fine.depth; j++){
+                    for(int i = 0; i < fine.width; i++){
+                        size_t node = (size_t)(j / 2) * coarse.width + i / 2;
+                        coarse.min[node] = std::min(coarse.min[node], fine.min[(size_t)j * fine.width + i]);
+                        coarse.max[node] = std::max(coarse.max[node], fine.max[(size_t)j * fine.width + i]);
+                    }
+                }
+                levels.push_back(std::move(coarse));
+            }
+        }
+
+        //min and max height over the cells i0..i1 x j0..j1, read from the level where the range spans at most 2x2 nodes
+        void heightRange(int i0, int j0, int i1, int j1, double& low, double& high) const{
+            size_t level = 0;
+            while(level + 1 < levels.size() && ((i1 >> level) - (i0 >> level) > 1 || (j1 >> level) - (j0 >> level) > 1)){
+                level++;
+            }
+            const Level& nodes = levels[level];
+            low = std::numeric_limits<double>::infinity();
+            high = -std::numeric_limits<double>::infinity();
+            for(int j = j0 >> level; j <= (j1 >> level); j++){
+                for(int i = i0 >> level; i <= (i1 >> level); i++){
+                    low = std::min(low, nodes.min[(size_t)j * nodes.width + i]);
+                    high = std::max(high, nodes.max[(size_t)j * nodes.width + i]);
+                }
+            }
+        }
+
+        bool intersectRange(const glm::dvec3& a, const glm::dvec3& b, double t0, double t1, int split, double& fraction) const{
+            glm::dvec3 p0 = a + (b - a) * t0;
+            glm::dvec3 p1 = a + (b - a) * t1;
+
+            double gx0 = (std::min(p0.x, p1.x) - origin_x) / cell_size;
+            double gx1 = (std::max(p0.x, p1.x) - origin_x) / cell_size;
+            double gz0 = (std::min(p0.z, p1.z) - origin_z) / cell_size;
+            double gz1 = (std::max(p0.z, p1.z) - origin_z) / cell_size;
+            if(gx1 < 0.0 || gz1 < 0.0 || gx0 > width - 1 || gz0 > depth - 1){
+                return false;
+            }
+            int i0 = glm::clamp((int)std::floor(gx0), 0, width - 2);
+            int i1 = glm::clamp((int)std::floor(gx1), 0, width - 2);
+            int j0 = glm::clamp((int)std::floor(gz0), 0, depth - 2);
+            int j1 = glm::clamp((int)std::floor(gz1), 0, depth - 2);
+
+            double low, high;
+            heightRange(i0, j0, i1, j1, low, high);
+            if(std::min(p0.y, p1.y) > high){
+                return false;
+            }
+            //wholly over the grid and under its lowest cell, the range is under the surface from its start
+            bool inside = gx0 >= 0.0 && gz0 >= 0.0 && gx1 <= width - 1 && gz1 <= depth - 1;
+            if(inside && std::max(p0.y, p1.y) < low){
+                fraction = t0;
+                return true;
+            }
+            if((i1 - i0 <= 1 && j1 - j0 <= 1) || split >= MAX_SPLIT_DEPTH){
+                return intersectCells(a, b, t0, t1, fraction);
+            }
+            double middle = 0.5 * (t0 + t1);
+            return intersectRange(a, b, t0, middle, split + 1, fraction) || intersectRange(a, b, middle, t1, split + 1, fraction);
+        }
+
+        //walks the cells crossed between t0 and t1, inside a cell the height along the segment is quadratic
+        bool intersectCells(const glm::dvec3& a, const glm::dvec3& b, double t0, double t1, double& fraction) const{
+            glm::dvec3 d = b - a;
+            double breaks[MAX_BREAKS] = {t0, t1};
+            int count = 2;
+            if(!addGridCrossings(a.x, d.x, origin_x, width - 1, t0, t1, breaks, count) || !addGridCrossings(a.z, d.z, origin_z, depth - 1, t0, t1, breaks, count)){
+                double middle = 0.5 * (t0 + t1);
+                return intersectCells(a, b, t0, middle, fraction) || intersectCells(a, b, middle, t1, fraction);
+            }
+            std::sort(breaks, breaks + count);
+
+            for(int k = 0; k + 1 < count; k++){
+                double u0 = breaks[k];
+                double u1 = breaks[k + 1];
+                if(u1 <= u0){
+                    continue;
+                }
+                glm::dvec3 middle = a + d * (0.5 * (u0 + u1));
+                double gx = (middle.x - origin_x) / cell_size;
+                double gz = (middle.z - origin_z) / cell_size;
+                if(gx < 0.0 || gz < 0.0 || gx > width - 1 || gz > depth - 1){
+                    continue;
+                }
+                int i = std::min((int)gx, width - 2);
+                int j = std::min((int)gz, depth - 2);
+                if(intersectCell(a, d, i, j, u0, u1, fraction)){
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //grid lines 0..last crossed between t0 and t1, the ones outside the grid only split pieces that are skipped
+        //anyway; false when breaks is full
+        bool addGridCrossings(double start, double delta, double origin, int last, double t0, double t1, double* breaks, int& count) const{
+            if(delta == 0.0){
+                return true;
+            }
+            double g0 = (start + delta * t0 - origin) / cell_size;
+            double g1 = (start + delta * t1 - origin) / cell_size;
+            double first = std::max(std::ceil(std::min(g0, g1)), 0.0);
+            double end = std::min(std::floor(std::max(g0, g1)), (double)last);
+            for(double line = first; line <= end; line++){
+                double t = (origin + line * cell_size - start) / delta;
+                if(t > t0 && t < t1){
+                    if(count == MAX_BREAKS){
+                        return false;
+                    }
+                    breaks[count++] = t;
+                }
+            }
+            return true;
+        }
+
+        //clearance y(t) - h(t) over one cell is a quadratic, the first root after which it is negative is the impact
+        bool intersectCell(const glm::dvec3& a, const glm::dvec3& d, int i, int j, double u0, double u1, double& fraction) const{
+            double h00 = sample(i, j), h10 = sample(i + 1, j), h01 = sample(i, j + 1), h11 = sample(i + 1, j + 1);
+            double k1 = h10 - h00;
+            double k2 = h01 - h00;
+            double k3 = h00 - h10 - h01 + h11;
+            double px = (a.x - origin_x) / cell_size - i;
+            double pz = (a.z - origin_z) / cell_size - j;
+            double qx = d.x / cell_size;
+            double qz = d.z / cell_size;
+
+            double c0 = a.y - (h00 + k1 * px + k2 * pz + k3 * px * pz);
+            double c1 = d.y - (k1 * qx + k2 * qz + k3 * (px * qz + pz * qx));
+            double c2 = -k3 * qx * qz;
+            auto clearance = [&](double t){
+                return c0 + (c1 + c2 * t) * t;
+            };
+
+            if(clearance(u0) < 0.0){
+                fraction = u0;
+                return true;
+            }
+
+            double roots[2] = {0.0, 0.0};
+            int count = 0;
+            if(std::abs(c2) < 1e-12 * (std::abs(c1) + std::abs(c0) + 1e-300)){
+                if(c1 != 0.0){
+                    roots[count++] = -c0 / c1;
+                }
+            } else {
+                double discriminant = c1 * c1 - 4.0 * c2 * c0;
+                if(discriminant >= 0.0){
+                    double q = -0.5 * (c1 + std::copysign(std::sqrt(discriminant), c1));
+                    roots[count++] = q / c2;
+                    if(q != 0.0){
+                        roots[count++] = c0 / q;
+                    }
+                    if(count == 2 && roots[1] < roots[0]){
+                        std::swap(roots[0], roots[1]);
+                    }
+                }
+            }
+
+            for(int r = 0; r < count; r++){
+                if(roots[r] < u0 || roots[r] > u1){
+                    continue;
+                }
+                double next = r + 1 < count ? std::min(roots[r + 1], u1) : u1;
+                if(next > roots[r] && clearance(0.5 * (roots[r] + next)) < 0.0){
+                    fraction = roots[r];
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static uint64_t nextId(){
+            static std::atomic<uint64_t> counter{0};
+            return ++counter;
+        }
+
+        int width;
+        int depth;
+        double cell_size;
+        double origin_x;
+        double origin_z;
+        std::vector<double> heights;
+        std::vector<Level> levels;
+        uint64_t id;
+};
+
+int Terrain::MAX_SPLIT_DEPTH = 32;
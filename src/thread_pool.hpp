@@ -0,0 +1,111 @@
+#pragma once
+
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Fixed size worker pool. Threads waiting on a result help by running queued tasks,
+//so work submitted from inside a task can never starve the pool.
+class ThreadPool {
+    public:
+        ThreadPool(unsigned threads = std::max(1u, std::thread::hardware_concurrency())){
+            for(unsigned i = 0; i < threads; i++){
+                workers.emplace_back([this, i](){
+                    Trace::setThreadName("pool worker " + std::to_string(i));
+                    while(true){
+                        std::function<void()> task;
+                        {
+                            Trace::Scope idle("queue_wait", "pool");
+                            std::unique_lock<std::mutex> lock(mutex);
+                            condition.wait(lock, [this](){ return stopping || !tasks.empty(); });
+                            if(tasks.empty()){
+                                return;
+                            }
+                            task = std::move(tasks.front());
+                            tasks.pop_front();
+                        }
+                        task();
+                    }
+                });
+            }
+        }
+
+        ~ThreadPool(){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            condition.notify_all();
+            for(auto& worker : workers){
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        template<typename F>
+        auto submit(F function) -> std::future<decltype(function())>{
+            typedef decltype(function()) Result;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+            std::future<Result> future = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.emplace_back([task](){ (*task)(); });
+            }
+            condition.notify_one();
+            return future;
+        }
+
+        template<typename T>
+        T wait(std::future<T>& future){
+            Trace::Scope trace("wait", "pool");
+            while(future.wait_for(std::chrono::seconds(0)) != std::future_status::ready){
+                if(!runPendingTask()){
+                    future.wait_for(std::chrono::microseconds(50));
+                }
+            }
+            return future.get();
+        }
+
+        //runs one queued task on the calling thread, false when the queue is empty
+        bool runPendingTask(){
+            std::function<void()> task;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(tasks.empty()){
+                    return false;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+            return true;
+        }
+
+        size_t size() const{
+            return workers.size();
+        }
+
+        //process wide pool shared by the solvers
+        static ThreadPool& shared(){
+            static ThreadPool pool;
+            return pool;
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+};
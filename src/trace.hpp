@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//compiled out together with the counters
+#ifndef BALLISTICS_INSTRUMENTATION
+#define BALLISTICS_INSTRUMENTATION 1
+#endif
+
+//Timeline of scoped events in the Chrome Trace Event format, for chrome://tracing and Perfetto.
+//Every thread appends complete events to a fixed buffer of its own without a lock: only the owner
+//writes, and it publishes the count with a release store that the exporter reads with acquire.
+//Recording is switched at run time and a scope costs one relaxed load while it is off. A full buffer
+//drops further events and counts them. start() and clear() only bump an epoch, each thread empties
+//its own buffer when it records the next event; the control calls are serialised with each other.
+class Trace {
+    public:
+        static constexpr bool ENABLED = BALLISTICS_INSTRUMENTATION != 0;
+        static size_t CAPACITY; //events per thread
+
+        typedef std::chrono::steady_clock Clock;
+
+        struct Event{
+            const char* name; //string literals only, they are kept by pointer
+            const char* category;
+            uint64_t start_ns;
+            uint64_t duration_ns;
+            const char* arg_name; //nullptr for none
+            int64_t arg;
+        };
+
+        class Scope{
+            public:
+                Scope(const char* name, const char* category){
+                    if constexpr (ENABLED){
+                        if(recording()){
+                            active = true;
+                            event = {name, category, now(), 0, nullptr, 0};
+                        }
+                    }
+                }
+                ~Scope(){
+                    if constexpr (ENABLED){
+                        if(active){
+                            event.duration_ns = now() - event.start_ns;
+                            record(event);
+                        }
+                    }
+                }
+                void arg(const char* name, int64_t value){
+                    if constexpr (ENABLED){
+                        event.arg_name = name;
+                        event.arg = value;
+                    }
+                }
+            private:
+                bool active = false;
+                Event event;
+        };
+
+        static bool recording(){
+            return ENABLED && flag().load(std::memory_order_relaxed);
+        }
+
+        static void start(){
+            std::lock_guard<std::mutex> lock(controlMutex());
+            epoch().fetch_add(1, std::memory_order_acq_rel);
+            flag().store(true, std::memory_order_release);
+        }
+
+        static void stop(){
+            std::lock_guard<std::mutex> lock(controlMutex());
+            flag().store(false, std::memory_order_release);
+        }
+
+        static void clear(){
+            std::lock_guard<std::mutex> lock(controlMutex());
+            epoch().fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        //shown as the track name, the thread id otherwise
+        static void setThreadName(const std::string& name){
+            if constexpr (ENABLED){
+                Buffer& buffer = threadBuffer();
+                std::lock_guard<std::mutex> lock(buffer.name_mutex);
+                buffer.name = name;
+            }
+        }
+
+        static void record(const Event& event){
+            Buffer& buffer = threadBuffer();
+            uint64_t current = epoch().load(std::memory_order_acquire);
+            if(buffer.epoch.load(std::memory_order_relaxed) != current){
+                //allocated on the first event, published by the epoch store below
+                if(!buffer.events){
+                    buffer.events.reset(new Event[buffer.capacity]);
+                }
+                buffer.count.store(0, std::memory_order_relaxed);
+                buffer.dropped.store(0, std::memory_order_relaxed);
+                buffer.epoch.store(current, std::memory_order_release);
+            }
+            size_t count = buffer.count.load(std::memory_order_relaxed);
+            if(count >= buffer.capacity){
+                buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            buffer.events[count] = event;
+            buffer.count.store(count + 1, std::memory_order_release);
+        }
+
+        struct Snapshot{
+            struct Thread{
+                uint32_t id;
+                std::string name;
+                std::vector<Event> events;
+            };
+            std::vector<Thread> threads;
+            uint64_t dropped = 0;
+
+            size_t events() const{
+                size_t count = 0;
+                for(const Thread& thread : threads){
+                    count += thread.events.size();
+                }
+                return count;
+            }
+        };
+
+        //copies what every thread recorded since the last start() or clear()
+        static Snapshot snapshot(){
+            std::lock_guard<std::mutex> lock(controlMutex());
+            return collect();
+        }
+
+        static std::string toJson(const Snapshot& snapshot){
+            std::string out = "{\"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped\": " + std::to_string(snapshot.dropped) + "}, \"traceEvents\": [";
+            char line[512];
+            bool first = true;
+            for(const Snapshot::Thread& thread : snapshot.threads){
+                std::string name = thread.name.empty() ? "thread " + std::to_string(thread.id) : thread.name;
+                std::snprintf(line, sizeof(line), "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+                    first ? "" : ",", thread.id, escape(name).c_str());
+                out += line;
+                first = false;
+                for(const Event& event : thread.events){
+                    std::snprintf(line, sizeof(line), ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+                        event.name, event.category, thread.id, event.start_ns / 1000.0, event.duration_ns / 1000.0);
+                    out += line;
+                    if(event.arg_name){
+                        std::snprintf(line, sizeof(line), ", \"args\": {\"%s\": %lld}", event.arg_name, (long long)event.arg);
+                        out += line;
+                    }
+                    out += "}";
+                }
+            }
+            out += "\n]}\n";
+            return out;
+        }
+
+        static bool writeJson(const std::string& path){
+            std::ofstream file(path);
+            if(!file){
+                return false;
+            }
+            file << toJson(snapshot());
+            return (bool)file;
+        }
+
+    private:
+        struct Buffer{
+            std::unique_ptr<Event[]> events;
+            size_t capacity;
+            std::atomic<size_t> count{0};
+            std::atomic<uint64_t> epoch{0};
+            std::atomic<uint64_t> dropped{0};
+            uint32_t id;
+            std::mutex name_mutex;
+            std::string name;
+        };
+
+        static Snapshot collect(){
+            Snapshot snapshot;
+            uint64_t current = epoch().load(std::memory_order_acquire);
+            std::lock_guard<std::mutex> lock(registryMutex());
+            for(const auto& buffer : buffers()){
+                //a buffer still on an old epoch has recorded nothing since
+                if(buffer->epoch.load(std::memory_order_acquire) != current){
+                    continue;
+                }
+                size_t count = buffer->count.load(std::memory_order_acquire);
+                Snapshot::Thread thread;
+                thread.id = buffer->id;
+                {
+                    std::lock_guard<std::mutex> name_lock(buffer->name_mutex);
+                    thread.name = buffer->name;
+                }
+                thread.events.assign(buffer->events.get(), buffer->events.get() + count);
+                snapshot.dropped += buffer->dropped.load(std::memory_order_relaxed);
+                snapshot.threads.push_back(std::move(thread));
+            }
+            return snapshot;
+        }
+
+        static uint64_t now(){
+            static const Clock::time_point origin = Clock::now();
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin).count();
+        }
+
+        static std::string escape(const std::string& text){
+            std::string escaped;
+            for(char c : text){
+                if(c == '"' || c == '\\'){
+                    escaped += '\\';
+                }
+                escaped += (unsigned char)c < 0x20 ? ' ' : c;
+            }
+            return escaped;
+        }
+
+        static std::atomic<bool>& flag(){
+            static std::atomic<bool> flag{false};
+            return flag;
+        }
+
+        //starts at 1 so a fresh buffer (epoch 0) never counts as current
+        static std::atomic<uint64_t>& epoch(){
+            static std::atomic<uint64_t> epoch{1};
+            return epoch;
+        }
+
+        static std::mutex& controlMutex(){
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static std::mutex& registryMutex(){
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        //buffers outlive their threads so the timeline of a finished worker can still be written
+        static std::vector<std::shared_ptr<Buffer>>& buffers(){
+            static std::vector<std::shared_ptr<Buffer>> buffers;
+            return buffers;
+        }
+
+        static Buffer& threadBuffer(){
+            thread_local std::shared_ptr<Buffer> buffer = [](){
+                auto buffer = std::make_shared<Buffer>();
+                buffer->capacity = std::max<size_t>(1, CAPACITY);
+                std::lock_guard<std::mutex> lock(registryMutex());
+                buffer->id = (uint32_t)buffers().size() + 1;
+                buffers().push_back(buffer);
+                return buffer;
+            }();
+            return *buffer;
+        }
+};
+
+size_t Trace::CAPACITY = 1 << 16;
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <deque>
+
+//Time stamped positions of a moving target and a predictor fitted to the last WINDOW of them by least
+//squares: position and velocity, plus acceleration for CONSTANT_ACCELERATION, expanded around the latest
+//observation. With too few observations for the model the fit drops to the next simpler one.
+class Track {
+    public:
+        static size_t WINDOW;
+
+        enum Model{
+            CONSTANT_VELOCITY,
+            CONSTANT_ACCELERATION
+        };
+
+        struct Observation{
+            double time;
+            glm::dvec3 position;
+        };
+
+        Track(Model model = CONSTANT_VELOCITY) : model(model){}
+
+        //observations older than the latest one are dropped
+        void observe(double time, const glm::dvec3& position){
+            if(!observations.empty() && time <= observations.back().time){
+                return;
+            }
+            observations.push_back({time, position});
+            while(observations.size() > std::max<size_t>(1, WINDOW)){
+                observations.pop_front();
+            }
+            fit();
+        }
+
+        bool empty() const{
+            return observations.empty();
+        }
+
+        size_t size() const{
+            return observations.size();
+        }
+
+        Model getModel() const{
+            return model;
+        }
+
+        double lastTime() const{
+            return reference;
+        }
+
+        glm::dvec3 predict(double time) const{
+            double dt = time - reference;
+            return position + velocity * dt + 0.5 * acceleration * dt * dt;
+        }
+
+        glm::dvec3 predictVelocity(double time) const{
+            return velocity + acceleration * (time - reference);
+        }
+
+        const glm::dvec3& getAcceleration() const{
+            return acceleration;
+        }
+
+    private:
+        void fit(){
+            reference = observations.back().time;
+            position = observations.back().position;
+            velocity = glm::dvec3(0.0);
+            acceleration = glm::dvec3(0.0);
+            size_t count = observations.size();
+            if(count < 2){
+                return;
+            }
+
+            //normal equations of p(t) = c0 + c1 dt + c2 dt^2 / 2, dt from the latest observation
+            int terms = model == CONSTANT_ACCELERATION && count >= 3 ? 3 : 2;
+            glm::dmat3 normal(0.0);
+            glm::dmat3 right(0.0); //column per axis
+            for(const Observation& observation : observations){
+                double dt = observation.time - reference;
+                double basis[3] = {1.0, dt, 0.5 * dt * dt};
+                for(int i = 0; i < terms; i++){
+                    for(int j = 0; j < terms; j++){
+                        normal[j][i] += basis[i] * basis[j];
+                    }
+                    for(int axis = 0; axis < 3; axis++){
+                        right[axis][i] += basis[i] * observation.position[axis];
+                    }
+                }
+            }
+            if(terms == 2){
+                normal[2][2] = 1.0;
+            }
+            if(std::abs(glm::determinant(normal)) < 1e-300){
+                return;
+            }
+            glm::dmat3 coefficients = glm::inverse(normal) * right;
+            for(int axis = 0; axis < 3; axis++){
+                position[axis] = coefficients[axis][0];
+                velocity[axis] = coefficients[axis][1];
+                acceleration[axis] = coefficients[axis][2];
+            }
+        }
+
+        Model model;
+        std::deque<Observation> observations;
+        double reference = 0.0;
+        glm::dvec3 position = glm::dvec3(0.0);
+        glm::dvec3 velocity = glm::dvec3(0.0);
+        glm::dvec3 acceleration = glm::dvec3(0.0);
+};
+
+size_t Track::WINDOW = 16;
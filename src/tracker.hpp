@@ -0,0 +1,303 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "track.hpp"
+#include "intercept.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Re-solves the intercept of every active track once per period on its own worker threads. Each track
+//has one job at a time: it is released at the start of its period, must finish within the deadline
+//after that, and the ready jobs run earliest deadline first. A job that cannot make its deadline by
+//the track's average solve time is shed without solving and lowers that average as if it had cost
+//nothing, so a track that once ran long is tried again after a few periods. One that finishes late is
+//counted as a miss and its solution flagged. A track whose next period is already past its deadline
+//skips to the current one. Observation times and now() are seconds on the tracker's clock.
+class Tracker {
+    public:
+        static double COST_SMOOTHING; //weight of the latest solve in the average cost
+
+        typedef std::chrono::steady_clock Clock;
+
+        struct Settings{
+            glm::dvec3 shooter_position = glm::dvec3(0.0);
+            double shoot_speed = 100.0;
+            double shoot_height = 1.0;
+            double delta_time = 0.01;
+            const Terrain* terrain = nullptr;
+            double period = 0.1; //seconds between solves of the same track
+            double deadline = 0.1; //seconds after the release
+            unsigned threads = 1;
+            Intercept::Settings intercept;
+        };
+
+        struct Stats{
+            uint64_t solved = 0;
+            uint64_t missed = 0; //finished after the deadline
+            uint64_t shed = 0; //dropped before solving
+            uint64_t skipped = 0; //periods passed over while behind
+            double max_lateness = 0.0; //seconds
+            size_t tracks = 0;
+        };
+
+        struct Status{
+            Intercept::Solution solution;
+            double solved_at = 0.0;
+            bool late = false;
+            uint64_t solves = 0;
+        };
+
+        Tracker(const Settings& settings) : settings(settings), origin(Clock::now()) {}
+
+        ~Tracker(){
+            stop();
+        }
+
+        Tracker(const Tracker&) = delete;
+        Tracker& operator=(const Tracker&) = delete;
+
+        double now() const{
+            return std::chrono::duration<double>(Clock::now() - origin).count();
+        }
+
+        uint64_t addTrack(Track::Model model = Track::CONSTANT_VELOCITY){
+            std::lock_guard<std::mutex> lock(mutex);
+            uint64_t id = next_id++;
+            tracks[id] = std::make_shared<Entry>(model);
+            if(running){
+                release(id, now());
+            }
+            return id;
+        }
+
+        //a job of the track already running still finishes, its result is dropped
+        bool removeTrack(uint64_t id){
+            std::lock_guard<std::mutex> lock(mutex);
+            return tracks.erase(id) > 0;
+        }
+
+        bool observe(uint64_t id, double time, const glm::dvec3& position){
+            std::shared_ptr<Entry> entry = find(id);
+            if(!entry){
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            entry->track.observe(time, position);
+            return true;
+        }
+
+        //false for an unknown track
+        bool latest(uint64_t id, Status& status){
+            std::shared_ptr<Entry> entry = find(id);
+            if(!entry){
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            status = entry->status;
+            return true;
+        }
+
+        void start(){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(running){
+                return;
+            }
+            running = true;
+            double time = now();
+            for(const auto& track : tracks){
+                release(track.first, time);
+            }
+            for(unsigned i = 0; i < std::max(1u, settings.threads); i++){
+                workers.emplace_back([this, i](){
+                    Trace::setThreadName("tracker worker " + std::to_string(i));
+                    work();
+                });
+            }
+        }
+
+        void stop(){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!running){
+                    return;
+                }
+                running = false;
+            }
+            condition.notify_all();
+            for(auto& thread : workers){
+                thread.join();
+            }
+            workers.clear();
+            pending = JobQueue<Release>();
+            ready = JobQueue<Deadline>();
+        }
+
+        Stats stats(){
+            std::lock_guard<std::mutex> lock(mutex);
+            Stats result = counters;
+            result.tracks = tracks.size();
+            return result;
+        }
+
+    private:
+        struct Entry{
+            Entry(Track::Model model) : track(model) {}
+
+            std::mutex mutex; //track and status
+            Track track;
+            Status status;
+            double cost = 0.0; //average solve seconds, scheduler mutex
+        };
+
+        struct Job{
+            uint64_t id;
+            double release;
+            double deadline;
+        };
+
+        struct Release{
+            bool operator()(const Job& a, const Job& b) const{
+                return a.release > b.release;
+            }
+        };
+
+        struct Deadline{
+            bool operator()(const Job& a, const Job& b) const{
+                return a.deadline > b.deadline;
+            }
+        };
+
+        template<typename Order>
+        using JobQueue = std::priority_queue<Job, std::vector<Job>, Order>;
+
+        std::shared_ptr<Entry> find(uint64_t id){
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = tracks.find(id);
+            return it != tracks.end() ? it->second : nullptr;
+        }
+
+        //under the mutex
+        void release(uint64_t id, double time){
+            pending.push({id, time, time + settings.deadline});
+            condition.notify_one();
+        }
+
+        //next period of a job, skipping the ones whose deadline has already passed
+        void reschedule(const Job& job, double time){
+            double period = std::max(settings.period, 1e-6);
+            double next = job.release + period;
+            if(next + settings.deadline < time){
+                double behind = std::floor((time - settings.deadline - next) / period) + 1.0;
+                counters.skipped += (uint64_t)behind;
+                next += behind * period;
+            }
+            release(job.id, next);
+        }
+
+        void work(){
+            Simulation simulation(settings.shooter_position, settings.shooter_position, settings.shoot_speed, settings.shoot_height, settings.delta_time);
+            simulation.setTerrain(settings.terrain);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            while(running){
+                double time = now();
+                while(!pending.empty() && pending.top().release <= time){
+                    ready.push(pending.top());
+                    pending.pop();
+                }
+                if(ready.empty()){
+                    if(pending.empty()){
+                        condition.wait(lock);
+                    } else {
+                        condition.wait_for(lock, std::chrono::duration<double>(pending.top().release - time));
+                    }
+                    continue;
+                }
+
+                Job job = ready.top();
+                ready.pop();
+                auto it = tracks.find(job.id);
+                if(it == tracks.end()){
+                    continue;
+                }
+                std::shared_ptr<Entry> entry = it->second;
+                if(time + entry->cost > job.deadline){
+                    entry->cost -= COST_SMOOTHING * entry->cost;
+                    counters.shed++;
+                    reschedule(job, time);
+                    continue;
+                }
+
+                lock.unlock();
+                solve(simulation, *entry, job, time);
+                lock.lock();
+            }
+        }
+
+        //called without the scheduler mutex, takes it again to record the outcome
+        void solve(Simulation& simulation, Entry& entry, const Job& job, double started){
+            Trace::Scope trace("track", "tracker");
+            trace.arg("id", (int64_t)job.id);
+            Track track(Track::CONSTANT_VELOCITY);
+            Status previous;
+            {
+                std::lock_guard<std::mutex> lock(entry.mutex);
+                track = entry.track;
+                previous = entry.status;
+            }
+
+            bool solved = !track.empty();
+            Intercept::Solution solution;
+            if(solved){
+                solution = Intercept::solve(simulation, track, started, settings.intercept, previous.solves > 0 ? &previous.solution : nullptr);
+            }
+            double finished = now();
+            bool late = finished > job.deadline;
+            if(solved){
+                std::lock_guard<std::mutex> lock(entry.mutex);
+                entry.status.solution = solution;
+                entry.status.solved_at = finished;
+                entry.status.late = late;
+                entry.status.solves++;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if(solved){
+                entry.cost += COST_SMOOTHING * ((finished - started) - entry.cost);
+                counters.solved++;
+                if(late){
+                    counters.missed++;
+                    counters.max_lateness = std::max(counters.max_lateness, finished - job.deadline);
+                }
+            }
+            if(running && tracks.count(job.id)){
+                reschedule(job, finished);
+            }
+        }
+
+        Settings settings;
+        Clock::time_point origin;
+
+        std::mutex mutex; //everything below
+        std::condition_variable condition;
+        bool running = false;
+        uint64_t next_id = 1;
+        std::map<uint64_t, std::shared_ptr<Entry>> tracks;
+        JobQueue<Release> pending;
+        JobQueue<Deadline> ready;
+        Stats counters;
+        std::vector<std::thread> workers;
+};
+
+double Tracker::COST_SMOOTHING = 0.2;
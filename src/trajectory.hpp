@@ -0,0 +1,292 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+//Trajectory stored as sparse keyframes (time, position, velocity).
+//Between keyframes the path is the cubic Hermite spline through both end states,
+//so it can be sampled at any time or arc length without keeping every step.
+class Trajectory {
+    public:
+        struct Keyframe{
+            double time;
+            glm::dvec3 position;
+            glm::dvec3 velocity;
+        };
+
+        //max distance between the spline and the dropped steps it is checked against, which once a span
+        //is longer than CHECKED_STEPS are only a thinned subset of the steps it replaces
+        double tolerance;
+
+        //steps dropped from the open span that are kept to re-check longer spans against
+        static constexpr size_t CHECKED_STEPS = 32;
+
+        Trajectory(double tolerance = 0.001) : tolerance(tolerance) {}
+
+        void clear(){
+            keyframes.clear();
+            restartSpan();
+        }
+
+        //The last keyframe is provisional: it is replaced by the next step as long as the
+        //spline over the longer span still passes within tolerance of the state it drops and
+        //of a sample of the steps dropped before it. The sample is thinned to every other step
+        //whenever CHECKED_STEPS are kept, so a long span costs a bounded number of checks per
+        //step, and the steps between the sampled ones are not checked again.
+        void record(double time, const glm::dvec3& position, const glm::dvec3& velocity){
+            Keyframe keyframe = {time, position, velocity};
+            size_t count = keyframes.size();
+            if(count >= 2){
+                const Keyframe& start = keyframes[count - 2];
+                const Keyframe& pending = keyframes[count - 1];
+                auto within = [&](const Keyframe& step){
+                    return glm::length(Trajectory::position(start, keyframe, step.time) - step.position) <= tolerance;
+                };
+                if(within(pending) && std::all_of(dropped.begin(), dropped.end(), within)){
+                    drop(pending);
+                    keyframes[count - 1] = keyframe;
+                    return;
+                }
+            }
+            restartSpan();
+            keyframes.push_back(keyframe);
+        }
+
+        bool empty() const{
+            return keyframes.empty();
+        }
+
+        size_t size() const{
+            return keyframes.size();
+        }
+
+        const std::vector<Keyframe>& getKeyframes() const{
+            return keyframes;
+        }
+
+        double startTime() const{
+            return keyframes.empty() ? 0.0 : keyframes.front().time;
+        }
+
+        double endTime() const{
+            return keyframes.empty() ? 0.0 : keyframes.back().time;
+        }
+
+        //t is clamped to the recorded interval
+        glm::dvec3 position(double time) const{
+            if(keyframes.empty()){
+                return glm::dvec3(0.0);
+            }
+            time = glm::clamp(time, startTime(), endTime());
+            size_t i = segment(time);
+            if(i + 1 >= keyframes.size()){
+                return keyframes.back().position;
+            }
+            return position(keyframes[i], keyframes[i + 1], time);
+        }
+
+        glm::dvec3 velocity(double time) const{
+            if(keyframes.empty()){
+                return glm::dvec3(0.0);
+            }
+            time = glm::clamp(time, startTime(), endTime());
+            size_t i = segment(time);
+            if(i + 1 >= keyframes.size()){
+                return keyframes.back().velocity;
+            }
+            return velocity(keyframes[i], keyframes[i + 1], time);
+        }
+
+        std::vector<glm::dvec3> sampleByTime(double interval) const{
+            std::vector<glm::dvec3> samples;
+            if(keyframes.empty() || interval <= 0.0){
+                return samples;
+            }
+            double start = startTime();
+            size_t count = (size_t)((endTime() - start) / interval);
+            samples.reserve(count + 2);
+            for(size_t i = 0; i <= count; i++){
+                samples.push_back(position(start + i * interval));
+            }
+            if(start + count * interval < endTime()){
+                samples.push_back(keyframes.back().position);
+            }
+            return samples;
+        }
+
+        //points spaced evenly along the path, each span is measured on a fine polyline
+        std::vector<glm::dvec3> sampleByArcLength(double spacing, int subdivisions = 16) const{
+            std::vector<glm::dvec3> samples;
+            if(keyframes.empty() || spacing <= 0.0){
+                return samples;
+            }
+            samples.push_back(keyframes.front().position);
+            double travelled = 0.0;
+            glm::dvec3 previous = keyframes.front().position;
+            for(size_t i = 0; i + 1 < keyframes.size(); i++){
+                const Keyframe& a = keyframes[i];
+                const Keyframe& b = keyframes[i + 1];
+                for(int j = 1; j <= subdivisions; j++){
+                    glm::dvec3 current = position(a, b, a.time + (b.time - a.time) * j / subdivisions);
+                    double length = glm::length(current - previous);
+                    while(length > 0.0 && travelled + length >= spacing){
+                        double s = (spacing - travelled) / length;
+                        previous = previous + (current - previous) * s;
+                        samples.push_back(previous);
+                        length = glm::length(current - previous);
+                        travelled = 0.0;
+                    }
+                    travelled += length;
+                    previous = current;
+                }
+            }
+            if(travelled > 0.0){
+                samples.push_back(keyframes.back().position);
+            }
+            return samples;
+        }
+
+        static glm::dvec3 position(const Keyframe& a, const Keyframe& b, double time){
+            double h = b.time - a.time;
+            if(h <= 0.0){
+                return b.position;
+            }
+            double s = (time - a.time) / h;
+            double s2 = s * s;
+            double s3 = s2 * s;
+            return (2.0 * s3 - 3.0 * s2 + 1.0) * a.position
+                 + (s3 - 2.0 * s2 + s) * h * a.velocity
+                 + (-2.0 * s3 + 3.0 * s2) * b.position
+                 + (s3 - s2) * h * b.velocity;
+        }
+
+        static glm::dvec3 velocity(const Keyframe& a, const Keyframe& b, double time){
+            double h = b.time - a.time;
+            if(h <= 0.0){
+                return b.velocity;
+            }
+            double s = (time - a.time) / h;
+            double s2 = s * s;
+            return (6.0 * s2 - 6.0 * s) / h * a.position
+                 + (3.0 * s2 - 4.0 * s + 1.0) * a.velocity
+                 + (-6.0 * s2 + 6.0 * s) / h * b.position
+                 + (3.0 * s2 - 2.0 * s) * b.velocity;
+        }
+
+        //Time of closest approach to point on the spline between a and b. The root of the
+        //range rate (p(t) - point).p'(t) is found with Brent's method. While still closing in at b
+        //the answer is b, when already moving away at a it is a.
+        static double closestApproach(const Keyframe& a, const Keyframe& b, const glm::dvec3& point){
+            auto rate = [&](double time){
+                return glm::dot(position(a, b, time) - point, velocity(a, b, time));
+            };
+            double fb = rate(b.time);
+            if(fb <= 0.0){
+                return b.time;
+            }
+            double fa = rate(a.time);
+            if(fa >= 0.0){
+                return a.time;
+            }
+            return brent(rate, a.time, b.time, fa, fb, 1e-13 * std::max(1.0, std::abs(b.time)));
+        }
+
+        //root of f between x0 and x1, f(x0) and f(x1) of opposite sign
+        template<typename F>
+        static double brent(F f, double x0, double x1, double f0, double f1, double tolerance, int max_iterations = 100){
+            double a = x0, b = x1, c = x1;
+            double fa = f0, fb = f1, fc = f1;
+            double d = b - a, e = d;
+            for(int i = 0; i < max_iterations; i++){
+                if((fb > 0.0) == (fc > 0.0)){
+                    c = a;
+                    fc = fa;
+                    d = b - a;
+                    e = d;
+                }
+                if(std::abs(fc) < std::abs(fb)){
+                    a = b; b = c; c = a;
+                    fa = fb; fb = fc; fc = fa;
+                }
+                double tol = 2.0 * std::numeric_limits<double>::epsilon() * std::abs(b) + 0.5 * tolerance;
+                double m = 0.5 * (c - b);
+                if(std::abs(m) <= tol || fb == 0.0){
+                    return b;
+                }
+                if(std::abs(e) >= tol && std::abs(fa) > std::abs(fb)){
+                    //inverse quadratic interpolation, secant when only two points are distinct
+                    double s = fb / fa;
+                    double p, q;
+                    if(a == c){
+                        p = 2.0 * m * s;
+                        q = 1.0 - s;
+                    } else {
+                        double r = fb / fc;
+                        double t = fa / fc;
+                        p = s * (2.0 * m * t * (t - r) - (b - a) * (r - 1.0));
+                        q = (t - 1.0) * (r - 1.0) * (s - 1.0);
+                    }
+                    if(p > 0.0){
+                        q = -q;
+                    } else {
+                        p = -p;
+                    }
+                    if(2.0 * p < std::min(3.0 * m * q - std::abs(tol * q), std::abs(e * q))){
+                        e = d;
+                        d = p / q;
+                    } else {
+                        d = m;
+                        e = d;
+                    }
+                } else {
+                    d = m;
+                    e = d;
+                }
+                a = b;
+                fa = fb;
+                b += std::abs(d) > tol ? d : (m > 0.0 ? tol : -tol);
+                fb = f(b);
+            }
+            return b;
+        }
+
+    private:
+        //index of the keyframe starting the span that contains time
+        size_t segment(double time) const{
+            auto it = std::upper_bound(keyframes.begin(), keyframes.end(), time, [](double t, const Keyframe& keyframe){
+                return t < keyframe.time;
+            });
+            if(it == keyframes.begin()){
+                return 0;
+            }
+            return std::min((size_t)(it - keyframes.begin()) - 1, keyframes.size() - 1);
+        }
+
+        void restartSpan(){
+            dropped.clear();
+            dropped_count = 0;
+            dropped_stride = 1;
+        }
+
+        void drop(const Keyframe& step){
+            if(dropped_count++ % dropped_stride == 0){
+                dropped.push_back(step);
+            }
+            if(dropped.size() >= CHECKED_STEPS){
+                for(size_t i = 0; 2 * i < dropped.size(); i++){
+                    dropped[i] = dropped[2 * i];
+                }
+                dropped.resize((dropped.size() + 1) / 2);
+                dropped_stride *= 2;
+            }
+        }
+
+        std::vector<Keyframe> keyframes;
+        //steps dropped since the last fixed keyframe, every dropped_stride-th one
+        std::vector<Keyframe> dropped;
+        size_t dropped_count = 0;
+        size_t dropped_stride = 1;
+};
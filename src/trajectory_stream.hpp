@@ -0,0 +1,589 @@
+#pragma once
+
+#include "components.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Compact archive of a flown trajectory, written while the shot is simulated. Samples are grouped in
+//chunks; each chunk stores its first time and position as raw doubles and the rest as integer multiples
+//of the quanta relative to them, so the rounding error never exceeds half a quantum and never builds up.
+//The first step of a chunk is a zigzag varint, every later one only the change from the step before
+//(a ballistic path is close to a parabola, so those are a few bits), bit packed at the widest one per
+//coordinate. Chunks are independent, an index at the end of the file gives random access by chunk;
+//without it (the writer never finished) the reader walks the chunks that were written completely.
+//
+//  header:  "BTRJ" u32 version f64 position_quantum f64 time_quantum
+//  chunk:   'C' u32 size, varint count, f64 time x y z, 4 x varint first step, 4 x (u8 width, packed)
+//  index:   'I' u32 size, varint chunks, chunks x (u64 offset, f64 time, varint count)
+//  trailer: u64 index offset "BTRX"
+class TrajectoryStream {
+    public:
+        static constexpr uint32_t VERSION = 1;
+
+        struct Settings{
+            double position_quantum = 0.001; //meters
+            double time_quantum = 0.000001; //seconds
+            uint32_t chunk_samples = 256;
+            bool background = true; //write the encoded chunks on a thread of their own
+        };
+
+        struct Sample{
+            double time;
+            glm::dvec3 position;
+        };
+
+        //Encodes a chunk whenever chunk_samples samples are in, nothing else is kept. With background set
+        //add() never touches the stream, the chunks are queued (without bound) for the writer thread.
+        //The stream must not be used by anyone else until finish().
+        class Writer {
+            public:
+                Writer(std::ostream& output, const Settings& settings) : output(output), settings(settings){
+                    if(!(settings.position_quantum > 0.0) || !(settings.time_quantum > 0.0)){
+                        throw std::invalid_argument("TrajectoryStream needs a positive position and time quantum");
+                    }
+                    this->settings.chunk_samples = std::max<uint32_t>(1, settings.chunk_samples);
+                    pending.reserve(this->settings.chunk_samples);
+                    std::string header = "BTRJ";
+                    putFixed(header, VERSION);
+                    putDouble(header, settings.position_quantum);
+                    putDouble(header, settings.time_quantum);
+                    if(settings.background){
+                        thread = std::thread([this](){
+                            drain();
+                        });
+                    }
+                    emit(std::move(header));
+                }
+
+                ~Writer(){
+                    finish();
+                }
+
+                void add(double time, const glm::dvec3& position){
+                    pending.push_back({time, position});
+                    sample_count++;
+                    if(pending.size() >= settings.chunk_samples){
+                        flushChunk();
+                    }
+                }
+
+                //for the step callback of simulateShot, which does not report the launch point
+                std::function<void(const Position& position, const double& time)> callback(){
+                    return [this](const Position& position, const double& time){
+                        add(time, position.position);
+                    };
+                }
+
+                //writes the last chunk and the index, waits for the writer thread
+                void finish(){
+                    if(finished){
+                        return;
+                    }
+                    finished = true;
+                    flushChunk();
+
+                    std::string index;
+                    putVarint(index, entries.size());
+                    for(const Entry& entry : entries){
+                        putFixed(index, entry.offset);
+                        putDouble(index, entry.time);
+                        putVarint(index, entry.count);
+                    }
+                    uint64_t index_offset = offset;
+                    std::string record = "I";
+                    putFixed(record, (uint32_t)index.size());
+                    record += index;
+                    putFixed(record, index_offset);
+                    record += "BTRX";
+                    emit(std::move(record));
+
+                    if(thread.joinable()){
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            stopping = true;
+                        }
+                        condition.notify_one();
+                        thread.join();
+                    }
+                    output.flush();
+                }
+
+                uint64_t samples() const{
+                    return sample_count;
+                }
+
+                size_t chunks() const{
+                    return entries.size();
+                }
+
+                //encoded so far, including what the writer thread has not written yet
+                uint64_t bytes() const{
+                    return offset;
+                }
+
+            private:
+                struct Entry{
+                    uint64_t offset;
+                    double time;
+                    uint64_t count;
+                };
+
+                void flushChunk(){
+                    if(pending.empty()){
+                        return;
+                    }
+                    std::string payload = encodeChunk(pending, settings);
+                    std::string record = "C";
+                    putFixed(record, (uint32_t)payload.size());
+                    record += payload;
+                    entries.push_back({offset, pending.front().time, pending.size()});
+                    pending.clear();
+                    emit(std::move(record));
+                }
+
+                void emit(std::string&& bytes){
+                    offset += bytes.size();
+                    if(!settings.background){
+                        output.write(bytes.data(), bytes.size());
+                        return;
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        queue.push_back(std::move(bytes));
+                    }
+                    condition.notify_one();
+                }
+
+                void drain(){
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while(true){
+                        condition.wait(lock, [this](){
+                            return stopping || !queue.empty();
+                        });
+                        if(queue.empty()){
+                            return;
+                        }
+                        std::string bytes = std::move(queue.front());
+                        queue.pop_front();
+                        lock.unlock();
+                        output.write(bytes.data(), bytes.size());
+                        lock.lock();
+                    }
+                }
+
+                std::ostream& output;
+                Settings settings;
+                std::vector<Sample> pending;
+                std::vector<Entry> entries;
+                uint64_t offset = 0;
+                uint64_t sample_count = 0;
+                bool finished = false;
+
+                std::thread thread;
+                std::mutex mutex;
+                std::condition_variable condition;
+                std::deque<std::string> queue;
+                bool stopping = false;
+        };
+
+        class Reader {
+            public:
+                explicit Reader(std::istream& input) : input(input){
+                    char header[24];
+                    if(!input.read(header, sizeof(header)) || std::memcmp(header, "BTRJ", 4) != 0){
+                        throw std::runtime_error("Not a trajectory stream");
+                    }
+                    const char* cursor = header + 4;
+                    const char* end = header + sizeof(header);
+                    if(getFixed<uint32_t>(cursor, end) != VERSION){
+                        throw std::runtime_error("Unsupported trajectory stream version");
+                    }
+                    settings.position_quantum = getDouble(cursor, end);
+                    settings.time_quantum = getDouble(cursor, end);
+                    if(!readIndex()){
+                        scan();
+                    }
+                }
+
+                const Settings& getSettings() const{
+                    return settings;
+                }
+
+                //false when the index was lost and the chunks were found by walking the file
+                bool indexed() const{
+                    return has_index;
+                }
+
+                size_t chunks() const{
+                    return entries.size();
+                }
+
+                uint64_t samples() const{
+                    uint64_t count = 0;
+                    for(const Entry& entry : entries){
+                        count += entry.count;
+                    }
+                    return count;
+                }
+
+                double chunkTime(size_t index) const{
+                    return entries.at(index).time;
+                }
+
+                //the chunk holding time, the first one before it starts
+                size_t findChunk(double time) const{
+                    auto it = std::upper_bound(entries.begin(), entries.end(), time, [](double time, const Entry& entry){
+                        return time < entry.time;
+                    });
+                    return it == entries.begin() ? 0 : (size_t)(it - entries.begin() - 1);
+                }
+
+                std::vector<Sample> chunk(size_t index){
+                    const Entry& entry = entries.at(index);
+                    input.clear();
+                    input.seekg(entry.offset + 1);
+                    std::string size_bytes = readBytes(4);
+                    const char* cursor = size_bytes.data();
+                    uint32_t size = getFixed<uint32_t>(cursor, cursor + 4);
+                    std::string payload = readBytes(size);
+                    return decodeChunk(payload, settings);
+                }
+
+                std::vector<Sample> readAll(){
+                    std::vector<Sample> samples;
+                    for(size_t i = 0; i < entries.size(); i++){
+                        std::vector<Sample> part = chunk(i);
+                        samples.insert(samples.end(), part.begin(), part.end());
+                    }
+                    return samples;
+                }
+
+            private:
+                struct Entry{
+                    uint64_t offset;
+                    double time;
+                    uint64_t count;
+                };
+
+                bool readIndex(){
+                    input.seekg(0, std::ios::end);
+                    std::streamoff length = input.tellg();
+                    if(length < 24 + 12){
+                        return false;
+                    }
+                    input.seekg(length - 12);
+                    char trailer[12];
+                    if(!input.read(trailer, sizeof(trailer)) || std::memcmp(trailer + 8, "BTRX", 4) != 0){
+                        return false;
+                    }
+                    const char* cursor = trailer;
+                    uint64_t index_offset = getFixed<uint64_t>(cursor, trailer + 8);
+                    if(index_offset + 5 > (uint64_t)length - 12){
+                        return false;
+                    }
+                    input.seekg(index_offset);
+                    std::string record = readBytes((size_t)(length - 12 - index_offset));
+                    if(record[0] != 'I'){
+                        return false;
+                    }
+                    cursor = record.data() + 1;
+                    const char* end = record.data() + record.size();
+                    getFixed<uint32_t>(cursor, end);
+                    uint64_t count = getVarint(cursor, end);
+                    for(uint64_t i = 0; i < count; i++){
+                        Entry entry;
+                        entry.offset = getFixed<uint64_t>(cursor, end);
+                        entry.time = getDouble(cursor, end);
+                        entry.count = getVarint(cursor, end);
+                        entries.push_back(entry);
+                    }
+                    has_index = true;
+                    return true;
+                }
+
+                //a chunk cut short by a crash ends the walk
+                void scan(){
+                    input.clear();
+                    input.seekg(0, std::ios::end);
+                    uint64_t length = (uint64_t)input.tellg();
+                    uint64_t offset = 24;
+                    while(offset + 5 <= length){
+                        input.seekg(offset);
+                        std::string head = readBytes(5);
+                        if(head[0] != 'C'){
+                            break;
+                        }
+                        const char* cursor = head.data() + 1;
+                        uint32_t size = getFixed<uint32_t>(cursor, cursor + 4);
+                        if(offset + 5 + size > length){
+                            break;
+                        }
+                        std::string payload = readBytes(size);
+                        cursor = payload.data();
+                        const char* end = payload.data() + payload.size();
+                        Entry entry;
+                        entry.offset = offset;
+                        entry.count = getVarint(cursor, end);
+                        entry.time = getDouble(cursor, end);
+                        entries.push_back(entry);
+                        offset += 5 + size;
+                    }
+                }
+
+                std::string readBytes(size_t size){
+                    std::string bytes(size, '\0');
+                    if(!input.read(&bytes[0], size)){
+                        throw std::runtime_error("Truncated trajectory stream");
+                    }
+                    return bytes;
+                }
+
+                std::istream& input;
+                Settings settings;
+                std::vector<Entry> entries;
+                bool has_index = false;
+        };
+
+    private:
+        static std::string encodeChunk(const std::vector<Sample>& samples, const Settings& settings){
+            std::string payload;
+            putVarint(payload, samples.size());
+            const Sample& base = samples.front();
+            putDouble(payload, base.time);
+            putDouble(payload, base.position.x);
+            putDouble(payload, base.position.y);
+            putDouble(payload, base.position.z);
+            if(samples.size() < 2){
+                return payload;
+            }
+
+            //time, x, y, z as multiples of the quanta from the base sample
+            std::vector<int64_t> quantised[4];
+            for(const Sample& sample : samples){
+                quantised[0].push_back(std::llround((sample.time - base.time) / settings.time_quantum));
+                for(int axis = 0; axis < 3; axis++){
+                    quantised[axis + 1].push_back(std::llround((sample.position[axis] - base.position[axis]) / settings.position_quantum));
+                }
+            }
+            for(int stream = 0; stream < 4; stream++){
+                putVarint(payload, zigzag(quantised[stream][1] - quantised[stream][0]));
+            }
+
+            std::vector<uint64_t> residuals(samples.size() - 2);
+            for(int stream = 0; stream < 4; stream++){
+                const std::vector<int64_t>& q = quantised[stream];
+                uint64_t widest = 0;
+                for(size_t i = 2; i < q.size(); i++){
+                    residuals[i - 2] = zigzag((q[i] - q[i - 1]) - (q[i - 1] - q[i - 2]));
+                    widest |= residuals[i - 2];
+                }
+                uint8_t width = 0;
+                while(width < 64 && (widest >> width) != 0){
+                    width++;
+                }
+                payload += (char)width;
+                BitWriter bits(payload);
+                for(uint64_t residual : residuals){
+                    bits.put(residual, width);
+                }
+                bits.flush();
+            }
+            return payload;
+        }
+
+        static std::vector<Sample> decodeChunk(const std::string& payload, const Settings& settings){
+            const char* cursor = payload.data();
+            const char* end = payload.data() + payload.size();
+            uint64_t count = getVarint(cursor, end);
+            Sample base;
+            base.time = getDouble(cursor, end);
+            base.position.x = getDouble(cursor, end);
+            base.position.y = getDouble(cursor, end);
+            base.position.z = getDouble(cursor, end);
+            if(count == 0 || count > UINT32_MAX){
+                throw std::runtime_error("Corrupt trajectory chunk");
+            }
+
+            std::vector<int64_t> quantised[4];
+            if(count >= 2){
+                int64_t first[4];
+                for(int stream = 0; stream < 4; stream++){
+                    first[stream] = unzigzag(getVarint(cursor, end));
+                }
+                for(int stream = 0; stream < 4; stream++){
+                    std::vector<int64_t>& q = quantised[stream];
+                    q.reserve(count);
+                    q.push_back(0);
+                    q.push_back(first[stream]);
+                    if(cursor >= end){
+                        throw std::runtime_error("Corrupt trajectory chunk");
+                    }
+                    uint8_t width = (uint8_t)*cursor++;
+                    BitReader bits(cursor, end);
+                    for(uint64_t i = 2; i < count; i++){
+                        int64_t change = unzigzag(bits.get(width));
+                        q.push_back(2 * q[i - 1] - q[i - 2] + change);
+                    }
+                    cursor = bits.position();
+                }
+            }
+
+            std::vector<Sample> samples(count, base);
+            for(uint64_t i = 1; i < count; i++){
+                samples[i].time = base.time + quantised[0][i] * settings.time_quantum;
+                for(int axis = 0; axis < 3; axis++){
+                    samples[i].position[axis] = base.position[axis] + quantised[axis + 1][i] * settings.position_quantum;
+                }
+            }
+            return samples;
+        }
+
+        class BitWriter {
+            public:
+                explicit BitWriter(std::string& output) : output(output){}
+
+                void put(uint64_t value, uint8_t width){
+                    while(width > 0){
+                        uint8_t take = std::min<uint8_t>(width, 64 - used);
+                        uint64_t part = take == 64 ? value : value & ((uint64_t(1) << take) - 1);
+                        buffer |= part << used;
+                        used += take;
+                        value = take == 64 ? 0 : value >> take;
+                        width -= take;
+                        if(used == 64){
+                            putFixed(output, buffer);
+                            buffer = 0;
+                            used = 0;
+                        }
+                    }
+                }
+
+                //whole bytes only
+                void flush(){
+                    for(uint8_t bit = 0; bit < used; bit += 8){
+                        output += (char)(buffer >> bit);
+                    }
+                    buffer = 0;
+                    used = 0;
+                }
+
+            private:
+                std::string& output;
+                uint64_t buffer = 0;
+                uint8_t used = 0;
+        };
+
+        class BitReader {
+            public:
+                BitReader(const char* cursor, const char* end) : cursor(cursor), end(end){}
+
+                uint64_t get(uint8_t width){
+                    uint64_t value = 0;
+                    uint8_t filled = 0;
+                    while(filled < width){
+                        if(available == 0){
+                            if(cursor >= end){
+                                throw std::runtime_error("Corrupt trajectory chunk");
+                            }
+                            byte = (uint8_t)*cursor++;
+                            available = 8;
+                        }
+                        uint8_t take = std::min<uint8_t>(width - filled, available);
+                        value |= (uint64_t)(byte & ((1u << take) - 1)) << filled;
+                        byte >>= take;
+                        available -= take;
+                        filled += take;
+                    }
+                    return value;
+                }
+
+                //the next whole byte
+                const char* position() const{
+                    return cursor;
+                }
+
+            private:
+                const char* cursor;
+                const char* end;
+                uint8_t byte = 0;
+                uint8_t available = 0;
+        };
+
+        static uint64_t zigzag(int64_t value){
+            return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+        }
+
+        static int64_t unzigzag(uint64_t value){
+            return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+        }
+
+        static void putVarint(std::string& output, uint64_t value){
+            while(value >= 0x80){
+                output += (char)(value | 0x80);
+                value >>= 7;
+            }
+            output += (char)value;
+        }
+
+        static uint64_t getVarint(const char*& cursor, const char* end){
+            uint64_t value = 0;
+            for(int shift = 0; shift < 64; shift += 7){
+                if(cursor >= end){
+                    break;
+                }
+                uint8_t byte = (uint8_t)*cursor++;
+                value |= (uint64_t)(byte & 0x7f) << shift;
+                if(!(byte & 0x80)){
+                    return value;
+                }
+            }
+            throw std::runtime_error("Corrupt trajectory chunk");
+        }
+
+        //little endian whatever the host
+        template<typename T>
+        static void putFixed(std::string& output, T value){
+            for(size_t i = 0; i < sizeof(T); i++){
+                output += (char)(value >> (8 * i));
+            }
+        }
+
+        template<typename T>
+        static T getFixed(const char*& cursor, const char* end){
+            if(end - cursor < (std::ptrdiff_t)sizeof(T)){
+                throw std::runtime_error("Corrupt trajectory chunk");
+            }
+            T value = 0;
+            for(size_t i = 0; i < sizeof(T); i++){
+                value |= (T)(uint8_t)cursor[i] << (8 * i);
+            }
+            cursor += sizeof(T);
+            return value;
+        }
+
+        static void putDouble(std::string& output, double value){
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            putFixed(output, bits);
+        }
+
+        static double getDouble(const char*& cursor, const char* end){
+            uint64_t bits = getFixed<uint64_t>(cursor, end);
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+};
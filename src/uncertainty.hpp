@@ -0,0 +1,371 @@
+#pragma once
+
+#include "simulation.hpp"
+#include "physics.hpp"
+#include "components.hpp"
+#include "thread_pool.hpp"
+#include "trajectory.hpp"
+#include <glm/glm.hpp>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <random>
+#include <vector>
+
+//Spread of a shot caused by uncertain inputs, without flying thousands of perturbed shots.
+//The sensitivities of position and velocity to every input (columns of the state transition
+//matrix) are integrated next to the nominal shot from the linearised equations of motion.
+//At the closest approach to the target they are projected onto the target plane (normal to
+//the nominal velocity) and combined with the input variances into the impact covariance.
+//sample() is the brute force Monte Carlo version of the same numbers.
+class Uncertainty {
+    public:
+        enum Parameter{
+            SPEED,
+            AIR_RESISTANCE,
+            MASS,
+            ANGLE,
+            AZIMUTH,
+            WIND_X,
+            WIND_Y,
+            WIND_Z,
+            PARAMETERS
+        };
+
+        //standard deviations, or one sampled deviation from the nominal shot; angles in degrees.
+        //The nominal wind is calm, wind is a uniform air velocity.
+        struct Inputs{
+            double speed = 0.0;
+            double air_resistance = 0.0;
+            double mass = 0.0;
+            double angle = 0.0;
+            double azimuth = 0.0;
+            glm::dvec3 wind = glm::dvec3(0.0);
+        };
+
+        struct Result{
+            bool reached = false; //the nominal shot got to its closest approach within MAX_SIMULATION_TIME
+            double time = 0.0; //of the nominal closest approach
+            glm::dvec3 point = glm::dvec3(0.0);
+            //target plane: normal along the nominal velocity, lateral is horizontal
+            glm::dvec3 normal = glm::dvec3(0.0);
+            glm::dvec3 lateral = glm::dvec3(0.0);
+            glm::dvec3 vertical = glm::dvec3(0.0);
+            //mean impact in the target plane relative to the target, (lateral, vertical)
+            glm::dvec2 miss = glm::dvec2(0.0);
+            glm::dmat2 covariance = glm::dmat2(0.0);
+            glm::dmat3 world_covariance = glm::dmat3(0.0);
+            //probability of passing within the radius of the target
+            double hit_probability = 0.0;
+            uint64_t steps = 0;
+            //impact shift in the target plane per unit of each input, empty for sample()
+            std::array<glm::dvec2, PARAMETERS> sensitivities{};
+        };
+
+        static Result propagate(const Simulation& simulation, double angle, double azimuth, const Inputs& sigma, double radius){
+            Result result;
+            const glm::dvec3& target = simulation.getTargetPosition();
+            double delta_time = simulation.getDeltaTime();
+            Mass mass = simulation.getMass();
+
+            Position position = {simulation.getShooterPosition(), simulation.getShooterPosition()};
+            Velocity velocity = {simulation.launchVelocity(angle, azimuth)};
+
+            //the launch direction only depends on the aim
+            std::array<glm::dvec3, PARAMETERS> dp;
+            std::array<glm::dvec3, PARAMETERS> dv;
+            dp.fill(glm::dvec3(0.0));
+            dv.fill(glm::dvec3(0.0));
+            const double h = 0.001;
+            dv[SPEED] = glm::normalize(velocity.velocity);
+            dv[ANGLE] = (simulation.launchVelocity(angle + h, azimuth) - simulation.launchVelocity(angle - h, azimuth)) / (2.0 * h);
+            dv[AZIMUTH] = (simulation.launchVelocity(angle, azimuth + h) - simulation.launchVelocity(angle, azimuth - h)) / (2.0 * h);
+
+            double time = 0.0;
+            while(delta_time > 0.0 && time < Simulation::getMaxSimulationTime()){
+                Position next_position = position;
+                Velocity next_velocity = velocity;
+                Physics::integrate(next_position, next_velocity, mass, delta_time);
+                result.steps++;
+
+                Trajectory::Keyframe start = {time, position.position, velocity.velocity};
+                Trajectory::Keyframe end = {time + delta_time, next_position.position, next_velocity.velocity};
+                double closest = Trajectory::closestApproach(start, end, target);
+                if(closest < end.time){
+                    glm::dvec3 closest_velocity = Trajectory::velocity(start, end, closest);
+                    advance(dp, dv, velocity.velocity, closest_velocity, mass, closest - time);
+                    position.position = Trajectory::position(start, end, closest);
+                    velocity.velocity = closest_velocity;
+                    time = closest;
+                    result.reached = true;
+                    break;
+                }
+                advance(dp, dv, velocity.velocity, next_velocity.velocity, mass, delta_time);
+                position = next_position;
+                velocity = next_velocity;
+                time = end.time;
+            }
+
+            result.time = time;
+            result.point = position.position;
+            targetPlane(result, velocity.velocity);
+            result.miss = project(result, position.position - target);
+
+            double variances[PARAMETERS] = {sigma.speed * sigma.speed, sigma.air_resistance * sigma.air_resistance, sigma.mass * sigma.mass,
+                                            sigma.angle * sigma.angle, sigma.azimuth * sigma.azimuth,
+                                            sigma.wind.x * sigma.wind.x, sigma.wind.y * sigma.wind.y, sigma.wind.z * sigma.wind.z};
+            for(int k = 0; k < PARAMETERS; k++){
+                //moving along the path does not move the impact, only the part of dp in the plane counts
+                glm::dvec2 shift = project(result, dp[k]);
+                result.sensitivities[k] = shift;
+                result.covariance[0][0] += variances[k] * shift.x * shift.x;
+                result.covariance[0][1] += variances[k] * shift.x * shift.y;
+                result.covariance[1][1] += variances[k] * shift.y * shift.y;
+            }
+            result.covariance[1][0] = result.covariance[0][1];
+            finish(result, radius);
+            return result;
+        }
+
+        //Monte Carlo reference: count shots with normally distributed inputs, flown in parallel,
+        //each one intersected with the target plane of the nominal shot
+        static Result sample(const Simulation& simulation, double angle, double azimuth, const Inputs& sigma, double radius,
+                             size_t count, unsigned seed = 1, ThreadPool& pool = ThreadPool::shared()){
+            Result result = propagate(simulation, angle, azimuth, Inputs(), radius);
+            result.sensitivities.fill(glm::dvec2(0.0));
+            result.steps = 0;
+
+            std::mt19937 generator(seed);
+            std::normal_distribution<double> normal(0.0, 1.0);
+            std::vector<Inputs> deviations(count);
+            for(Inputs& deviation : deviations){
+                deviation.speed = sigma.speed * normal(generator);
+                deviation.air_resistance = sigma.air_resistance * normal(generator);
+                deviation.mass = sigma.mass * normal(generator);
+                deviation.angle = sigma.angle * normal(generator);
+                deviation.azimuth = sigma.azimuth * normal(generator);
+                deviation.wind = glm::dvec3(sigma.wind.x * normal(generator), sigma.wind.y * normal(generator), sigma.wind.z * normal(generator));
+            }
+
+            struct Impact{
+                bool crossed;
+                glm::dvec2 point;
+                uint64_t steps;
+            };
+            std::vector<Impact> impacts(count);
+            std::vector<std::future<void>> chunks;
+            const size_t chunk = 64;
+            for(size_t begin = 0; begin < count; begin += chunk){
+                size_t end = std::min(begin + chunk, count);
+                chunks.push_back(pool.submit([&, begin, end](){
+                    for(size_t i = begin; i < end; i++){
+                        impacts[i].crossed = fly(simulation, angle, azimuth, deviations[i], result, impacts[i].point, impacts[i].steps);
+                    }
+                }));
+            }
+            for(auto& future : chunks){
+                pool.wait(future);
+            }
+
+            size_t crossed = 0;
+            size_t hits = 0;
+            glm::dvec2 mean(0.0);
+            for(const Impact& impact : impacts){
+                result.steps += impact.steps;
+                if(impact.crossed){
+                    crossed++;
+                    mean += impact.point;
+                    hits += glm::length(impact.point) < radius ? 1 : 0;
+                }
+            }
+            if(crossed > 0){
+                mean /= (double)crossed;
+            }
+            glm::dmat2 covariance(0.0);
+            for(const Impact& impact : impacts){
+                if(impact.crossed){
+                    glm::dvec2 offset = impact.point - mean;
+                    covariance[0][0] += offset.x * offset.x;
+                    covariance[0][1] += offset.x * offset.y;
+                    covariance[1][1] += offset.y * offset.y;
+                }
+            }
+            if(crossed > 1){
+                for(int i = 0; i < 2; i++){
+                    for(int j = 0; j < 2; j++){
+                        covariance[i][j] /= (double)(crossed - 1);
+                    }
+                }
+            }
+            covariance[1][0] = covariance[0][1];
+
+            result.miss = mean;
+            result.covariance = covariance;
+            finish(result, radius);
+            result.hit_probability = count > 0 ? (double)hits / count : 0.0;
+            return result;
+        }
+
+        //probability that a normally distributed point in the plane lies within radius of the origin
+        static double diskProbability(const glm::dvec2& mean, const glm::dmat2& covariance, double radius){
+            //x = mean + L z with covariance = L L^T; for every z1 the allowed z2 form one interval
+            double l11 = std::sqrt(std::max(covariance[0][0], 0.0));
+            double l21 = l11 > 0.0 ? covariance[0][1] / l11 : 0.0;
+            double l22 = std::sqrt(std::max(covariance[1][1] - l21 * l21, 0.0));
+
+            auto inner = [&](double z1){
+                double x = mean.x + l11 * z1;
+                double q = radius * radius - x * x;
+                if(q <= 0.0){
+                    return 0.0;
+                }
+                double c = mean.y + l21 * z1;
+                double half = std::sqrt(q);
+                if(l22 <= 0.0){
+                    return std::abs(c) < half ? 1.0 : 0.0;
+                }
+                return normalCdf((half - c) / l22) - normalCdf((-half - c) / l22);
+            };
+
+            if(l11 <= 0.0 || radius <= 0.0){
+                return radius > 0.0 ? inner(0.0) : 0.0;
+            }
+            //Simpson's rule over the part of +-8 standard deviations inside the disk, in x = radius sin(phi)
+            //so the square root edges of the disk do not spoil the convergence
+            const int intervals = 256;
+            const double limit = 8.0;
+            double phi0 = std::asin(glm::clamp((mean.x - limit * l11) / radius, -1.0, 1.0));
+            double phi1 = std::asin(glm::clamp((mean.x + limit * l11) / radius, -1.0, 1.0));
+            if(phi1 <= phi0){
+                return 0.0;
+            }
+            double step = (phi1 - phi0) / intervals;
+            double sum = 0.0;
+            for(int i = 0; i <= intervals; i++){
+                double phi = phi0 + i * step;
+                double z = (radius * std::sin(phi) - mean.x) / l11;
+                double weight = (i == 0 || i == intervals) ? 1.0 : (i % 2 == 1 ? 4.0 : 2.0);
+                sum += weight * inner(z) * std::exp(-0.5 * z * z) * radius * std::cos(phi) / l11;
+            }
+            return glm::clamp(sum * step / 3.0 / std::sqrt(2.0 * glm::pi<double>()), 0.0, 1.0);
+        }
+
+    private:
+        //drag acceleration -k |u| u with u the velocity through the air; returns d(acceleration)/d(velocity) applied to x
+        static glm::dvec3 dragJacobian(const glm::dvec3& u, double k, const glm::dvec3& x){
+            double speed = glm::length(u);
+            if(speed <= 0.0){
+                return glm::dvec3(0.0);
+            }
+            return -k * (speed * x + u * (glm::dot(u, x) / speed));
+        }
+
+        //Heun step of d(dp)/dt = dv, d(dv)/dt = J dv + da/dparameter along the nominal velocities v0 -> v1
+        static void advance(std::array<glm::dvec3, PARAMETERS>& dp, std::array<glm::dvec3, PARAMETERS>& dv,
+                            const glm::dvec3& v0, const glm::dvec3& v1, const Mass& mass, double delta_time){
+            if(delta_time <= 0.0){
+                return;
+            }
+            double k = 0.5 * Physics::AIR_DENSITY * mass.air_resistance / mass.mass;
+            auto derivative = [&](const glm::dvec3& v, int parameter, const glm::dvec3& sensitivity){
+                glm::dvec3 result = dragJacobian(v, k, sensitivity);
+                double speed = glm::length(v);
+                switch(parameter){
+                    case AIR_RESISTANCE: result += -0.5 * Physics::AIR_DENSITY / mass.mass * speed * v; break;
+                    case MASS: result += k / mass.mass * speed * v; break;
+                    //the wind enters through the air velocity v - w
+                    case WIND_X: result -= dragJacobian(v, k, glm::dvec3(1.0, 0.0, 0.0)); break;
+                    case WIND_Y: result -= dragJacobian(v, k, glm::dvec3(0.0, 1.0, 0.0)); break;
+                    case WIND_Z: result -= dragJacobian(v, k, glm::dvec3(0.0, 0.0, 1.0)); break;
+                    default: break;
+                }
+                return result;
+            };
+
+            for(int parameter = 0; parameter < PARAMETERS; parameter++){
+                glm::dvec3 a1 = derivative(v0, parameter, dv[parameter]);
+                glm::dvec3 predicted = dv[parameter] + a1 * delta_time;
+                glm::dvec3 a2 = derivative(v1, parameter, predicted);
+                dp[parameter] += (dv[parameter] + predicted) * 0.5 * delta_time;
+                dv[parameter] += (a1 + a2) * 0.5 * delta_time;
+            }
+        }
+
+        static void targetPlane(Result& result, const glm::dvec3& velocity){
+            result.normal = glm::normalize(velocity);
+            result.lateral = glm::normalize(glm::cross(result.normal, Simulation::UP_VECTOR));
+            if(glm::isnan(result.lateral.x)){
+                result.lateral = glm::dvec3(1.0, 0.0, 0.0);
+            }
+            result.vertical = glm::cross(result.lateral, result.normal);
+        }
+
+        static glm::dvec2 project(const Result& result, const glm::dvec3& offset){
+            return glm::dvec2(glm::dot(offset, result.lateral), glm::dot(offset, result.vertical));
+        }
+
+        static void finish(Result& result, double radius){
+            for(int i = 0; i < 3; i++){
+                for(int j = 0; j < 3; j++){
+                    glm::dvec2 a(result.lateral[i], result.vertical[i]);
+                    glm::dvec2 b(result.lateral[j], result.vertical[j]);
+                    result.world_covariance[j][i] = a.x * (result.covariance[0][0] * b.x + result.covariance[1][0] * b.y)
+                                                  + a.y * (result.covariance[0][1] * b.x + result.covariance[1][1] * b.y);
+                }
+            }
+            result.hit_probability = diskProbability(result.miss, result.covariance, radius);
+        }
+
+        static double normalCdf(double x){
+            return 0.5 * std::erfc(-x / std::sqrt(2.0));
+        }
+
+        //One perturbed shot. With a uniform wind the motion through the air is the calm one started
+        //at v0 - w, the ground position adds w t. Returns false when the target plane is not reached.
+        static bool fly(const Simulation& simulation, double angle, double azimuth, const Inputs& deviation, const Result& nominal,
+                        glm::dvec2& point, uint64_t& steps){
+            const glm::dvec3& target = simulation.getTargetPosition();
+            double delta_time = simulation.getDeltaTime();
+            Mass mass = simulation.getMass();
+            mass.mass += deviation.mass;
+            mass.air_resistance += deviation.air_resistance;
+
+            glm::dvec3 launch = simulation.launchVelocity(angle + deviation.angle, azimuth + deviation.azimuth);
+            double speed = glm::length(launch);
+            if(speed > 0.0){
+                launch *= (speed + deviation.speed) / speed;
+            }
+
+            Position air = {simulation.getShooterPosition(), simulation.getShooterPosition()};
+            Velocity velocity = {launch - deviation.wind};
+            auto side = [&](const glm::dvec3& position){
+                return glm::dot(position - target, nominal.normal);
+            };
+
+            steps = 0;
+            double time = 0.0;
+            Trajectory::Keyframe start = {time, air.position, launch};
+            if(side(start.position) >= 0.0){
+                point = project(nominal, start.position - target);
+                return true;
+            }
+            while(delta_time > 0.0 && time < Simulation::getMaxSimulationTime()){
+                Physics::integrate(air, velocity, mass, delta_time);
+                time += delta_time;
+                steps++;
+                Trajectory::Keyframe end = {time, air.position + deviation.wind * time, velocity.velocity + deviation.wind};
+                double f1 = side(end.position);
+                if(f1 >= 0.0){
+                    auto distance = [&](double t){
+                        return side(Trajectory::position(start, end, t));
+                    };
+                    double crossing = Trajectory::brent(distance, start.time, end.time, side(start.position), f1, 1e-12 * std::max(1.0, time));
+                    point = project(nominal, Trajectory::position(start, end, crossing) - target);
+                    return true;
+                }
+                start = end;
+            }
+            return false;
+        }
+};
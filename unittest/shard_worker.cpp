@@ -0,0 +1,49 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include "../src/shards.hpp"
+
+// Worker exec'd by the Shards test, the test process runs threads of its own and must not fork without exec.
+// SHARD_WORKER_FAULT picks a failure: "restart" kills the first worker of shard 1 after 6 results and half
+// a line, "fail" fails shard 2 every time.
+int main(int argc, char** argv) {
+    try {
+        std::string directory;
+        size_t shard = 0;
+        unsigned threads = 1;
+        for (int i = 1; i < argc; i++) {
+            if (std::strcmp(argv[i], "--shard-worker") == 0 && i + 2 < argc) {
+                directory = argv[++i];
+                shard = (size_t)std::stoull(argv[++i]);
+            } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                threads = (unsigned)std::stoul(argv[++i]);
+            } else {
+                std::cerr << "Usage: " << argv[0] << " --shard-worker <dir> <shard> [--threads <n>]" << std::endl;
+                return 1;
+            }
+        }
+        if (directory.empty()) {
+            std::cerr << "--shard-worker needs <dir> <shard>" << std::endl;
+            return 1;
+        }
+
+        Shards::CHECKPOINT_BLOCK = 4;
+        const char* fault = std::getenv("SHARD_WORKER_FAULT");
+        std::string mode = fault ? fault : "";
+        if (mode == "restart" && shard == 1 && ::access(Shards::partialPath(directory, shard).c_str(), F_OK) != 0) {
+            Shards::runShard(directory, shard, 1, nullptr, 6);
+            std::ofstream(Shards::partialPath(directory, shard), std::ios::app) << "16 HI";
+            return 1;
+        }
+        if (mode == "fail" && shard == 2) {
+            return 1;
+        }
+        return Shards::runShard(directory, shard, threads) ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
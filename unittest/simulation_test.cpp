@@ -8,10 +8,49 @@
 
 #include <entt/entt.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
 #define private public
 #include "../src/physics.hpp"
 #include "../src/simulation.hpp"
 #include "../src/components.hpp"
+#include "../src/instrumentation.hpp"
+#include "../src/batch.hpp"
+#include "../src/shot_cache.hpp"
+#include "../src/trajectory.hpp"
+#include "../src/reachability.hpp"
+#include "../src/thread_pool.hpp"
+#include "../src/barrage.hpp"
+#include "../src/terrain.hpp"
+#include "../src/service.hpp"
+#include "../src/safety_fan.hpp"
+#include "../src/accuracy.hpp"
+#include "../src/uncertainty.hpp"
+#include "../src/heatmap.hpp"
+#include "../src/shards.hpp"
+#include "../src/charge.hpp"
+#include "../src/trajectory_stream.hpp"
+#include "../src/trace.hpp"
+#include "../src/tracker.hpp"
+#include "../src/resumable.hpp"
 
 TEST_CASE("Physics Test", "[physics]") {
 
@@ -167,4 +206,2110 @@ TEST_CASE("Simulation Strategy 2 Test", "[simulation]") {
         REQUIRE(result.best_result.result != Simulation::ShotResultEnum::HIT);
     }
     // ...
-}
\ No newline at end of file
+}
+
+TEST_CASE("Instrumentation Test", "[instrumentation]") {
+
+    Physics::AIR_DENSITY = 0.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    Instrumentation::reset();
+
+    SECTION("Strategy counters"){
+        Simulation simulation(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(10.0, 0.0, 0.0), 10.0, 10.0, 0.0001);
+        auto result = simulation.find_angle_strategy();
+        REQUIRE(result.best_result.result == Simulation::ShotResultEnum::HIT);
+
+        Instrumentation::Stats stats = Instrumentation::snapshot();
+        if(Instrumentation::ENABLED){
+            const Instrumentation::SolveStats& solve = stats.solves["strategy1"];
+            REQUIRE(solve.solve_ns.count == 1);
+            REQUIRE(solve.terminations[Instrumentation::HIT] == 1);
+            REQUIRE(solve.shots_per_solve.sum == Catch::Approx(result.tries));
+            REQUIRE(stats.steps_per_shot.count == result.tries);
+            REQUIRE(stats.steps > 0);
+            REQUIRE(Instrumentation::toJson(stats).find("\"strategy1\"") != std::string::npos);
+        } else {
+            REQUIRE(stats.steps == 0);
+        }
+    }
+
+    SECTION("Per thread merge"){
+        Batch::Scenario scenario = {glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(100.0, 0.0, 0.0), 10.0, 1.0, 0.01, 1};
+        std::vector<Batch::Scenario> scenarios(8, scenario);
+        auto results = Batch::run(scenarios, 4);
+
+        REQUIRE(results.size() == scenarios.size());
+        Instrumentation::Stats stats = Instrumentation::snapshot();
+        if(Instrumentation::ENABLED){
+            const Instrumentation::SolveStats& solve = stats.solves["strategy1"];
+            REQUIRE(solve.solve_ns.count == scenarios.size());
+            REQUIRE(solve.terminations[Instrumentation::NO_IN_RANGE] == scenarios.size());
+        }
+    }
+
+    SECTION("Warm fallback is one solve"){
+        //out of range, the warm bracket never closes and strategy 1 finishes inside the warm solve
+        Simulation simulation(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(100.0, 0.0, 0.0), 10.0, 1.0, 0.01);
+        auto result = simulation.solve_angle_warm(20.0, 1.0);
+        REQUIRE(result.best_result.result != Simulation::ShotResultEnum::HIT);
+
+        Instrumentation::Stats stats = Instrumentation::snapshot();
+        if(Instrumentation::ENABLED){
+            REQUIRE(stats.solves.count("strategy1") == 0);
+            const Instrumentation::SolveStats& solve = stats.solves["warm"];
+            REQUIRE(solve.solve_ns.count == 1);
+            REQUIRE(solve.terminations[Instrumentation::NO_IN_RANGE] == 1);
+            //tries is where the best shot was found, every flown shot is counted once
+            REQUIRE(solve.shots_per_solve.sum == Catch::Approx(stats.steps_per_shot.count));
+            REQUIRE(stats.steps_per_shot.count >= result.tries);
+        }
+    }
+}
+
+TEST_CASE("Shot Cache Test", "[cache]") {
+
+    Physics::AIR_DENSITY = 1.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    Simulation::ShotCache cache(1024, 4);
+    Simulation simulation(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(50.0, 0.0, 0.0), 50.0, 1.0, 0.01);
+    simulation.setCache(&cache);
+
+    SECTION("Repeated shot"){
+        auto first = simulation.simulateShot(10.0);
+        auto second = simulation.simulateShot(10.0);
+        REQUIRE(cache.missCount() == 1);
+        REQUIRE(cache.hitCount() == 1);
+        REQUIRE(second.result == first.result);
+        REQUIRE(second.distance == first.distance);
+        REQUIRE(second.time == first.time);
+    }
+
+    SECTION("Environment is part of the key"){
+        simulation.simulateShot(10.0);
+        Physics::AIR_DENSITY = 0.5;
+        simulation.simulateShot(10.0);
+        REQUIRE(cache.missCount() == 2);
+        REQUIRE(cache.hitCount() == 0);
+    }
+
+    SECTION("Repeated solve"){
+        auto uncached = Simulation(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(50.0, 0.0, 0.0), 50.0, 1.0, 0.01).find_angle_strategy2();
+        auto first = simulation.find_angle_strategy2();
+        uint64_t misses = cache.missCount();
+        auto second = simulation.find_angle_strategy2();
+        REQUIRE(cache.missCount() == misses);
+        REQUIRE(first.best_angle == uncached.best_angle);
+        REQUIRE(second.best_angle == first.best_angle);
+        REQUIRE(second.tries == first.tries);
+    }
+
+    SECTION("Least recently used is evicted"){
+        Simulation::ShotCache small(2, 1);
+        simulation.setCache(&small);
+        simulation.simulateShot(1.0);
+        simulation.simulateShot(2.0);
+        simulation.simulateShot(1.0);
+        simulation.simulateShot(3.0);
+        REQUIRE(small.size() == 2);
+        simulation.simulateShot(1.0);
+        REQUIRE(small.hitCount() == 2);
+        simulation.simulateShot(2.0);
+        REQUIRE(small.missCount() == 4);
+    }
+}
+
+TEST_CASE("Trajectory Test", "[trajectory]") {
+
+    //In vacuum the trajectory is an exact parabola, so the spline can be compared against it.
+    Physics::AIR_DENSITY = 0.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    glm::dvec3 shooter_position = glm::dvec3(0.0, 0.0, 0.0);
+    glm::dvec3 target_position = glm::dvec3(100.0, 0.0, 0.0);
+    Simulation simulation(shooter_position, target_position, 50.0, 1.0, 0.001);
+
+    size_t steps = 0;
+    Trajectory trajectory(0.0001);
+    simulation.simulateShot(30.0, [&](const Position& position, const double& time){
+        steps++;
+    }, &trajectory);
+
+    glm::dvec3 initial_velocity = 50.0 * glm::dvec3(glm::cos(glm::radians(30.0)), glm::sin(glm::radians(30.0)), 0.0);
+
+    SECTION("Sparse keyframes"){
+        REQUIRE(trajectory.size() >= 2);
+        REQUIRE(trajectory.size() * 20 < steps);
+        REQUIRE(trajectory.startTime() == 0.0);
+    }
+
+    SECTION("Sub-step sampling"){
+        for(double time = 0.0; time < trajectory.endTime(); time += 0.0137){
+            glm::dvec3 expected_position = shooter_position + initial_velocity * time + 0.5 * Physics::GRAVITY * time * time;
+            glm::dvec3 expected_velocity = initial_velocity + Physics::GRAVITY * time;
+            REQUIRE(glm::length(trajectory.position(time) - expected_position) < 0.001);
+            REQUIRE(glm::length(trajectory.velocity(time) - expected_velocity) < 0.01);
+        }
+    }
+
+    SECTION("Arc length sampling"){
+        auto samples = trajectory.sampleByArcLength(0.5);
+        REQUIRE(samples.size() > 2);
+        for(size_t i = 1; i + 1 < samples.size(); i++){
+            REQUIRE(glm::length(samples[i] - samples[i - 1]) == Catch::Approx(0.5).epsilon(0.01));
+        }
+        REQUIRE(glm::length(samples.back() - trajectory.position(trajectory.endTime())) < 0.000001);
+    }
+
+    SECTION("Closest approach"){
+        //one long span still reproduces the parabola, so the closest approach is found inside it
+        double time = 1.37;
+        glm::dvec3 point = shooter_position + initial_velocity * time + 0.5 * Physics::GRAVITY * time * time;
+        Trajectory::Keyframe a = {0.0, shooter_position, initial_velocity};
+        Trajectory::Keyframe b = {3.0, shooter_position + initial_velocity * 3.0 + 0.5 * Physics::GRAVITY * 9.0, initial_velocity + Physics::GRAVITY * 3.0};
+        REQUIRE(Trajectory::closestApproach(a, b, point) == Catch::Approx(time).epsilon(1e-9));
+        REQUIRE(Trajectory::closestApproach(a, b, shooter_position - initial_velocity) == 0.0);
+        REQUIRE(Trajectory::closestApproach(a, b, b.position + b.velocity) == 3.0);
+    }
+
+    SECTION("Hit with large steps"){
+        //the target sits in the middle of a 0.25 s step where the chord is several centimeters off the path
+        double time = 2.1;
+        glm::dvec3 target = shooter_position + initial_velocity * time + 0.5 * Physics::GRAVITY * time * time;
+        double angle = 30.0 - glm::degrees(std::atan2(target.y, target.x));
+        Simulation coarse(shooter_position, target, 50.0, 1.0, 0.25);
+        auto result = coarse.simulateShot(angle);
+        REQUIRE(result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(result.time == Catch::Approx(time).epsilon(1e-9));
+    }
+
+    SECTION("Drag"){
+        //with drag the spline is no longer exact, every flown step has to stay within tolerance
+        Physics::AIR_DENSITY = 1.0;
+        Simulation fast(shooter_position, glm::dvec3(5000.0, 0.0, 0.0), 300.0, 1.0, 0.001);
+        for(double tolerance : {0.001, 0.01, 0.1}){
+            std::vector<std::pair<double, glm::dvec3>> flown;
+            Trajectory dragged(tolerance);
+            fast.simulateShot(45.0, [&](const Position& position, const double& time){
+                flown.push_back({time, position.position});
+            }, &dragged);
+            REQUIRE(flown.size() > 5000);
+            REQUIRE(dragged.size() > 2);
+            REQUIRE(dragged.size() * 20 < flown.size());
+            double error = 0.0;
+            for(auto& [time, position] : flown){
+                error = std::max(error, glm::length(dragged.position(time) - position));
+            }
+            REQUIRE(error <= tolerance * 1.01);
+        }
+    }
+}
+
+TEST_CASE("Reachability Test", "[reachability]") {
+
+    Physics::AIR_DENSITY = 0.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+    Simulation::REACHABILITY_PRECHECK = true;
+    glm::dvec3 up = glm::dvec3(0.0, 1.0, 0.0);
+
+    SECTION("Vacuum range"){
+        //max range on flat ground is v^2/g, straight up it is v^2/2g
+        auto envelope = Reachability::envelope(30.0, 1.0, 0.01, up, 100.0);
+        REQUIRE(envelope);
+        REQUIRE(envelope->rangeAt(0.0) == Catch::Approx(90.0).epsilon(0.02));
+        REQUIRE(envelope->max_height == Catch::Approx(45.0));
+        REQUIRE(Reachability::classify(envelope.get(), glm::dvec3(0.0), glm::dvec3(80.0, 0.0, 0.0), up) == Reachability::REACHABLE);
+        REQUIRE(Reachability::classify(envelope.get(), glm::dvec3(0.0), glm::dvec3(89.5, 0.0, 0.0), up) == Reachability::MARGINAL);
+        REQUIRE(Reachability::classify(envelope.get(), glm::dvec3(0.0), glm::dvec3(0.0, 0.0, 120.0), up) == Reachability::UNREACHABLE);
+        REQUIRE(Reachability::classify(envelope.get(), glm::dvec3(0.0), glm::dvec3(1.0, 60.0, 0.0), up) == Reachability::UNREACHABLE);
+    }
+
+    SECTION("Rejected without simulating"){
+        Simulation simulation(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(100.0, 0.0, 0.0), 10.0, 10.0, 0.01);
+        size_t shots = 0;
+        auto result = simulation.find_angle_strategy([&](const Simulation::ShotResult& result, const double& angle){
+            shots++;
+        });
+        REQUIRE(result.best_result.result == Simulation::ShotResultEnum::NO_IN_RANGE);
+        REQUIRE(result.tries == 0);
+        REQUIRE(shots == 0);
+        REQUIRE(!result.marginal);
+
+        simulation.setPrecheck(false);
+        REQUIRE(simulation.find_angle_strategy().tries > 0);
+    }
+
+    SECTION("Reachable targets are solved as before"){
+        Simulation simulation(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(10.0, 0.0, 0.0), 10.0, 10.0, 0.0001);
+        auto checked = simulation.find_angle_strategy();
+        Simulation::REACHABILITY_PRECHECK = false;
+        auto unchecked = simulation.find_angle_strategy();
+        Simulation::REACHABILITY_PRECHECK = true;
+        REQUIRE(checked.best_result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(checked.best_angle == unchecked.best_angle);
+        REQUIRE(checked.tries == unchecked.tries);
+        REQUIRE(checked.marginal);
+    }
+}
+
+TEST_CASE("Multi-resolution Strategy Test", "[simulation]") {
+
+    Physics::AIR_DENSITY = 1.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    glm::dvec3 initial_position = glm::dvec3(0.0, 0.0, 0.0);
+    glm::dvec3 target_position = glm::dvec3(80.0, 5.0, 10.0);
+    Simulation simulation(initial_position, target_position, 60.0, 1.0, 0.0005);
+
+    size_t fine_steps = 0;
+    auto fine = simulation.find_angle_strategy(nullptr, [&](const Position& position, const double& time){
+        fine_steps++;
+    });
+    size_t multires_steps = 0;
+    auto multires = simulation.find_angle_strategy_multires(nullptr, [&](const Position& position, const double& time){
+        multires_steps++;
+    });
+
+    REQUIRE(fine.best_result.result == Simulation::ShotResultEnum::HIT);
+    REQUIRE(multires.best_result.result == Simulation::ShotResultEnum::HIT);
+    REQUIRE(multires.best_angle == Catch::Approx(fine.best_angle).margin(0.000001));
+    REQUIRE(multires.best_result.time == Catch::Approx(fine.best_result.time).margin(0.001));
+    REQUIRE(multires_steps < fine_steps / 2);
+
+    SECTION("Out of range"){
+        Simulation::REACHABILITY_PRECHECK = false;
+        Simulation far(initial_position, glm::dvec3(400.0, 0.0, 0.0), 60.0, 1.0, 0.0005);
+        auto result = far.find_angle_strategy_multires();
+        Simulation::REACHABILITY_PRECHECK = true;
+        REQUIRE(result.best_result.result == Simulation::ShotResultEnum::NO_IN_RANGE);
+    }
+}
+
+TEST_CASE("K-ary Strategy Test", "[simulation]") {
+
+    Physics::AIR_DENSITY = 1.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    glm::dvec3 initial_position = glm::dvec3(0.0, 0.0, 0.0);
+    glm::dvec3 target_position = glm::dvec3(80.0, 5.0, 10.0);
+    Simulation simulation(initial_position, target_position, 60.0, 1.0, 0.001);
+
+    auto bisection = simulation.find_angle_strategy();
+    std::mutex mutex;
+    size_t steps = 0;
+    auto kary = simulation.find_angle_strategy_kary(nullptr, [&](const Position& position, const double& time){
+        std::lock_guard<std::mutex> lock(mutex);
+        steps++;
+    });
+
+    REQUIRE(bisection.best_result.result == Simulation::ShotResultEnum::HIT);
+    REQUIRE(kary.best_result.result == Simulation::ShotResultEnum::HIT);
+    REQUIRE(kary.best_angle == Catch::Approx(bisection.best_angle).margin(0.0001));
+    REQUIRE(kary.tries < bisection.tries);
+    REQUIRE(steps > 0);
+
+    SECTION("Out of range"){
+        Simulation::REACHABILITY_PRECHECK = false;
+        Simulation far(initial_position, glm::dvec3(400.0, 0.0, 0.0), 60.0, 1.0, 0.001);
+        auto result = far.find_angle_strategy_kary();
+        Simulation::REACHABILITY_PRECHECK = true;
+        REQUIRE(result.best_result.result == Simulation::ShotResultEnum::NO_IN_RANGE);
+    }
+
+    SECTION("Nested submit"){
+        ThreadPool pool(2);
+        std::vector<std::future<int>> outer;
+        for(int i = 0; i < 8; i++){
+            outer.push_back(pool.submit([&pool, i](){
+                auto inner = pool.submit([i](){ return i * 2; });
+                return pool.wait(inner) + 1;
+            }));
+        }
+        int total = 0;
+        for(auto& future : outer){
+            total += pool.wait(future);
+        }
+        REQUIRE(total == 64);
+    }
+}
+
+TEST_CASE("Barrage Test", "[barrage]") {
+
+    Physics::AIR_DENSITY = 1.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+
+    SECTION("Parallel update matches serial"){
+        entt::registry serial;
+        entt::registry parallel;
+        for(int i = 0; i < 20000; i++){
+            glm::dvec3 velocity = glm::dvec3(10.0 + i % 97, 20.0 + i % 13, i % 7);
+            for(auto* registry : {&serial, &parallel}){
+                auto entity = registry->create();
+                registry->emplace<Position>(entity, glm::dvec3(0.0), glm::dvec3(0.0));
+                registry->emplace<Velocity>(entity, velocity);
+                registry->emplace<Mass>(entity, Mass{1.0, 0.01});
+            }
+        }
+
+        size_t threshold = Physics::PARALLEL_THRESHOLD;
+        for(int step = 0; step < 10; step++){
+            Physics::PARALLEL_THRESHOLD = std::numeric_limits<size_t>::max();
+            Physics::update(serial, 0.01);
+            Physics::PARALLEL_THRESHOLD = 1;
+            Physics::update(parallel, 0.01);
+        }
+        Physics::PARALLEL_THRESHOLD = threshold;
+
+        auto a = serial.group<Position, Velocity, Mass>();
+        auto b = parallel.group<Position, Velocity, Mass>();
+        REQUIRE(a.size() == b.size());
+        for(auto entity : a){
+            REQUIRE(a.get<Position>(entity).position == b.get<Position>(entity).position);
+            REQUIRE(a.get<Velocity>(entity).velocity == b.get<Velocity>(entity).velocity);
+        }
+    }
+
+    SECTION("Group smaller than a chunk"){
+        entt::registry serial;
+        entt::registry parallel;
+        for(int i = 0; i < 10; i++){
+            for(auto* registry : {&serial, &parallel}){
+                auto entity = registry->create();
+                registry->emplace<Position>(entity, glm::dvec3(0.0), glm::dvec3(0.0));
+                registry->emplace<Velocity>(entity, glm::dvec3(10.0 + i, 20.0, i));
+                registry->emplace<Mass>(entity, Mass{1.0, 0.01});
+            }
+        }
+
+        size_t threshold = Physics::PARALLEL_THRESHOLD;
+        size_t chunk = Physics::PARALLEL_CHUNK;
+        Physics::PARALLEL_CHUNK = 4096;
+        for(int step = 0; step < 10; step++){
+            Physics::PARALLEL_THRESHOLD = std::numeric_limits<size_t>::max();
+            Physics::update(serial, 0.01);
+            Physics::PARALLEL_THRESHOLD = 1;
+            Physics::update(parallel, 0.01);
+        }
+        Physics::PARALLEL_THRESHOLD = threshold;
+        Physics::PARALLEL_CHUNK = chunk;
+
+        auto a = serial.group<Position, Velocity, Mass>();
+        auto b = parallel.group<Position, Velocity, Mass>();
+        REQUIRE(a.size() == b.size());
+        for(auto entity : a){
+            REQUIRE(a.get<Position>(entity).position == b.get<Position>(entity).position);
+        }
+    }
+
+    SECTION("Salvo lands and is retired"){
+        Physics::AIR_DENSITY = 0.0;
+        Barrage barrage;
+        barrage.salvo(glm::dvec3(0.0), 50.0, 45.0, 0.0, 0.0, 1000, 1.0, 1.0, 0.01);
+        REQUIRE(barrage.scheduled() == 1000);
+
+        //vacuum flight time at 45 degrees is 2 v sin(45) / g
+        double flight = 2.0 * 50.0 * std::sin(glm::radians(45.0)) / 10.0;
+        while(barrage.currentTime() < 1.0 + flight + 0.1){
+            barrage.step(0.01);
+            REQUIRE(barrage.active() + barrage.scheduled() + barrage.impacted() == 1000);
+        }
+        REQUIRE(barrage.active() == 0);
+        REQUIRE(barrage.impacted() == 1000);
+        REQUIRE(barrage.registry.group<Position, Velocity, Mass>().size() == 0);
+
+        for(const auto& impact : barrage.recentImpacts()){
+            REQUIRE(glm::length(impact.position) == Catch::Approx(250.0).margin(0.5));
+        }
+    }
+
+    SECTION("Impact in the launch step"){
+        //launched halfway through the step, 1 m up at 100 m/s downward, lands 0.01 s later
+        Physics::AIR_DENSITY = 0.0;
+        Barrage barrage;
+        barrage.schedule({0.05, glm::dvec3(0.0, 1.0, 0.0), glm::dvec3(0.0, -100.0, 0.0), 1.0, 0.0});
+        barrage.step(0.1);
+        REQUIRE(barrage.impacted() == 1);
+        REQUIRE(barrage.recentImpacts().back().time == Catch::Approx(0.06).margin(1e-4));
+
+        size_t count = 0;
+        barrage.each([&](const Position&, const Velocity&){ count++; });
+        REQUIRE(count == 0);
+    }
+}
+
+TEST_CASE("Terrain Test", "[terrain]") {
+
+    SECTION("Flat ground"){
+        Terrain terrain(101, 101, 1.0, -50.0, -50.0, std::vector<double>(101 * 101, 0.0));
+        double fraction = -1.0;
+        REQUIRE(terrain.intersect(glm::dvec3(10.0, 5.0, 10.0), glm::dvec3(12.0, -1.0, 10.0), fraction));
+        REQUIRE(fraction == Catch::Approx(5.0 / 6.0));
+        REQUIRE_FALSE(terrain.intersect(glm::dvec3(-40.0, 0.5, -40.0), glm::dvec3(40.0, 0.1, 40.0), fraction));
+        REQUIRE_FALSE(terrain.intersect(glm::dvec3(60.0, 5.0, 0.0), glm::dvec3(70.0, -5.0, 0.0), fraction));
+        //starting on the surface and going up is not an impact
+        REQUIRE_FALSE(terrain.intersect(glm::dvec3(0.0, 0.0, 0.0), glm::dvec3(1.0, 1.0, 0.0), fraction));
+        //wholly under the ground hits where it starts, running off the grid does not
+        REQUIRE(terrain.intersect(glm::dvec3(-30.0, -5.0, 10.0), glm::dvec3(30.0, -3.0, 12.0), fraction));
+        REQUIRE(fraction == 0.0);
+        REQUIRE(terrain.intersect(glm::dvec3(40.0, -5.0, 0.0), glm::dvec3(80.0, -5.0, 0.0), fraction));
+        REQUIRE(fraction == 0.0);
+        REQUIRE_FALSE(terrain.intersect(glm::dvec3(55.0, -5.0, 0.0), glm::dvec3(80.0, -5.0, 0.0), fraction));
+        REQUIRE(terrain.height(3.5, -2.0) == 0.0);
+    }
+
+    SECTION("Matches dense sampling"){
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<double> noise(-3.0, 3.0);
+        int width = 65;
+        int depth = 49;
+        std::vector<double> heights(width * depth);
+        for(int j = 0; j < depth; j++){
+            for(int i = 0; i < width; i++){
+                heights[j * width + i] = 5.0 * std::sin(i * 0.2) * std::cos(j * 0.15) + noise(generator);
+            }
+        }
+        Terrain terrain(width, depth, 2.0, -10.0, 4.0, heights);
+        REQUIRE(terrain.minHeight() <= terrain.maxHeight());
+
+        std::uniform_real_distribution<double> x(-20.0, 130.0);
+        std::uniform_real_distribution<double> y(-10.0, 12.0);
+        std::uniform_real_distribution<double> z(-5.0, 105.0);
+        int hits = 0;
+        for(int k = 0; k < 300; k++){
+            glm::dvec3 a(x(generator), y(generator), z(generator));
+            glm::dvec3 b(x(generator), y(generator), z(generator));
+
+            double expected = -1.0;
+            const int samples = 200000;
+            for(int n = 0; n <= samples; n++){
+                double t = (double)n / samples;
+                glm::dvec3 p = a + (b - a) * t;
+                if(p.y < terrain.height(p.x, p.z)){
+                    expected = t;
+                    break;
+                }
+            }
+
+            double fraction = -1.0;
+            bool hit = terrain.intersect(a, b, fraction);
+            REQUIRE(hit == (expected >= 0.0));
+            if(hit){
+                hits++;
+                REQUIRE(fraction == Catch::Approx(expected).margin(2.0 / samples));
+            }
+
+            //walking the cells without splitting first halves ranges that cross too many grid lines
+            int split_depth = Terrain::MAX_SPLIT_DEPTH;
+            Terrain::MAX_SPLIT_DEPTH = 0;
+            double walked = -1.0;
+            REQUIRE(terrain.intersect(a, b, walked) == hit);
+            Terrain::MAX_SPLIT_DEPTH = split_depth;
+            if(hit){
+                REQUIRE(walked == Catch::Approx(fraction).margin(1e-12));
+            }
+        }
+        REQUIRE(hits > 20);
+    }
+
+    SECTION("Shots stop on the ground"){
+        Physics::AIR_DENSITY = 0.0;
+        Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+        Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+        Simulation::HIT_TRASHOLD = 0.0001;
+        Simulation::MAX_SIMULATION_TIME = 100.0;
+
+        int size = 201;
+        std::vector<double> flat(size * size, 0.0);
+        std::vector<double> ridge = flat;
+        for(int j = 0; j < size; j++){
+            for(int i = 140; i <= 145; i++){
+                ridge[j * size + i] = 20.0;
+            }
+        }
+        Terrain ground(size, size, 1.0, -100.0, -100.0, flat);
+        Terrain wall(size, size, 1.0, -100.0, -100.0, ridge);
+
+        glm::dvec3 shooter(0.0, 1.0, 0.0);
+        glm::dvec3 target(80.0, 0.5, 0.0);
+        Simulation simulation(shooter, target, 60.0, 1.0, 0.001);
+
+        simulation.setTerrain(&wall);
+        auto blocked = simulation.simulateShot(0.0);
+        REQUIRE(blocked.result == Simulation::ShotResultEnum::TERRAIN);
+        REQUIRE(blocked.time < 40.0 / 60.0 + 0.01);
+
+        auto open = Simulation(shooter, target, 60.0, 1.0, 0.001).find_angle_strategy();
+        simulation.setTerrain(&ground);
+        REQUIRE(simulation.simulateShot(0.0).result == Simulation::ShotResultEnum::TERRAIN);
+        auto grounded = simulation.find_angle_strategy();
+        REQUIRE(open.best_result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(grounded.best_result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(grounded.best_angle == Catch::Approx(open.best_angle).margin(0.0001));
+
+        //the same scene with x up, the terrain frame turns with UP_VECTOR
+        Physics::GRAVITY = glm::dvec3(-10.0, 0.0, 0.0);
+        Simulation::UP_VECTOR = glm::dvec3(1.0, 0.0, 0.0);
+        auto turn = [](const glm::dvec3& point){
+            return glm::dvec3(point.y, point.z, point.x);
+        };
+        Simulation turned(turn(shooter), turn(target), 60.0, 1.0, 0.001);
+        turned.setTerrain(&wall);
+        auto turned_blocked = turned.simulateShot(0.0);
+        REQUIRE(turned_blocked.result == Simulation::ShotResultEnum::TERRAIN);
+        REQUIRE(turned_blocked.time == Catch::Approx(blocked.time).margin(1e-9));
+        turned.setTerrain(&ground);
+        auto turned_grounded = turned.find_angle_strategy();
+        REQUIRE(turned_grounded.best_result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(turned_grounded.best_angle == Catch::Approx(grounded.best_angle).margin(0.0001));
+        Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+        Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+
+        REQUIRE(std::string(Batch::resultName(Simulation::ShotResultEnum::TERRAIN)) == "TERRAIN");
+    }
+}
+
+TEST_CASE("Service Test", "[service]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.0000001;
+
+    std::string path = "/tmp/ballistics_service_test_" + std::to_string(::getpid()) + ".sock";
+    double window = Service::BATCH_WINDOW_MS;
+    size_t max_line = Service::MAX_LINE;
+    Service::BATCH_WINDOW_MS = 20.0;
+    Service::MAX_LINE = 1000;
+    Service service(path, 2);
+    service.start();
+
+    Batch::Scenario scenario;
+    scenario.shooter_position = glm::dvec3(0.0, 0.0, 0.0);
+    scenario.target_position = glm::dvec3(100.0, 0.0, 0.0);
+    scenario.shoot_speed = 100.0;
+    scenario.shoot_height = 1.0;
+    scenario.delta_time = 0.01;
+
+    SECTION("Request and response"){
+        ServiceClient client(path);
+        Service::Message response;
+        REQUIRE(Service::parseMessage(client.request(Service::requestJson(42, scenario)), response));
+        Simulation::StrategyResult expected = Batch::solve(scenario);
+        REQUIRE(response.number("id") == 42.0);
+        REQUIRE(response.strings["result"] == Batch::resultName(expected.best_result.result));
+        REQUIRE(response.number("angle") == expected.best_angle);
+        REQUIRE(response.number("tries") == expected.tries);
+
+        REQUIRE(Service::parseMessage(client.request("{\"id\":3,\"shooter\":[0,0]}"), response));
+        REQUIRE(response.number("id") == 3.0);
+        REQUIRE(response.strings.count("error") == 1);
+        REQUIRE(Service::parseMessage(client.request("not json"), response));
+        REQUIRE(response.strings.count("error") == 1);
+
+        for(const char* invalid : {"\"dt\":0", "\"dt\":-0.01", "\"mass\":0", "\"strategy\":7", "\"strategy\":nan", "\"strategy\":1.5"}){
+            std::string line = Service::requestJson(5, scenario);
+            std::string key = std::string(invalid).substr(0, std::string(invalid).find(':') + 1);
+            size_t begin = line.find(key);
+            size_t end = line.find_first_of(",}", begin);
+            line.replace(begin, end - begin, invalid);
+            REQUIRE(Service::parseMessage(client.request(line), response));
+            REQUIRE(response.number("id") == 5.0);
+            REQUIRE(response.strings.count("error") == 1);
+        }
+    }
+
+    SECTION("Slow reader"){
+        //a client that sends and does not read has its answers buffered, everyone else is still answered
+        sockaddr_un address = Service::socketAddress(path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        REQUIRE(::connect(fd, (sockaddr*)&address, sizeof(address)) == 0);
+        std::string requests;
+        for(int i = 0; i < 5000; i++){
+            requests += "{\"stats\":true}\n";
+        }
+        REQUIRE(::send(fd, requests.data(), requests.size(), MSG_NOSIGNAL) == (ssize_t)requests.size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        ServiceClient client(path);
+        Service::Message response;
+        REQUIRE(Service::parseMessage(client.request(Service::requestJson(7, scenario)), response));
+        REQUIRE(response.number("id") == 7.0);
+
+        size_t lines = 0;
+        char buffer[65536];
+        while(lines < 5000){
+            ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+            REQUIRE(count > 0);
+            lines += std::count(buffer, buffer + count, '\n');
+        }
+        ::close(fd);
+    }
+
+    SECTION("Line too long"){
+        sockaddr_un address = Service::socketAddress(path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        REQUIRE(::connect(fd, (sockaddr*)&address, sizeof(address)) == 0);
+        std::string line(2000, ' ');
+        REQUIRE(::send(fd, line.data(), line.size(), MSG_NOSIGNAL) == (ssize_t)line.size());
+        std::string received;
+        char buffer[4096];
+        ssize_t count;
+        while((count = ::recv(fd, buffer, sizeof(buffer), 0)) > 0){
+            received.append(buffer, count);
+        }
+        REQUIRE(count == 0);
+        REQUIRE(received.find("\"error\"") != std::string::npos);
+        ::close(fd);
+    }
+
+    SECTION("Load is batched"){
+        std::vector<Batch::Scenario> scenarios;
+        for(int i = 0; i < 8; i++){
+            scenario.target_position.x = 50.0 + 10.0 * i;
+            scenarios.push_back(scenario);
+        }
+        ServiceClient::LoadResult result = ServiceClient::load(path, scenarios, 8, 200);
+        REQUIRE(result.requests == 200);
+        REQUIRE(result.errors == 0);
+        REQUIRE(result.p50_ms <= result.p99_ms);
+
+        ServiceClient client(path);
+        Service::Message stats;
+        REQUIRE(Service::parseMessage(client.request("{\"stats\":true}"), stats));
+        REQUIRE(stats.number("requests") == 200.0);
+        REQUIRE(stats.number("batches") < 200.0);
+        REQUIRE(stats.number("mean_batch") > 1.0);
+        REQUIRE(stats.number("p99_ms") > 0.0);
+    }
+
+    service.stop();
+    Service::BATCH_WINDOW_MS = window;
+    Service::MAX_LINE = max_line;
+    REQUIRE(::access(path.c_str(), F_OK) != 0);
+}
+
+TEST_CASE("Safety Fan Test", "[safety_fan]") {
+
+    Physics::AIR_DENSITY = 0.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    Simulation simulation(glm::dvec3(0.0), glm::dvec3(100.0, 0.0, 0.0), 50.0, 1.0, 0.001);
+
+    Simulation::Flight flight = simulation.simulateFlight(45.0, 0.0, 0.0);
+    REQUIRE(flight.landed);
+    REQUIRE(flight.impact.x == Catch::Approx(250.0).margin(0.1));
+    REQUIRE(flight.time == Catch::Approx(2.0 * 50.0 * std::sin(glm::radians(45.0)) / 10.0).margin(0.001));
+
+    SafetyFan::Settings settings;
+    settings.initial_rays = 5;
+    settings.tolerance = 2.0;
+    SafetyFan::Result fan = SafetyFan::compute(simulation, settings);
+
+    REQUIRE(fan.rays.size() > 5);
+    REQUIRE((int)fan.rays.size() <= settings.max_rays);
+    REQUIRE(fan.max_range == Catch::Approx(250.0).margin(1.0));
+    REQUIRE(fan.max_height == Catch::Approx(125.0).margin(0.5));
+    for(size_t i = 0; i + 1 < fan.rays.size(); i++){
+        REQUIRE(fan.rays[i].angle < fan.rays[i + 1].angle);
+        REQUIRE(SafetyFan::gap(fan.rays[i], fan.rays[i + 1]) <= settings.tolerance);
+    }
+    //the outer profile at range r is the vacuum envelope v^2/2g - g r^2/2v^2
+    for(const glm::dvec2& point : fan.profile){
+        if(point.x < 240.0){
+            REQUIRE(point.y == Catch::Approx(125.0 - 10.0 * point.x * point.x / (2.0 * 2500.0)).margin(3.0));
+        }
+    }
+
+    SECTION("Azimuths"){
+        settings.azimuths = 3;
+        settings.azimuth_span = 90.0;
+        SafetyFan::Result wide = SafetyFan::compute(simulation, settings);
+        REQUIRE(wide.outline.size() == 3);
+        for(size_t i = 0; i < 3; i++){
+            double azimuth = glm::radians(-45.0 + 45.0 * i);
+            REQUIRE(glm::length(wide.outline[i]) == Catch::Approx(250.0).margin(1.0));
+            REQUIRE(std::abs(std::atan2(-wide.outline[i].z, wide.outline[i].x) - azimuth) < 0.01);
+        }
+    }
+
+    SECTION("Drag"){
+        //the fan is read from the sparse trajectories, its apex has to match the highest flown step
+        Physics::AIR_DENSITY = 1.0;
+        SafetyFan::Result dragged = SafetyFan::compute(simulation, settings);
+        double step_height = 0.0;
+        for(const SafetyFan::Ray& ray : dragged.rays){
+            entt::registry registry;
+            auto projectile = simulation.launch(registry, simulation.launchVelocity(ray.angle, ray.azimuth));
+            for(double time = 0.0; time < ray.flight.time; time += 0.001){
+                Physics::update(registry, 0.001);
+                step_height = std::max(step_height, registry.get<Position>(projectile).position.y);
+            }
+        }
+        REQUIRE(dragged.max_height < 100.0);
+        //samples are 0.5 * range_bin apart along the path, the apex can fall between two of them
+        REQUIRE(dragged.max_height == Catch::Approx(step_height).margin(0.25 * settings.range_bin));
+    }
+}
+
+TEST_CASE("Accuracy Test", "[accuracy]") {
+
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    SECTION("Integrator order"){
+        Physics::AIR_DENSITY = 1.225;
+        Mass mass = {1.0, 0.01};
+        auto fly = [&](Physics::Integrator integrator, double delta_time){
+            Physics::INTEGRATOR = integrator;
+            Position position = {glm::dvec3(0.0), glm::dvec3(0.0)};
+            Velocity velocity = {glm::dvec3(80.0, 60.0, 0.0)};
+            int steps = (int)std::lround(2.0 / delta_time);
+            for(int i = 0; i < steps; i++){
+                Physics::integrate(position, velocity, mass, delta_time);
+            }
+            return position.position;
+        };
+        glm::dvec3 exact = fly(Physics::RK4, 0.0001);
+
+        //halving the step divides the error by 2^order
+        auto ratio = [&](Physics::Integrator integrator){
+            double coarse = glm::length(fly(integrator, 0.02) - exact);
+            double fine = glm::length(fly(integrator, 0.01) - exact);
+            return coarse / fine;
+        };
+        REQUIRE(ratio(Physics::EULER) == Catch::Approx(2.0).margin(0.2));
+        REQUIRE(ratio(Physics::HEUN) == Catch::Approx(4.0).margin(0.4));
+        REQUIRE(ratio(Physics::RK4) == Catch::Approx(16.0).margin(2.0));
+        Physics::INTEGRATOR = Physics::TRAPEZOID;
+    }
+
+    SECTION("Harness"){
+        Physics::AIR_DENSITY = 0.0;
+        std::vector<Batch::Scenario> scenarios(2);
+        scenarios[0].target_position = glm::dvec3(100.0, 0.0, 0.0);
+        scenarios[1].target_position = glm::dvec3(60.0, 10.0, 30.0);
+        for(auto& scenario : scenarios){
+            scenario.shooter_position = glm::dvec3(0.0);
+            scenario.shoot_speed = 50.0;
+            scenario.shoot_height = 1.0;
+            scenario.delta_time = 0.01;
+            scenario.strategy = 1;
+        }
+
+        double reference = Accuracy::REFERENCE_DELTA_TIME;
+        Accuracy::REFERENCE_DELTA_TIME = 0.001;
+        auto measurements = Accuracy::run(scenarios, {Physics::EULER, Physics::RK4}, {0.02, 0.01});
+        Accuracy::REFERENCE_DELTA_TIME = reference;
+        REQUIRE(measurements.size() == 8);
+        REQUIRE(Physics::INTEGRATOR == Physics::TRAPEZOID);
+
+        for(const auto& measurement : measurements){
+            REQUIRE(measurement.result == Simulation::ShotResultEnum::HIT);
+            REQUIRE(measurement.steps > 0);
+            if(measurement.configuration.integrator == Physics::RK4){
+                //constant acceleration is integrated exactly
+                REQUIRE(measurement.analytic_error < 0.001);
+            }
+        }
+
+        auto points = Accuracy::pareto(measurements);
+        REQUIRE(points.size() == 4);
+        for(size_t i = 0; i + 1 < points.size(); i++){
+            REQUIRE(points[i].evaluations <= points[i + 1].evaluations);
+        }
+        REQUIRE(points[0].pareto);
+        for(const auto& point : points){
+            if(point.configuration.integrator == Physics::EULER){
+                REQUIRE(point.max_angle_error > 0.001);
+            }
+        }
+
+        std::string csv = Accuracy::csv(points);
+        REQUIRE(std::count(csv.begin(), csv.end(), '\n') == 5);
+        std::string json = Accuracy::json(points, measurements);
+        REQUIRE(json.find("\"pareto\": true") != std::string::npos);
+        REQUIRE(json.find("nan") == std::string::npos);
+    }
+}
+
+TEST_CASE("Uncertainty Test", "[uncertainty]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+    Simulation::AIR_RESISTANCE = 0.01;
+
+    Simulation simulation(glm::dvec3(0.0), glm::dvec3(150.0, 10.0, 30.0), 150.0, 1.0, 0.01);
+    auto solved = simulation.find_angle(Simulation::THREE_POINT);
+    REQUIRE(solved.best_result.result == Simulation::ShotResultEnum::HIT);
+
+    Uncertainty::Inputs sigma;
+    sigma.speed = 0.5;
+    sigma.air_resistance = 0.0005;
+    sigma.mass = 0.02;
+    sigma.angle = 0.05;
+    sigma.azimuth = 0.05;
+    sigma.wind = glm::dvec3(1.0, 0.5, 1.0);
+
+    SECTION("Nominal shot"){
+        auto result = Uncertainty::propagate(simulation, solved.best_angle, 0.0, Uncertainty::Inputs(), 1.0);
+        REQUIRE(result.reached);
+        REQUIRE(result.time == Catch::Approx(solved.best_result.time).epsilon(1e-6));
+        REQUIRE(glm::length(result.miss) < 0.001);
+        REQUIRE(result.covariance[0][0] == 0.0);
+        REQUIRE(result.hit_probability == 1.0);
+        REQUIRE(std::abs(glm::dot(result.normal, result.lateral)) < 1e-12);
+        REQUIRE(std::abs(glm::dot(result.normal, result.vertical)) < 1e-12);
+    }
+
+    SECTION("Against Monte Carlo"){
+        auto linear = Uncertainty::propagate(simulation, solved.best_angle, 0.0, sigma, 1.0);
+        auto sampled = Uncertainty::sample(simulation, solved.best_angle, 0.0, sigma, 1.0, 4000, 7);
+
+        //one shot against thousands
+        REQUIRE(linear.steps * 1000 < sampled.steps);
+        REQUIRE(glm::length(linear.miss - sampled.miss) < 0.1);
+        REQUIRE(linear.covariance[0][0] == Catch::Approx(sampled.covariance[0][0]).epsilon(0.1));
+        REQUIRE(linear.covariance[1][1] == Catch::Approx(sampled.covariance[1][1]).epsilon(0.1));
+        REQUIRE(std::abs(linear.covariance[0][1]) < 0.1 * std::sqrt(sampled.covariance[0][0] * sampled.covariance[1][1]) + std::abs(sampled.covariance[0][1]));
+        REQUIRE(linear.hit_probability == Catch::Approx(sampled.hit_probability).margin(0.03));
+
+        double trace = linear.world_covariance[0][0] + linear.world_covariance[1][1] + linear.world_covariance[2][2];
+        REQUIRE(trace == Catch::Approx(linear.covariance[0][0] + linear.covariance[1][1]).epsilon(1e-9));
+    }
+
+    SECTION("Every input"){
+        //each column of the sensitivities on its own
+        for(int parameter = 0; parameter < Uncertainty::PARAMETERS; parameter++){
+            Uncertainty::Inputs single;
+            switch(parameter){
+                case Uncertainty::SPEED: single.speed = sigma.speed; break;
+                case Uncertainty::AIR_RESISTANCE: single.air_resistance = sigma.air_resistance; break;
+                case Uncertainty::MASS: single.mass = sigma.mass; break;
+                case Uncertainty::ANGLE: single.angle = sigma.angle; break;
+                case Uncertainty::AZIMUTH: single.azimuth = sigma.azimuth; break;
+                case Uncertainty::WIND_X: single.wind.x = sigma.wind.x; break;
+                case Uncertainty::WIND_Y: single.wind.y = sigma.wind.y; break;
+                default: single.wind.z = sigma.wind.z; break;
+            }
+            auto linear = Uncertainty::propagate(simulation, solved.best_angle, 0.0, single, 1.0);
+            auto sampled = Uncertainty::sample(simulation, solved.best_angle, 0.0, single, 1.0, 2000, parameter + 1);
+            double expected = sampled.covariance[0][0] + sampled.covariance[1][1];
+            REQUIRE(expected > 0.0);
+            REQUIRE(linear.covariance[0][0] + linear.covariance[1][1] == Catch::Approx(expected).epsilon(0.1));
+        }
+    }
+
+    SECTION("Disk probability"){
+        //circular normal: 1 - exp(-r^2 / 2 sigma^2)
+        glm::dmat2 covariance(0.0);
+        covariance[0][0] = 4.0;
+        covariance[1][1] = 4.0;
+        REQUIRE(Uncertainty::diskProbability(glm::dvec2(0.0), covariance, 2.0) == Catch::Approx(1.0 - std::exp(-0.5)).margin(1e-6));
+        REQUIRE(Uncertainty::diskProbability(glm::dvec2(0.0), glm::dmat2(0.0), 1.0) == 1.0);
+        REQUIRE(Uncertainty::diskProbability(glm::dvec2(2.0, 0.0), glm::dmat2(0.0), 1.0) == 0.0);
+        REQUIRE(Uncertainty::diskProbability(glm::dvec2(100.0, 0.0), covariance, 1.0) < 1e-9);
+    }
+}
+
+TEST_CASE("Heatmap Test", "[heatmap]") {
+
+    //in vacuum every target closer than v^2 / g at the shooter's height is reachable
+    Physics::AIR_DENSITY = 0.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -10.0, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    Heatmap::Settings settings;
+    settings.extent = 150.0;
+    settings.shoot_speed = 35.0;
+    settings.coarse = 4;
+    settings.levels = 2;
+    double max_range = 35.0 * 35.0 / 10.0;
+
+    SECTION("Warm start"){
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(80.0, 0.0, 20.0), 35.0, 1.0, 0.01);
+        auto cold = simulation.find_angle_strategy(nullptr, nullptr);
+        REQUIRE(cold.best_result.result == Simulation::ShotResultEnum::HIT);
+        auto warm = simulation.find_angle_warm(cold.best_angle + 0.3, 0.5);
+        REQUIRE(warm.best_result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(warm.best_angle == Catch::Approx(cold.best_angle).margin(1e-6));
+        REQUIRE(warm.tries < cold.tries);
+
+        //a guess on the wrong side of the bracket is widened until it holds
+        auto far = simulation.find_angle_warm(cold.best_angle + 20.0, 0.1);
+        REQUIRE(far.best_result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(far.best_angle == Catch::Approx(cold.best_angle).margin(1e-6));
+    }
+
+    SECTION("Refinement"){
+        Heatmap heatmap;
+        heatmap.run(settings);
+        REQUIRE(heatmap.done());
+        REQUIRE(heatmap.size() == 17);
+        REQUIRE(heatmap.solved() < 17 * 17);
+        REQUIRE(heatmap.warmSolves() > heatmap.coldSolves());
+
+        for(int j = 0; j < heatmap.size(); j++){
+            for(int i = 0; i < heatmap.size(); i++){
+                const Heatmap::Sample* sample = heatmap.lookup(i, j);
+                REQUIRE(sample != nullptr);
+                if(&heatmap.at(i, j) != sample){
+                    continue;
+                }
+                double range = glm::length(heatmap.target(i, j));
+                if(std::abs(range - max_range) < 1.0){
+                    continue;
+                }
+                REQUIRE((sample->result == Simulation::ShotResultEnum::HIT) == (range < max_range));
+                if(sample->result == Simulation::ShotResultEnum::HIT && range > 0.0){
+                    double v2 = 35.0 * 35.0;
+                    double elevation = glm::degrees(std::atan((v2 - std::sqrt(v2 * v2 - 100.0 * range * range)) / (10.0 * range)));
+                    REQUIRE(sample->elevation == Catch::Approx(elevation).margin(1e-4));
+                }
+            }
+        }
+
+        //the edge of the reachable disk is refined down to the finest level
+        int edge = 0;
+        for(int i = 0; i + 1 < heatmap.size(); i++){
+            const Heatmap::Sample& a = heatmap.at(i, 4);
+            const Heatmap::Sample& b = heatmap.at(i + 1, 4);
+            if(a.state == Heatmap::SOLVED && b.state == Heatmap::SOLVED
+               && (a.result == Simulation::ShotResultEnum::HIT) != (b.result == Simulation::ShotResultEnum::HIT)){
+                edge++;
+            }
+        }
+        REQUIRE(edge == 2);
+    }
+
+    SECTION("Stop"){
+        Heatmap heatmap;
+        settings.levels = 6;
+        heatmap.start(settings);
+        heatmap.stop();
+        REQUIRE(heatmap.solved() <= (uint64_t)(heatmap.size() * heatmap.size()));
+        heatmap.start(settings);
+    }
+}
+
+TEST_CASE("Shards Test", "[shards]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    std::string directory = "/tmp/ballistics_shards_test_" + std::to_string(::getpid());
+    std::string input = directory + ".txt";
+    {
+        std::ofstream file(input);
+        file << "# shooter target speed mass dt strategy\n";
+        std::mt19937 generator(5);
+        std::uniform_real_distribution<double> distance(20.0, 200.0);
+        std::uniform_real_distribution<double> offset(-20.0, 20.0);
+        for(int i = 0; i < 30; i++){
+            file << "0 0 0 " << distance(generator) << ' ' << offset(generator) << ' ' << offset(generator) << " 100 1 0.01 " << (i % 2 + 1) << '\n';
+            if(i == 10){
+                file << '\n';
+            }
+        }
+    }
+
+    //strategies outside 1..4 are rejected, a missing one is strategy 2
+    Batch::Scenario parsed;
+    REQUIRE(Batch::parseScenario("0 0 0 100 0 0 100 1 0.01 4", parsed));
+    REQUIRE(parsed.strategy == 4);
+    REQUIRE(Batch::parseScenario("0 0 0 100 0 0 100 1 0.01", parsed));
+    REQUIRE(parsed.strategy == 2);
+    REQUIRE_FALSE(Batch::parseScenario("0 0 0 100 0 0 100 1 0.01 7", parsed));
+    REQUIRE_FALSE(Batch::parseScenario("0 0 0 100 0 0 100 1 0.01 0", parsed));
+
+    std::string expected;
+    auto results = Batch::run(Batch::load(input));
+    for(size_t i = 0; i < results.size(); i++){
+        expected += Batch::format(i, results[i]) + '\n';
+    }
+
+    //the workers are exec'd, they run with the default environment set above and a CHECKPOINT_BLOCK of 4
+    Shards::Settings settings;
+    settings.shards = 3;
+    settings.processes = 2;
+    settings.executable = SHARD_WORKER;
+
+    SECTION("Merge matches one process"){
+        std::ostringstream output;
+        auto report = Shards::run(input, directory, settings, output);
+        REQUIRE(output.str() == expected);
+        REQUIRE(report.scenarios == 30);
+        REQUIRE(report.launched == 3);
+        REQUIRE(report.restarts == 0);
+
+        //a second run finds every shard finished
+        std::ostringstream again;
+        report = Shards::run(input, directory, settings, again);
+        REQUIRE(again.str() == expected);
+        REQUIRE(report.launched == 0);
+        REQUIRE(report.reused == 3);
+    }
+
+    SECTION("Restart from checkpoint"){
+        //the first worker of shard 1 dies after 6 results and half a line
+        ::setenv("SHARD_WORKER_FAULT", "restart", 1);
+        settings.threads = 2;
+        std::ostringstream output;
+        auto report = Shards::run(input, directory, settings, output);
+        REQUIRE(output.str() == expected);
+        REQUIRE(report.restarts == 1);
+        REQUIRE(report.launched == 4);
+    }
+
+    SECTION("Failing shard"){
+        ::setenv("SHARD_WORKER_FAULT", "fail", 1);
+        settings.max_restarts = 1;
+        std::ostringstream output;
+        REQUIRE_THROWS(Shards::run(input, directory, settings, output));
+        REQUIRE(output.str().empty());
+    }
+
+    ::unsetenv("SHARD_WORKER_FAULT");
+    for(size_t shard = 0; shard < 3; shard++){
+        ::unlink(Shards::inputPath(directory, shard).c_str());
+        ::unlink(Shards::partialPath(directory, shard).c_str());
+        ::unlink(Shards::outputPath(directory, shard).c_str());
+    }
+    ::unlink((directory + "/manifest").c_str());
+    ::rmdir(directory.c_str());
+    ::unlink(input.c_str());
+}
+
+TEST_CASE("Charge Test", "[charge]") {
+
+    Physics::AIR_DENSITY = 0.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    Simulation simulation(glm::dvec3(0.0), glm::dvec3(100.0, 0.0, 0.0), 100.0, 1.0, 0.01);
+    Charge::Constraints constraints;
+
+    SECTION("Minimum speed"){
+        //in vacuum the slowest shot to a level target is fired at 45 degrees with v^2 = g x
+        auto solution = Charge::solve(simulation, constraints);
+        REQUIRE(solution.found);
+        REQUIRE(solution.result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(solution.speed == Catch::Approx(std::sqrt(9.81 * 100.0)).margin(constraints.speed_tolerance));
+        REQUIRE(solution.elevation == Catch::Approx(45.0).margin(1.0));
+
+        constraints.max_speed = 30.0;
+        solution = Charge::solve(simulation, constraints);
+        REQUIRE_FALSE(solution.found);
+        REQUIRE(solution.shots == 0);
+    }
+
+    SECTION("Time of flight"){
+        //low arc with t = 3 s: vertical speed g t / 2, horizontal x / t
+        constraints.max_time = 3.0;
+        auto solution = Charge::solve(simulation, constraints);
+        REQUIRE(solution.found);
+        REQUIRE(solution.result.time <= 3.0);
+        double expected = std::sqrt(std::pow(9.81 * 1.5, 2.0) + std::pow(100.0 / 3.0, 2.0));
+        REQUIRE(solution.speed == Catch::Approx(expected).margin(2.0 * constraints.speed_tolerance));
+        REQUIRE(solution.shots < 100);
+    }
+
+    SECTION("Impact angle"){
+        //a level target is hit at the launch elevation, v^2 = g x / sin(2 theta)
+        constraints.impact_angle = 30.0;
+        auto solution = Charge::solve(simulation, constraints);
+        REQUIRE(solution.found);
+        REQUIRE(solution.impact_angle == Catch::Approx(30.0).margin(constraints.angle_tolerance));
+        REQUIRE(solution.elevation == Catch::Approx(solution.impact_angle).margin(0.1));
+        double low = std::sqrt(9.81 * 100.0 / std::sin(glm::radians(2.0 * (30.0 + constraints.angle_tolerance))));
+        double high = std::sqrt(9.81 * 100.0 / std::sin(glm::radians(2.0 * (30.0 - constraints.angle_tolerance))));
+        REQUIRE(solution.speed >= low - constraints.speed_tolerance);
+        REQUIRE(solution.speed <= high + constraints.speed_tolerance);
+        REQUIRE(solution.shots < 100);
+
+        //steeper than the slowest arc needs the high arc
+        constraints.impact_angle = 60.0;
+        REQUIRE_FALSE(Charge::solve(simulation, constraints).found);
+
+        //flatter than the line of sight to a target below
+        Simulation below(glm::dvec3(0.0), glm::dvec3(50.0, -30.0, 0.0), 100.0, 1.0, 0.01);
+        constraints.impact_angle = 20.0;
+        solution = Charge::solve(below, constraints);
+        REQUIRE_FALSE(solution.found);
+        REQUIRE(solution.solves == 0);
+    }
+
+    SECTION("Drag"){
+        Physics::AIR_DENSITY = 1.225;
+        Simulation far(glm::dvec3(0.0), glm::dvec3(300.0, 20.0, 50.0), 100.0, 1.0, 0.01);
+        Reachability::clearCache();
+        auto solution = Charge::solve(far, constraints);
+        REQUIRE(solution.found);
+        REQUIRE(solution.speed > Charge::vacuumSpeed(far.getShooterPosition(), far.getTargetPosition()));
+        //no envelope is swept behind the search, so every trajectory is in shots
+        REQUIRE(Reachability::cache().empty());
+        REQUIRE(solution.shots < 20 * solution.solves);
+        REQUIRE(solution.shots < 150);
+
+        far.setShootSpeed(solution.speed);
+        REQUIRE(far.find_angle_warm(solution.angle, 0.1).best_result.result == Simulation::ShotResultEnum::HIT);
+    }
+}
+
+TEST_CASE("Trajectory Stream Test", "[trajectory_stream]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    Simulation simulation(glm::dvec3(0.0), glm::dvec3(300.0, 0.0, 40.0), 100.0, 1.0, 0.001);
+    TrajectoryStream::Settings settings;
+    settings.chunk_samples = 500;
+
+    std::vector<TrajectoryStream::Sample> flown;
+    std::stringstream stream;
+    {
+        TrajectoryStream::Writer writer(stream, settings);
+        auto record = writer.callback();
+        writer.add(0.0, simulation.getShooterPosition());
+        flown.push_back({0.0, simulation.getShooterPosition()});
+        simulation.simulateShot(30.0, [&](const Position& position, const double& time){
+            record(position, time);
+            flown.push_back({time, position.position});
+        });
+        writer.finish();
+        REQUIRE(writer.samples() == flown.size());
+        REQUIRE(writer.bytes() == stream.str().size());
+    }
+    REQUIRE(flown.size() > 3000);
+    std::string bytes = stream.str();
+
+    SECTION("Round trip"){
+        //versus a dvec3 and a double per step
+        double ratio = (double)(flown.size() * 4 * sizeof(double)) / bytes.size();
+        REQUIRE(ratio > 10.0);
+
+        TrajectoryStream::Reader reader(stream);
+        REQUIRE(reader.indexed());
+        REQUIRE(reader.samples() == flown.size());
+        REQUIRE(reader.chunks() == (flown.size() + settings.chunk_samples - 1) / settings.chunk_samples);
+        auto samples = reader.readAll();
+        REQUIRE(samples.size() == flown.size());
+        double position_error = 0.0;
+        double time_error = 0.0;
+        for(size_t i = 0; i < samples.size(); i++){
+            position_error = std::max(position_error, glm::length(samples[i].position - flown[i].position));
+            time_error = std::max(time_error, std::abs(samples[i].time - flown[i].time));
+        }
+        REQUIRE(position_error <= std::sqrt(3.0) * settings.position_quantum / 2.0 + 1e-9);
+        REQUIRE(time_error <= settings.time_quantum / 2.0 + 1e-12);
+    }
+
+    SECTION("Random access"){
+        TrajectoryStream::Reader reader(stream);
+        size_t last = reader.chunks() - 1;
+        auto chunk = reader.chunk(3);
+        REQUIRE(chunk.size() == settings.chunk_samples);
+        REQUIRE(chunk.front().position == flown[3 * settings.chunk_samples].position);
+        REQUIRE(reader.chunk(last).back().time == Catch::Approx(flown.back().time).margin(settings.time_quantum));
+        REQUIRE(reader.findChunk(flown[3 * settings.chunk_samples + 10].time) == 3);
+        REQUIRE(reader.findChunk(-1.0) == 0);
+        REQUIRE(reader.findChunk(1e9) == last);
+    }
+
+    SECTION("Unfinished stream"){
+        //a writer that died half way leaves the chunks it wrote completely
+        std::stringstream whole(bytes);
+        TrajectoryStream::Reader reference(whole);
+        std::stringstream partial(bytes.substr(0, bytes.size() / 2));
+        TrajectoryStream::Reader reader(partial);
+        REQUIRE_FALSE(reader.indexed());
+        REQUIRE(reader.chunks() > 0);
+        REQUIRE(reader.chunks() < reference.chunks());
+        for(size_t i = 0; i < reader.chunks(); i++){
+            REQUIRE(reader.chunkTime(i) == reference.chunkTime(i));
+            REQUIRE(reader.chunk(i).back().position == reference.chunk(i).back().position);
+        }
+    }
+
+    SECTION("Not a stream"){
+        std::stringstream garbage("not a trajectory stream at all");
+        REQUIRE_THROWS(TrajectoryStream::Reader(garbage));
+    }
+
+    SECTION("Invalid quantum"){
+        std::stringstream output;
+        TrajectoryStream::Settings invalid = settings;
+        invalid.position_quantum = 0.0;
+        REQUIRE_THROWS_AS(TrajectoryStream::Writer(output, invalid), std::invalid_argument);
+        invalid = settings;
+        invalid.time_quantum = -0.001;
+        REQUIRE_THROWS_AS(TrajectoryStream::Writer(output, invalid), std::invalid_argument);
+        REQUIRE(output.str().empty());
+    }
+}
+
+TEST_CASE("Trace Test", "[trace]") {
+
+    Physics::AIR_DENSITY = 0.0;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.0000001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+    Simulation::REACHABILITY_PRECHECK = true;
+
+    auto count = [](const Trace::Snapshot& snapshot, const std::string& name){
+        size_t count = 0;
+        for(const auto& thread : snapshot.threads){
+            for(const auto& event : thread.events){
+                count += name == event.name;
+            }
+        }
+        return count;
+    };
+
+    Simulation simulation(glm::dvec3(0.0), glm::dvec3(100.0, 0.0, 0.0), 100.0, 1.0, 0.01);
+
+    SECTION("Off"){
+        Trace::stop();
+        Trace::clear();
+        simulation.find_angle_strategy();
+        REQUIRE(Trace::snapshot().events() == 0);
+    }
+
+    SECTION("Solve"){
+        Trace::start();
+        auto result = simulation.find_angle_strategy();
+        Trace::stop();
+        auto snapshot = Trace::snapshot();
+        REQUIRE(count(snapshot, "shot") == result.tries);
+        REQUIRE(count(snapshot, "iteration") == result.tries);
+        REQUIRE(count(snapshot, "strategy1") == 1);
+
+        //every shot inside the solve span
+        const Trace::Event* solve = nullptr;
+        for(const auto& thread : snapshot.threads){
+            for(const auto& event : thread.events){
+                if(std::string(event.name) == "strategy1"){
+                    solve = &event;
+                }
+            }
+        }
+        REQUIRE(solve != nullptr);
+        REQUIRE(std::string(solve->arg_name) == "shots");
+        REQUIRE(solve->arg == (int64_t)result.tries);
+        for(const auto& thread : snapshot.threads){
+            for(const auto& event : thread.events){
+                if(std::string(event.name) == "shot"){
+                    REQUIRE(event.start_ns >= solve->start_ns);
+                    REQUIRE(event.start_ns + event.duration_ns <= solve->start_ns + solve->duration_ns);
+                }
+            }
+        }
+
+        //nothing is recorded once stopped, clear() empties the buffers
+        simulation.find_angle_strategy();
+        REQUIRE(Trace::snapshot().events() == snapshot.events());
+        Trace::clear();
+        REQUIRE(Trace::snapshot().events() == 0);
+    }
+
+    SECTION("Threads"){
+        std::vector<Batch::Scenario> scenarios;
+        for(int i = 0; i < 12; i++){
+            scenarios.push_back({glm::dvec3(0.0), glm::dvec3(40.0 + 10.0 * i, 0.0, 0.0), 100.0, 1.0, 0.01, 1});
+        }
+        Trace::start();
+        Batch::run(scenarios, 3);
+        Trace::stop();
+        auto snapshot = Trace::snapshot();
+        REQUIRE(count(snapshot, "scenario") == scenarios.size());
+        REQUIRE(count(snapshot, "strategy1") == scenarios.size());
+        bool named = false;
+        for(const auto& thread : snapshot.threads){
+            named |= thread.name == "batch worker 1";
+        }
+        REQUIRE(named);
+
+        std::string json = Trace::toJson(snapshot);
+        REQUIRE(json.rfind("{\"displayTimeUnit\"", 0) == 0);
+        size_t complete = 0;
+        for(size_t at = json.find("\"ph\": \"X\""); at != std::string::npos; at = json.find("\"ph\": \"X\"", at + 1)){
+            complete++;
+        }
+        REQUIRE(complete == snapshot.events());
+        REQUIRE(json.find("\"thread_name\"") != std::string::npos);
+    }
+
+    SECTION("Full buffer"){
+        size_t capacity = Trace::CAPACITY;
+        Trace::CAPACITY = 4;
+        Trace::start();
+        std::thread([](){
+            Trace::setThreadName("small");
+            for(int i = 0; i < 10; i++){
+                Trace::Scope scope("event", "test");
+            }
+        }).join();
+        Trace::stop();
+        Trace::CAPACITY = capacity;
+        auto snapshot = Trace::snapshot();
+        REQUIRE(count(snapshot, "event") == 4);
+        REQUIRE(snapshot.dropped == 6);
+    }
+    Trace::stop();
+    Trace::clear();
+}
+
+TEST_CASE("Intercept Test", "[intercept]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    glm::dvec3 start(200.0, 30.0, 0.0);
+    glm::dvec3 velocity(-10.0, 0.0, 15.0);
+    glm::dvec3 acceleration(0.0, 0.0, -3.0);
+    auto truth = [&](double time){
+        return start + velocity * time + 0.5 * acceleration * time * time;
+    };
+    Simulation simulation(glm::dvec3(0.0), glm::dvec3(1.0, 0.0, 0.0), 150.0, 1.0, 0.01);
+    Intercept::Settings settings;
+
+    SECTION("Predictors"){
+        Track velocity_track(Track::CONSTANT_VELOCITY);
+        Track acceleration_track(Track::CONSTANT_ACCELERATION);
+        for(int i = 0; i < 10; i++){
+            velocity_track.observe(i * 0.1, truth(i * 0.1));
+            acceleration_track.observe(i * 0.1, truth(i * 0.1));
+        }
+        //out of order observations are dropped
+        velocity_track.observe(0.5, glm::dvec3(0.0));
+        REQUIRE(velocity_track.size() == 10);
+        REQUIRE(velocity_track.lastTime() == Catch::Approx(0.9));
+
+        REQUIRE(glm::length(acceleration_track.predict(3.0) - truth(3.0)) < 1e-6);
+        REQUIRE(glm::length(acceleration_track.getAcceleration() - acceleration) < 1e-6);
+        REQUIRE(glm::length(velocity_track.predict(3.0) - truth(3.0)) > glm::length(acceleration_track.predict(3.0) - truth(3.0)));
+
+        //a straight line is fitted exactly by both
+        Track line(Track::CONSTANT_ACCELERATION);
+        line.observe(0.0, start);
+        line.observe(1.0, start + velocity);
+        REQUIRE(glm::length(line.predict(2.0) - (start + 2.0 * velocity)) < 1e-9);
+    }
+
+    SECTION("Lead"){
+        Track track(Track::CONSTANT_ACCELERATION);
+        for(int i = 0; i < 10; i++){
+            track.observe(i * 0.1, truth(i * 0.1));
+        }
+        auto solution = Intercept::solve(simulation, track, 0.9, settings);
+        REQUIRE(solution.valid);
+        REQUIRE(solution.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(solution.flight_time > 0.0);
+        REQUIRE(solution.lead > 1.0);
+        //the shot arrives where the target will be
+        REQUIRE(glm::length(solution.aim_point - truth(solution.fire_time + solution.flight_time)) < 0.5);
+        simulation.setTargetPosition(solution.aim_point);
+        auto shot = simulation.simulateShot(solution.angle);
+        REQUIRE(shot.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(shot.time == Catch::Approx(solution.flight_time).margin(settings.tolerance * 2.0));
+
+        //the next period warm starts from this one
+        track.observe(1.0, truth(1.0));
+        auto next = Intercept::solve(simulation, track, 1.0, settings, &solution);
+        REQUIRE(next.valid);
+        REQUIRE(next.shots < solution.shots);
+
+        //latency moves the shot later along the track
+        Intercept::Settings delayed = settings;
+        delayed.latency = 0.5;
+        auto later = Intercept::solve(simulation, track, 1.0, delayed);
+        REQUIRE(later.valid);
+        REQUIRE(later.fire_time == Catch::Approx(1.5));
+        REQUIRE(glm::length(later.aim_point - truth(later.fire_time + later.flight_time)) < 0.5);
+    }
+
+    SECTION("Out of range"){
+        Track track;
+        track.observe(0.0, glm::dvec3(50000.0, 0.0, 0.0));
+        auto solution = Intercept::solve(simulation, track, 0.0, settings);
+        REQUIRE_FALSE(solution.valid);
+        REQUIRE(solution.result != Simulation::ShotResultEnum::HIT);
+        REQUIRE_FALSE(Intercept::solve(simulation, Track(), 0.0, settings).valid);
+    }
+}
+
+TEST_CASE("Tracker Test", "[tracker]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.01;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    Tracker::Settings settings;
+    settings.shoot_speed = 150.0;
+    settings.delta_time = 0.05;
+    settings.intercept.tolerance = 0.01;
+
+    SECTION("Hundreds of tracks"){
+        settings.period = 1.0;
+        settings.deadline = 1.0;
+        settings.threads = 2;
+        Tracker tracker(settings);
+        std::vector<uint64_t> ids;
+        for(int i = 0; i < 200; i++){
+            uint64_t id = tracker.addTrack(i % 2 ? Track::CONSTANT_ACCELERATION : Track::CONSTANT_VELOCITY);
+            glm::dvec3 start(60.0 + 0.25 * i, 5.0, 0.25 * (i - 100));
+            tracker.observe(id, 0.0, start);
+            tracker.observe(id, 0.1, start + glm::dvec3(-1.0, 0.0, 1.0));
+            tracker.observe(id, 0.2, start + glm::dvec3(-2.0, 0.0, 2.0));
+            ids.push_back(id);
+        }
+        REQUIRE_FALSE(tracker.observe(1000, 0.0, glm::dvec3(0.0)));
+        tracker.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        tracker.stop();
+
+        auto stats = tracker.stats();
+        REQUIRE(stats.tracks == 200);
+        REQUIRE(stats.solved >= 200);
+        for(uint64_t id : ids){
+            Tracker::Status status;
+            REQUIRE(tracker.latest(id, status));
+            REQUIRE(status.solves > 0);
+            REQUIRE(status.solution.valid);
+        }
+
+        REQUIRE(tracker.removeTrack(ids[0]));
+        Tracker::Status status;
+        REQUIRE_FALSE(tracker.latest(ids[0], status));
+        REQUIRE(tracker.stats().tracks == 199);
+    }
+
+    SECTION("Overload"){
+        //all released together with a deadline shorter than solving them all: the job running when the
+        //deadline passes is late and the ones after it are shed
+        settings.period = 0.005;
+        settings.deadline = 0.005;
+        settings.delta_time = 0.005;
+        Tracker tracker(settings);
+        std::vector<uint64_t> ids;
+        for(int i = 0; i < 200; i++){
+            uint64_t id = tracker.addTrack();
+            tracker.observe(id, 0.0, glm::dvec3(60.0 + 0.25 * i, 5.0, 0.0));
+            ids.push_back(id);
+        }
+        tracker.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        tracker.stop();
+
+        auto stats = tracker.stats();
+        REQUIRE(stats.missed > 0);
+        REQUIRE(stats.shed > 0);
+        REQUIRE(stats.max_lateness > 0.0);
+        REQUIRE(stats.missed <= stats.solved);
+
+        //once the load drops every track is solved again, even one whose average cost ran past the deadline
+        std::vector<uint64_t> kept(ids.begin(), ids.begin() + 4);
+        for(size_t i = kept.size(); i < ids.size(); i++){
+            REQUIRE(tracker.removeTrack(ids[i]));
+        }
+        std::map<uint64_t, uint64_t> solves;
+        for(uint64_t id : kept){
+            Tracker::Status status;
+            REQUIRE(tracker.latest(id, status));
+            solves[id] = status.solves;
+            tracker.tracks[id]->cost = 1.0;
+        }
+        tracker.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        tracker.stop();
+        for(uint64_t id : kept){
+            Tracker::Status status;
+            REQUIRE(tracker.latest(id, status));
+            REQUIRE(status.solves > solves[id]);
+        }
+        REQUIRE(tracker.stats().shed > stats.shed);
+    }
+}
+
+TEST_CASE("Modified Point Mass Test", "[physics]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+
+    //7.62 mm rifle bullet, 800 m/s from a 305 mm twist
+    Aerodynamics aerodynamics = {0.00782, 6.5e-8, 2.0, 2.5, -0.3, -0.01};
+    double rate = 2.0 * glm::pi<double>() * 800.0 / 0.305;
+    glm::dvec3 muzzle(800.0, 5.0, 0.0);
+
+    entt::registry registry;
+    auto launchInto = [&](entt::registry& target, double spin_rate, bool spinning){
+        auto projectile = target.create();
+        target.emplace<Position>(projectile, glm::dvec3(0.0), glm::dvec3(0.0));
+        target.emplace<Velocity>(projectile, muzzle);
+        target.emplace<Mass>(projectile, Mass{0.0097, 0.0000144});
+        if(spinning){
+            target.emplace<Spin>(projectile, Spin{spin_rate, glm::dvec3(0.0)});
+            target.emplace<Aerodynamics>(projectile, aerodynamics);
+        }
+        return projectile;
+    };
+    auto launch = [&](double spin_rate, bool spinning){
+        return launchInto(registry, spin_rate, spinning);
+    };
+    auto flyIn = [&](entt::registry& target, Physics::Model model, int steps){
+        Physics::MODEL = model;
+        for(int i = 0; i < steps; i++){
+            Physics::update(target, 0.001);
+        }
+        Physics::MODEL = Physics::POINT_MASS;
+    };
+    auto fly = [&](Physics::Model model, int steps){
+        flyIn(registry, model, steps);
+    };
+
+    SECTION("Without spin"){
+        //no Spin component leaves the point mass terms only, for every integrator
+        for(Physics::Integrator integrator : {Physics::TRAPEZOID, Physics::EULER, Physics::HEUN, Physics::RK4}){
+            Physics::INTEGRATOR = integrator;
+            registry.clear();
+            auto plain = launch(0.0, false);
+            fly(Physics::POINT_MASS, 500);
+            Position expected = registry.get<Position>(plain);
+            glm::dvec3 expected_velocity = registry.get<Velocity>(plain).velocity;
+
+            registry.clear();
+            plain = launch(0.0, false);
+            auto still = launch(0.0, true);
+            fly(Physics::MODIFIED_POINT_MASS, 500);
+            for(auto projectile : {plain, still}){
+                REQUIRE(glm::length(registry.get<Position>(projectile).position - expected.position) < 1e-9);
+                REQUIRE(glm::length(registry.get<Position>(projectile).previous_position - expected.previous_position) < 1e-9);
+                REQUIRE(glm::length(registry.get<Velocity>(projectile).velocity - expected_velocity) < 1e-9);
+            }
+        }
+    }
+
+    SECTION("Spin drift"){
+        auto right = launch(rate, true);
+        auto left = launch(-rate, true);
+        auto plain = launch(0.0, false);
+        fly(Physics::MODIFIED_POINT_MASS, 400);
+        double drift = registry.get<Position>(right).position.z;
+        fly(Physics::MODIFIED_POINT_MASS, 400);
+
+        //a right hand twist drifts right, looking down range with y up that is +z, and keeps drifting
+        REQUIRE(drift > 0.0);
+        REQUIRE(registry.get<Position>(right).position.z > 2.0 * drift);
+        REQUIRE(registry.get<Position>(right).position.z < 1.0);
+        REQUIRE(registry.get<Position>(left).position.z == Catch::Approx(-registry.get<Position>(right).position.z).margin(1e-9));
+        REQUIRE(registry.get<Position>(plain).position.z == 0.0);
+        //the lateral force barely changes the range
+        REQUIRE(registry.get<Position>(right).position.x == Catch::Approx(registry.get<Position>(plain).position.x).margin(0.01));
+
+        const Spin& spin = registry.get<Spin>(right);
+        REQUIRE(spin.rate > 0.0);
+        REQUIRE(spin.rate < rate);
+        REQUIRE(spin.yaw.z > 0.0);
+        REQUIRE(glm::length(spin.yaw) < glm::radians(1.0));
+        REQUIRE(glm::dot(spin.yaw, registry.get<Velocity>(right).velocity) == Catch::Approx(0.0).margin(1e-9));
+    }
+
+    SECTION("Parallel"){
+        //split into chunks on the shared pool, with and without spin mixed in the same chunks
+        entt::registry serial;
+        std::vector<entt::entity> projectiles, expected;
+        for(int i = 0; i < 10; i++){
+            projectiles.push_back(launch(rate * (i - 5) / 5.0, i % 3 != 0));
+            expected.push_back(launchInto(serial, rate * (i - 5) / 5.0, i % 3 != 0));
+        }
+        flyIn(serial, Physics::MODIFIED_POINT_MASS, 200);
+
+        size_t threshold = Physics::PARALLEL_THRESHOLD;
+        size_t chunk = Physics::PARALLEL_CHUNK;
+        Physics::PARALLEL_THRESHOLD = 1;
+        Physics::PARALLEL_CHUNK = 3;
+        fly(Physics::MODIFIED_POINT_MASS, 200);
+        Physics::PARALLEL_THRESHOLD = threshold;
+        Physics::PARALLEL_CHUNK = chunk;
+        for(size_t i = 0; i < projectiles.size(); i++){
+            REQUIRE(registry.get<Position>(projectiles[i]).position == serial.get<Position>(expected[i]).position);
+            REQUIRE(registry.get<Velocity>(projectiles[i]).velocity == serial.get<Velocity>(expected[i]).velocity);
+        }
+    }
+
+    SECTION("Lanes stay with the registry"){
+        //a second registry stepped in between does not disturb the first
+        entt::registry other;
+        auto first = launch(rate, true);
+        auto second = launchInto(other, -rate, true);
+        entt::registry serial;
+        auto expected = launchInto(serial, rate, true);
+        flyIn(serial, Physics::MODIFIED_POINT_MASS, 100);
+        Physics::MODEL = Physics::MODIFIED_POINT_MASS;
+        for(int i = 0; i < 100; i++){
+            Physics::update(registry, 0.001);
+            Physics::update(other, 0.001);
+        }
+        REQUIRE(registry.get<Position>(first).position == serial.get<Position>(expected).position);
+        REQUIRE(registry.get<Spin>(first).rate == serial.get<Spin>(expected).rate);
+        REQUIRE(other.get<Position>(second).position.z == Catch::Approx(-registry.get<Position>(first).position.z));
+
+        //writes to an entity already held are only seen after a reload
+        registry.get<Velocity>(first).velocity = glm::dvec3(0.0);
+        Physics::reloadModified(registry);
+        Physics::update(registry, 0.001);
+        REQUIRE(registry.get<Velocity>(first).velocity.x == 0.0);
+
+        //patching the mass reloads the drag without reloadModified()
+        registry.patch<Velocity>(first, [](Velocity& velocity){ velocity.velocity = glm::dvec3(100.0, 0.0, 0.0); });
+        Physics::update(registry, 0.001);
+        double light = 100.0 - registry.get<Velocity>(first).velocity.x;
+        REQUIRE(light > 0.0);
+        double before = registry.get<Velocity>(first).velocity.x;
+        registry.patch<Mass>(first, [](Mass& mass){ mass.mass *= 10.0; });
+        Physics::update(registry, 0.001);
+        REQUIRE(before - registry.get<Velocity>(first).velocity.x < 0.5 * light);
+    }
+
+    SECTION("Simulation"){
+        //155 mm shell, 800 m/s from a 20 calibre twist
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(3000.0, 0.0, 0.0), 800.0, 43.0, 0.01);
+        Aerodynamics shell = {0.155, 0.15, 2.0, 3.0, -0.3, -0.01};
+        double shell_rate = 2.0 * glm::pi<double>() * 800.0 / (20.0 * 0.155);
+        Physics::MODEL = Physics::MODIFIED_POINT_MASS;
+        REQUIRE(simulation.isPlanar());
+        simulation.setAerodynamics(shell, shell_rate);
+        REQUIRE(simulation.isSpinning());
+        REQUIRE_FALSE(simulation.isPlanar());
+
+        auto impactOf = [&](){
+            glm::dvec3 impact(0.0);
+            simulation.simulateShot(10.0, [&](const Position& position, const double& time){
+                impact = position.position;
+            });
+            return impact;
+        };
+        glm::dvec3 drifted = impactOf();
+        Physics::MODEL = Physics::POINT_MASS;
+        glm::dvec3 straight = impactOf();
+        REQUIRE(std::abs(straight.z) < 1e-9);
+        //a right hand twist drifts to the right of the line of fire, +z looking down +x with y up
+        REQUIRE(drifted.z > 0.01);
+
+        //spin settings are part of the shot key
+        Simulation::ShotCache cache(1024, 4);
+        simulation.setCache(&cache);
+        Physics::MODEL = Physics::MODIFIED_POINT_MASS;
+        simulation.simulateShot(10.0);
+        simulation.setAerodynamics(shell, shell_rate * 0.5);
+        simulation.simulateShot(10.0);
+        REQUIRE(cache.missCount() == 2);
+    }
+    Physics::MODEL = Physics::POINT_MASS;
+}
+
+TEST_CASE("Resumable Solve Test", "[resumable]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+    Simulation::REACHABILITY_PRECHECK = false;
+
+    std::vector<glm::dvec3> targets = {glm::dvec3(100.0, 0.0, 0.0), glm::dvec3(250.0, 40.0, 30.0), glm::dvec3(80.0, -20.0, -60.0), glm::dvec3(50000.0, 0.0, 0.0)};
+    std::vector<Simulation::Strategy> strategies = {Simulation::BISECTION, Simulation::THREE_POINT, Simulation::MULTI_RESOLUTION, Simulation::K_ARY};
+
+    SECTION("Same result as the blocking solve"){
+        for(const glm::dvec3& target : targets){
+            Simulation simulation(glm::dvec3(0.0), target, 100.0, 1.0, 0.01);
+            for(Simulation::Strategy strategy : strategies){
+                std::vector<double> blocking_angles;
+                auto blocking = simulation.find_angle(strategy, [&](const Simulation::ShotResult& result, const double& angle){
+                    blocking_angles.push_back(angle);
+                });
+
+                std::vector<double> angles;
+                ResumableSolve solve(simulation, strategy, [&](const Simulation::ShotResult& result, const double& angle){
+                    angles.push_back(angle);
+                });
+                ResumableSolve::Budget budget;
+                budget.steps = 97;
+                int resumes = 0;
+                while(!solve.resume(budget)){
+                    resumes++;
+                }
+                REQUIRE(resumes > 1);
+                REQUIRE(solve.done());
+                REQUIRE(solve.result().best_result.result == blocking.best_result.result);
+                REQUIRE(solve.result().best_result.distance == blocking.best_result.distance);
+                REQUIRE(solve.result().best_angle == blocking.best_angle);
+                REQUIRE(solve.result().tries == blocking.tries);
+                REQUIRE(angles == blocking_angles);
+            }
+        }
+    }
+
+    SECTION("Step budget"){
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(150.0, 10.0, 20.0), 100.0, 1.0, 0.01);
+        ResumableSolve solve(simulation, Simulation::BISECTION);
+        ResumableSolve::Budget budget;
+        budget.steps = 50;
+        uint64_t steps = 0;
+        double bracket = solve.bracket();
+        while(!solve.resume(budget)){
+            REQUIRE(solve.getSteps() - steps <= budget.steps);
+            REQUIRE(solve.getSteps() > steps);
+            REQUIRE(solve.bracket() <= bracket);
+            steps = solve.getSteps();
+            bracket = solve.bracket();
+        }
+        REQUIRE(solve.result().best_result.result == Simulation::ShotResultEnum::HIT);
+        //resuming a finished solve does nothing
+        steps = solve.getSteps();
+        REQUIRE(solve.resume(budget));
+        REQUIRE(solve.getSteps() == steps);
+    }
+
+    SECTION("Time budget"){
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(150.0, 10.0, 20.0), 100.0, 1.0, 0.001);
+        ResumableSolve solve(simulation, Simulation::THREE_POINT);
+        ResumableSolve::Budget budget;
+        budget.microseconds = 200.0;
+        int resumes = 0;
+        while(!solve.resume(budget)){
+            resumes++;
+        }
+        REQUIRE(resumes > 1);
+        REQUIRE(solve.result().best_result.result == Simulation::ShotResultEnum::HIT);
+    }
+
+    SECTION("Intermediate results"){
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(150.0, 10.0, 20.0), 100.0, 1.0, 0.01);
+        int reported = 0;
+        ResumableSolve solve(simulation, Simulation::BISECTION, [&](const Simulation::ShotResult& result, const double& angle){
+            reported++;
+        });
+        ResumableSolve::Budget budget;
+        budget.steps = 1;
+        double best = std::numeric_limits<double>::max();
+        while(!solve.resume(budget)){
+            REQUIRE(solve.result().best_result.distance <= best);
+            best = solve.result().best_result.distance;
+        }
+        REQUIRE(reported == (int)solve.getShots());
+        REQUIRE(solve.result().best_result.result == Simulation::ShotResultEnum::HIT);
+    }
+
+    SECTION("Shot cache"){
+        Simulation::ShotCache cache(1024, 4);
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(100.0, 0.0, 0.0), 100.0, 1.0, 0.01);
+        simulation.setCache(&cache);
+        ResumableSolve first(simulation, Simulation::BISECTION);
+        first.resume(ResumableSolve::Budget());
+        uint64_t misses = cache.missCount();
+        ResumableSolve second(simulation, Simulation::BISECTION);
+        second.resume(ResumableSolve::Budget());
+        REQUIRE(cache.missCount() == misses);
+        REQUIRE(second.getSteps() == 0);
+        REQUIRE(second.result().best_angle == first.result().best_angle);
+    }
+
+    SECTION("Unknown strategy"){
+        Simulation simulation(glm::dvec3(0.0), targets.front(), 100.0, 1.0, 0.01);
+        REQUIRE_THROWS_AS(ResumableSolve(simulation, (Simulation::Strategy)7), std::invalid_argument);
+        REQUIRE_THROWS_AS(simulation.find_angle((Simulation::Strategy)0), std::invalid_argument);
+    }
+
+    SECTION("Precheck"){
+        Simulation::REACHABILITY_PRECHECK = true;
+        for(const glm::dvec3& target : targets){
+            Simulation simulation(glm::dvec3(0.0), target, 100.0, 1.0, 0.01);
+            for(Simulation::Strategy strategy : strategies){
+                auto blocking = simulation.find_angle(strategy);
+                ResumableSolve solve(simulation, strategy);
+                ResumableSolve::Budget budget;
+                budget.steps = 97;
+                while(!solve.resume(budget)){}
+                REQUIRE(solve.result().best_result.result == blocking.best_result.result);
+                REQUIRE(solve.result().best_angle == blocking.best_angle);
+                REQUIRE(solve.result().tries == blocking.tries);
+                REQUIRE(solve.result().marginal == blocking.marginal);
+            }
+        }
+
+        //rejected before the first shot
+        Simulation simulation(glm::dvec3(0.0), targets.back(), 100.0, 1.0, 0.01);
+        ResumableSolve solve(simulation, Simulation::K_ARY);
+        ResumableSolve::Budget budget;
+        budget.steps = 1;
+        REQUIRE(solve.resume(budget));
+        REQUIRE(solve.getShots() == 0);
+        REQUIRE(solve.result().best_result.result == Simulation::ShotResultEnum::NO_IN_RANGE);
+        REQUIRE(solve.result().tries == 0);
+    }
+
+    SECTION("Strategy cache"){
+        Simulation::ShotCache cache(1024, 4);
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(250.0, 40.0, 30.0), 100.0, 1.0, 0.01);
+        simulation.setCache(&cache);
+        for(Simulation::Strategy strategy : strategies){
+            ResumableSolve live(simulation, strategy);
+            live.resume(ResumableSolve::Budget());
+            REQUIRE(live.getShots() > 0);
+
+            //the blocking solve finds what the live one stored, and the other way round
+            uint64_t misses = cache.missCount();
+            auto blocking = simulation.find_angle(strategy);
+            REQUIRE(cache.missCount() == misses);
+            REQUIRE(blocking.best_angle == live.result().best_angle);
+            REQUIRE(blocking.tries == live.result().tries);
+
+            ResumableSolve again(simulation, strategy);
+            REQUIRE(again.resume(ResumableSolve::Budget()));
+            REQUIRE(again.getShots() == 0);
+            REQUIRE(again.result().best_angle == live.result().best_angle);
+        }
+
+        //solves with callbacks neither read nor fill it
+        cache.clear();
+        int reported = 0;
+        ResumableSolve solve(simulation, Simulation::BISECTION, [&](const Simulation::ShotResult& result, const double& angle){
+            reported++;
+        });
+        solve.resume(ResumableSolve::Budget());
+        REQUIRE(reported > 0);
+        ResumableSolve after(simulation, Simulation::BISECTION);
+        after.resume(ResumableSolve::Budget());
+        REQUIRE(after.getShots() > 0);
+    }
+
+    Simulation::REACHABILITY_PRECHECK = true;
+}
+
+TEST_CASE("Planar Test", "[planar]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    //the same shot on both kernels
+    auto compare = [](Simulation& simulation, double angle){
+        Simulation::PLANAR = false;
+        std::vector<Position> full_steps;
+        auto full = simulation.simulateShot(angle, [&](const Position& position, const double& time){
+            full_steps.push_back(position);
+        });
+        Simulation::PLANAR = true;
+        std::vector<Position> planar_steps;
+        auto planar = simulation.simulateShot(angle, [&](const Position& position, const double& time){
+            planar_steps.push_back(position);
+        });
+        REQUIRE(planar.result == full.result);
+        REQUIRE(planar.distance == Catch::Approx(full.distance).margin(1e-6));
+        REQUIRE(planar.time == Catch::Approx(full.time).margin(1e-9));
+        REQUIRE(planar_steps.size() == full_steps.size());
+        for(size_t i = 0; i < full_steps.size(); i += 97){
+            REQUIRE(glm::length(planar_steps[i].position - full_steps[i].position) < 1e-6);
+            REQUIRE(glm::length(planar_steps[i].previous_position - full_steps[i].previous_position) < 1e-6);
+        }
+        //without a callback the miss is measured in the plane
+        auto bare = simulation.simulateShot(angle);
+        REQUIRE(bare.result == full.result);
+        REQUIRE(bare.distance == Catch::Approx(full.distance).margin(1e-6));
+        REQUIRE(bare.time == Catch::Approx(full.time).margin(1e-9));
+    };
+
+    SECTION("Same shots as the full kernel"){
+        for(Physics::Integrator integrator : {Physics::TRAPEZOID, Physics::EULER, Physics::HEUN, Physics::RK4}){
+            Physics::INTEGRATOR = integrator;
+            Simulation simulation(glm::dvec3(5.0, 2.0, -3.0), glm::dvec3(120.0, 10.0, 40.0), 100.0, 1.0, 0.01);
+            for(double angle : {0.0, 2.0, 7.5, 30.0, 60.0}){
+                compare(simulation, angle);
+            }
+            //straight up
+            Simulation vertical(glm::dvec3(0.0), glm::dvec3(0.0, 50.0, 0.0), 100.0, 1.0, 0.01);
+            compare(vertical, 0.0);
+        }
+        Physics::INTEGRATOR = Physics::TRAPEZOID;
+    }
+
+    SECTION("Target off the plane"){
+        //gravity leaning away from UP_VECTOR turns the plane away from the target
+        Physics::GRAVITY = glm::dvec3(0.5, -9.81, 0.8);
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(150.0, 0.0, 0.0), 100.0, 1.0, 0.01);
+        Simulation::Plane plane = simulation.planeOf(5.0);
+        REQUIRE(plane.offset2 > 0.0);
+        REQUIRE(glm::dot(plane.up, Physics::GRAVITY) < 0.0);
+        REQUIRE(std::abs(glm::dot(plane.downrange, Physics::GRAVITY)) < 1e-12);
+        for(double angle : {1.0, 5.0, 20.0}){
+            compare(simulation, angle);
+        }
+    }
+
+    SECTION("Terrain"){
+        int size = 201;
+        std::vector<double> ridge(size * size, 0.0);
+        for(int j = 0; j < size; j++){
+            for(int i = 140; i <= 145; i++){
+                ridge[j * size + i] = 20.0;
+            }
+        }
+        Terrain wall(size, size, 1.0, -100.0, -100.0, ridge);
+        Simulation simulation(glm::dvec3(0.0, 1.0, 0.0), glm::dvec3(80.0, 0.5, 0.0), 60.0, 1.0, 0.001);
+        simulation.setTerrain(&wall);
+        for(double angle : {0.0, 5.0, 30.0}){
+            compare(simulation, angle);
+        }
+    }
+
+    SECTION("Solve"){
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(120.0, 10.0, 40.0), 100.0, 1.0, 0.01);
+        Simulation::PLANAR = false;
+        auto full = simulation.find_angle_strategy();
+        Simulation::PLANAR = true;
+        auto planar = simulation.find_angle_strategy();
+        REQUIRE(planar.best_result.result == Simulation::ShotResultEnum::HIT);
+        REQUIRE(planar.best_angle == Catch::Approx(full.best_angle).margin(1e-6));
+
+        //resumed shots take the same path
+        ResumableSolve solve(simulation, Simulation::BISECTION);
+        ResumableSolve::Budget budget;
+        budget.steps = 100;
+        while(!solve.resume(budget)){}
+        REQUIRE(solve.result().best_angle == planar.best_angle);
+        REQUIRE(solve.result().tries == planar.tries);
+    }
+
+    SECTION("Detection"){
+        Simulation simulation(glm::dvec3(0.0), glm::dvec3(120.0, 10.0, 40.0), 100.0, 1.0, 0.01);
+        REQUIRE(simulation.isPlanar());
+        //the modified model is planar until the shell spins
+        Physics::MODEL = Physics::MODIFIED_POINT_MASS;
+        REQUIRE(simulation.isPlanar());
+        simulation.setAerodynamics({0.155, 0.15, 2.0, 3.0, -0.3, -0.01}, 1000.0);
+        REQUIRE_FALSE(simulation.isPlanar());
+        simulation.setAerodynamics({0.0, 0.0, 0.0, 0.0, 0.0, 0.0}, 0.0);
+        Physics::MODEL = Physics::POINT_MASS;
+        Simulation::PLANAR = false;
+        REQUIRE_FALSE(simulation.isPlanar());
+        Simulation::PLANAR = true;
+
+        //the kernels are not bit identical, so they do not share cached shots
+        Simulation::ShotCache cache(1024, 4);
+        simulation.setCache(&cache);
+        simulation.simulateShot(5.0);
+        Simulation::PLANAR = false;
+        simulation.simulateShot(5.0);
+        Simulation::PLANAR = true;
+        REQUIRE(cache.missCount() == 2);
+    }
+
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Simulation::PLANAR = true;
+}
+
+TEST_CASE("Planar Benchmark", "[.][benchmark]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+    Simulation::UP_VECTOR = glm::dvec3(0.0, 1.0, 0.0);
+    Simulation::HIT_TRASHOLD = 0.001;
+    Simulation::MAX_SIMULATION_TIME = 100.0;
+
+    Simulation simulation(glm::dvec3(0.0), glm::dvec3(400.0, 10.0, 150.0), 300.0, 1.0, 0.001);
+    BENCHMARK("full kernel"){
+        Simulation::PLANAR = false;
+        return simulation.simulateShot(3.0);
+    };
+    BENCHMARK("planar kernel"){
+        Simulation::PLANAR = true;
+        return simulation.simulateShot(3.0);
+    };
+    Simulation::PLANAR = true;
+}
+
+TEST_CASE("Physics Model Benchmark", "[.][benchmark]") {
+
+    Physics::AIR_DENSITY = 1.225;
+    Physics::GRAVITY = glm::dvec3(0.0, -9.81, 0.0);
+    Physics::INTEGRATOR = Physics::TRAPEZOID;
+
+    //one step of many projectiles, the modified model should stay within about twice the point mass
+    Aerodynamics aerodynamics = {0.00782, 6.5e-8, 2.0, 2.5, -0.3, -0.01};
+    entt::registry registry;
+    for(int i = 0; i < 4096; i++){
+        auto projectile = registry.create();
+        registry.emplace<Position>(projectile, glm::dvec3(0.0), glm::dvec3(0.0));
+        registry.emplace<Velocity>(projectile, glm::dvec3(800.0, 5.0 + i * 0.001, 0.0));
+        registry.emplace<Mass>(projectile, Mass{0.0097, 0.0000144});
+        registry.emplace<Spin>(projectile, Spin{16000.0, glm::dvec3(0.0)});
+        registry.emplace<Aerodynamics>(projectile, aerodynamics);
+    }
+
+    BENCHMARK("point mass"){
+        Physics::MODEL = Physics::POINT_MASS;
+        Physics::update(registry, 0.0001);
+    };
+    BENCHMARK("modified point mass"){
+        Physics::MODEL = Physics::MODIFIED_POINT_MASS;
+        Physics::update(registry, 0.0001);
+    };
+    Physics::MODEL = Physics::POINT_MASS;
+}